@@ -0,0 +1,295 @@
+// On target microbenchmarks of the latency critical firmware paths, built from the firmware sources.
+// Every result is one CSV line, so `idf.py monitor | grep ^BENCH` gives a table:
+//
+//   BENCH,<name>,<unit>,<count>,<first>,<min>,<median>,<max>
+//
+// first is the cold run, before the code is in the flash cache. The motors are only ever set to
+// speed 0 and no motor task runs, so the car can stay on the desk. The color sensor is read.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "bench.h"
+#include "controller.h"
+#include "control_protocol.h"
+#include "i2c_config.h"
+#include "led.h"
+#include "motor.h"
+#include "opt4060.h"
+#include "shared_state.h"
+
+static const char *TAG = "bench";
+
+#define BENCH_RUNS              200
+#define BENCH_BLE_HOST_PRIORITY (configMAX_PRIORITIES - 4)  // as nimble_port_freertos_init creates the host task
+
+static uint32_t results[BENCH_RUNS];
+static uint32_t results_extra[BENCH_RUNS];
+
+// one logged reading per class, from scripts/color_data.txt
+static const uint16_t readings[][4] = {
+        {484, 716, 188, 1600},      // red
+        {220, 460, 132, 1776},      // black
+        {432, 1352, 328, 2140},     // green
+        {1834, 1084, 1758, 2016},   // white
+};
+#define READING_COUNT (sizeof(readings) / sizeof(readings[0]))
+
+// the bench never drives, motor.c calls this after every target change
+void power_update(void)
+{
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// sorts values
+static void report(const char *name, const char *unit, uint32_t *values, int count)
+{
+    uint32_t first = values[0];
+
+    qsort(values, count, sizeof(values[0]), compare_u32);
+    printf("BENCH,%s,%s,%d,%lu,%lu,%lu,%lu\n", name, unit, count, first, values[0], values[count / 2],
+           values[count - 1]);
+}
+
+static void bench_predictor(void)
+{
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        const uint16_t *r = readings[i % READING_COUNT];
+        results[i] = bench_forward_float(r[0], r[1], r[2], r[3]);
+        results_extra[i] = bench_predict_float(r[0], r[1], r[2], r[3]);
+    }
+    report("forward_float", "cycles", results, BENCH_RUNS);
+    report("predict_float", "cycles", results_extra, BENCH_RUNS);
+
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        const uint16_t *r = readings[i % READING_COUNT];
+        results[i] = bench_forward_quantized(r[0], r[1], r[2], r[3]);
+        results_extra[i] = bench_predict_quantized(r[0], r[1], r[2], r[3]);
+    }
+    report("forward_int8", "cycles", results, BENCH_RUNS);
+    report("predict_int8", "cycles", results_extra, BENCH_RUNS);
+}
+
+// the whole read in us, and the CPU time to queue it in cycles
+static void bench_sensor(void)
+{
+    static const uint32_t speeds_hz[] = {100000, 400000, 800000, 1000000};
+    uint16_t red, green, blue, clear;
+    char name[32];
+
+    if (opt4060_init() != ESP_OK) {
+        ESP_LOGE(TAG, "No color sensor, skipping the bus benchmarks");
+        return;
+    }
+
+    for (int s = 0; s < sizeof(speeds_hz) / sizeof(speeds_hz[0]); s++) {
+        if (opt4060_set_bus_speed(speeds_hz[s]) != ESP_OK) {
+            continue;
+        }
+
+        int count = 0;
+        for (int i = 0; i < BENCH_RUNS; i++) {
+            int64_t start_us = esp_timer_get_time();
+            uint32_t start = esp_cpu_get_cycle_count();
+            esp_err_t err = opt4060_read_color_start();
+            uint32_t queued = esp_cpu_get_cycle_count() - start;
+            if (err == ESP_OK) {
+                err = opt4060_read_color_finish(&red, &green, &blue, &clear, pdMS_TO_TICKS(I2C_MASTER_TIMEOUT_MS));
+            }
+            if (err != ESP_OK) {
+                break;
+            }
+            results[count] = esp_timer_get_time() - start_us;
+            results_extra[count] = queued;
+            count++;
+        }
+        if (count == 0) {
+            ESP_LOGE(TAG, "Color reads fail at %lu Hz", speeds_hz[s]);
+            continue;
+        }
+
+        snprintf(name, sizeof(name), "opt4060_read_%luk", speeds_hz[s] / 1000);
+        report(name, "us", results, count);
+        snprintf(name, sizeof(name), "opt4060_start_%luk", speeds_hz[s] / 1000);
+        report(name, "cycles", results_extra, count);
+    }
+
+    opt4060_set_bus_speed(I2C_MASTER_FREQ_HZ);
+}
+
+static void bench_motor(void)
+{
+    const MotorPairUpdate stop = {{{0, 0, true}, {1, 0, true}}};
+
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        uint32_t start = esp_cpu_get_cycle_count();
+        set_motor_speed(i % NUM_MOTORS, 0, true);
+        results[i] = esp_cpu_get_cycle_count() - start;
+
+        start = esp_cpu_get_cycle_count();
+        set_motor_speeds(&stop);
+        results_extra[i] = esp_cpu_get_cycle_count() - start;
+    }
+    report("set_motor_speed", "cycles", results, BENCH_RUNS);
+    report("set_motor_speeds", "cycles", results_extra, BENCH_RUNS);
+}
+
+// handoff between two tasks at the priorities of a firmware path: the sender stamps the cycle count
+// and wakes the blocked receiver, which records how long that took
+typedef struct {
+    const char *name;
+    UBaseType_t sender_priority;
+    UBaseType_t receiver_priority;
+    bool queue;             // a one slot overwrite mailbox like motor_queue, else a task notification
+} handoff_t;
+
+static const handoff_t handoffs[] = {
+        {"notify_ble_host_to_controller", BENCH_BLE_HOST_PRIORITY, CONTROLLER_TASK_PRIORITY, false},
+        {"queue_controller_to_motor", CONTROLLER_TASK_PRIORITY, MOTOR_TASK_PRIORITY, true},
+};
+
+static const handoff_t *handoff;
+static volatile uint32_t handoff_stamp;
+static QueueHandle_t handoff_queue;
+static TaskHandle_t bench_task_handle;
+static TaskHandle_t sender_task_handle;
+static TaskHandle_t receiver_task_handle;
+
+static void handoff_receiver(void *arg)
+{
+    MotorPairUpdate update;
+
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        if (handoff->queue) {
+            xQueueReceive(handoff_queue, &update, portMAX_DELAY);
+        } else {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        results[i] = esp_cpu_get_cycle_count() - handoff_stamp;
+        xTaskNotifyGive(sender_task_handle);
+    }
+    xTaskNotifyGive(bench_task_handle);
+    vTaskDelete(NULL);
+}
+
+static void handoff_sender(void *arg)
+{
+    const MotorPairUpdate update = {{{0, 0, true}, {1, 0, true}}};
+
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        // a tick for the receiver to block again, its ack alone would let a higher priority
+        // sender run before it is back in its wait
+        vTaskDelay(1);
+        handoff_stamp = esp_cpu_get_cycle_count();
+        if (handoff->queue) {
+            xQueueOverwrite(handoff_queue, &update);
+        } else {
+            xTaskNotifyGive(receiver_task_handle);
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    vTaskDelete(NULL);
+}
+
+static void bench_handoff(void)
+{
+    handoff_queue = xQueueCreate(MOTOR_QUEUE_SIZE, sizeof(MotorPairUpdate));
+    if (handoff_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create handoff queue");
+        return;
+    }
+    bench_task_handle = xTaskGetCurrentTaskHandle();
+
+    for (int h = 0; h < sizeof(handoffs) / sizeof(handoffs[0]); h++) {
+        handoff = &handoffs[h];
+        if (xTaskCreate(handoff_receiver, "bench_receiver", 2048, NULL, handoff->receiver_priority,
+                        &receiver_task_handle) != pdPASS ||
+            xTaskCreate(handoff_sender, "bench_sender", 2048, NULL, handoff->sender_priority,
+                        &sender_task_handle) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create the handoff tasks");
+            return;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        report(handoff->name, "cycles", results, BENCH_RUNS);
+    }
+    vQueueDelete(handoff_queue);
+}
+
+// what the control write callback does, at the priority of the BLE host task that runs it.
+// The over the air part needs a central, see scripts/ble_latency.py.
+static void control_task(void *arg)
+{
+    uint8_t packet[sizeof(control_packet_header_t) + sizeof(control_setpoint_t)];
+    const control_setpoint_t setpoint = {0, 0, 0, 1};
+
+    memcpy(packet + sizeof(control_packet_header_t), &setpoint, sizeof(setpoint));
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        const control_packet_header_t header = {CONTROL_PROTOCOL_VERSION, 1, i + 1};
+        memcpy(packet, &header, sizeof(header));
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        control_protocol_receive(packet, sizeof(packet));
+        results[i] = esp_cpu_get_cycle_count() - start;
+
+        // let the controller task take the command, as it would between two writes
+        vTaskDelay(1);
+    }
+    xTaskNotifyGive(bench_task_handle);
+    vTaskDelete(NULL);
+}
+
+static void bench_control(void)
+{
+    // the command path as the firmware sets it up, minus BLE and the motor task
+    motor_queue = xQueueCreate(MOTOR_QUEUE_SIZE, sizeof(MotorPairUpdate));
+    if (motor_queue == NULL || shared_state_init() != ESP_OK || control_protocol_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up the command path");
+        return;
+    }
+    controller_init();
+
+    bench_task_handle = xTaskGetCurrentTaskHandle();
+    if (xTaskCreate(control_task, "bench_control", 3072, NULL, BENCH_BLE_HOST_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the control task");
+        return;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    report("control_protocol_receive", "cycles", results, BENCH_RUNS);
+}
+
+void app_main(void)
+{
+    esp_err_t nvs_err = nvs_flash_init();
+    if (nvs_err == ESP_ERR_NVS_NO_FREE_PAGES || nvs_err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        nvs_err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(nvs_err);
+
+    if (motor_pwm_init() != ESP_OK) {
+        return;
+    }
+    led_init();
+
+    printf("BENCH,cpu_mhz,%d\n", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    printf("BENCH,name,unit,count,first,min,median,max\n");
+    bench_predictor();
+    bench_motor();
+    bench_handoff();
+    bench_control();
+    bench_sensor();
+    printf("BENCH,done\n");
+}
@@ -0,0 +1,13 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+// CPU cycles of one forward pass, and of one predict_color_probabilities call, on raw sensor counts.
+// bench_float.c and bench_quantized.c build the same color_predictor.c with either engine.
+uint32_t bench_forward_float(uint16_t red, uint16_t green, uint16_t blue, uint16_t clear);
+uint32_t bench_predict_float(uint16_t red, uint16_t green, uint16_t blue, uint16_t clear);
+uint32_t bench_forward_quantized(uint16_t red, uint16_t green, uint16_t blue, uint16_t clear);
+uint32_t bench_predict_quantized(uint16_t red, uint16_t green, uint16_t blue, uint16_t clear);
+
+#endif // BENCH_H
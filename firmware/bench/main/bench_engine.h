@@ -0,0 +1,50 @@
+// The body of bench_float.c and bench_quantized.c: builds color_predictor.c once per engine, with its
+// public functions renamed so both fit into one app, and times its static forward() directly.
+// Define COLOR_PREDICTOR_QUANTIZED and BENCH_ENGINE before including.
+
+#include "esp_cpu.h"
+
+#define BENCH_CONCAT(name, engine)      name##_##engine
+#define BENCH_NAME(name, engine)        BENCH_CONCAT(name, engine)
+
+#define predict_color                       BENCH_NAME(predict_color, BENCH_ENGINE)
+#define predict_color_probabilities         BENCH_NAME(predict_color_probabilities, BENCH_ENGINE)
+#define color_predictor_get_model           BENCH_NAME(color_predictor_get_model, BENCH_ENGINE)
+#define color_predictor_get_builtin_model   BENCH_NAME(color_predictor_get_builtin_model, BENCH_ENGINE)
+#define color_predictor_set_model           BENCH_NAME(color_predictor_set_model, BENCH_ENGINE)
+
+#include "color_predictor.c"
+#include "bench.h"
+
+// keeps the compiler from dropping a forward pass whose output nobody reads
+static volatile float bench_sink;
+
+uint32_t BENCH_NAME(bench_forward, BENCH_ENGINE)(uint16_t red, uint16_t green, uint16_t blue, uint16_t clear)
+{
+#if COLOR_PREDICTOR_QUANTIZED
+    int32_t input[INPUT_SIZE] = {red, green, blue, clear};
+    int32_t output[OUTPUT_SIZE];
+#else
+    float input[INPUT_SIZE] = {red / 2048.0f, green / 2048.0f, blue / 2048.0f, clear / 2048.0f};
+    float output[OUTPUT_SIZE];
+#endif
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    forward(&color_model, input, output);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    bench_sink = output[0];
+    return cycles;
+}
+
+uint32_t BENCH_NAME(bench_predict, BENCH_ENGINE)(uint16_t red, uint16_t green, uint16_t blue, uint16_t clear)
+{
+    float probabilities[OUTPUT_SIZE];
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    uint32_t color = predict_color_probabilities(&color_model, red, green, blue, clear, probabilities);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    bench_sink = color;
+    return cycles;
+}
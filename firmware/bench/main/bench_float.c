@@ -0,0 +1,3 @@
+#define COLOR_PREDICTOR_QUANTIZED   0
+#define BENCH_ENGINE                float
+#include "bench_engine.h"
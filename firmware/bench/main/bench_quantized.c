@@ -0,0 +1,3 @@
+#define COLOR_PREDICTOR_QUANTIZED   1
+#define BENCH_ENGINE                quantized
+#include "bench_engine.h"
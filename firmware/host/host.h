@@ -0,0 +1,13 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+#include "led.h"
+
+// what the firmware logic last asked of the hardware, for the replay checks
+led_flash host_led_mode(void);
+
+// ms until the controller's command watchdog stops the motors, -1 while it is not running
+int64_t host_command_timer_remaining_ms(void);
+
+#endif // HOST_H
@@ -0,0 +1,467 @@
+// host replay and benchmark harness for the classifier and the game logic
+//
+//   replay --data <color_data.txt> [--min-accuracy <percent>] [--rounds <n>]
+//   replay --trace <file.trace>
+//   replay --tiles <color_data.txt>
+//
+// Exits non zero if the accuracy stays below --min-accuracy, an expectation of a trace fails or the
+// tile detector does not see every tile of a synthetic track exactly once.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "host.h"
+#include "esp_timer.h"
+#include "color_predictor.h"
+#include "controller.h"
+#include "control_protocol.h"
+#include "game_effect.h"
+#include "shared_state.h"
+#include "tile_detector.h"
+#include "tile_trigger.h"
+
+#define MAX_SAMPLES 4096
+
+// the class order of the model, see scripts/trainer.py
+static const char *color_names[OUTPUT_SIZE] = {"Red", "Black", "Green", "White"};
+
+typedef struct {
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+    uint16_t clear;
+    uint32_t label;
+} sample_t;
+
+static sample_t samples[MAX_SAMPLES];
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// samples logged by the firmware, "... Red: %d, Green: %d, Blue: %d, Clear: %d, Color: <name>"
+static int load_samples(const char *path)
+{
+    char line[256];
+    int count = 0;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL && count < MAX_SAMPLES) {
+        unsigned int r, g, b, c;
+        char name[16];
+        const char *values = strstr(line, "Red:");
+        if (values == NULL || sscanf(values, "Red: %u, Green: %u, Blue: %u, Clear: %u, Color: %15s",
+                                     &r, &g, &b, &c, name) != 5) {
+            continue;
+        }
+        for (uint32_t label = 0; label < OUTPUT_SIZE; label++) {
+            if (strcmp(name, color_names[label]) == 0) {
+                samples[count++] = (sample_t){r, g, b, c, label};
+                break;
+            }
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+// what tile_trigger and telemetry call, predict_color logs every prediction
+static uint32_t classify(const NeuralNetwork *nn, const sample_t *sample)
+{
+    float probabilities[OUTPUT_SIZE];
+    return predict_color_probabilities(nn, sample->red, sample->green, sample->blue, sample->clear, probabilities);
+}
+
+static int run_benchmark(const char *path, double min_accuracy, int rounds)
+{
+    const NeuralNetwork *nn = color_predictor_get_model();
+    uint32_t confusion[OUTPUT_SIZE][OUTPUT_SIZE] = {0};
+    int correct = 0;
+
+    int count = load_samples(path);
+    if (count <= 0) {
+        fprintf(stderr, "%s: no samples\n", path);
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        uint32_t predicted = classify(nn, &samples[i]);
+        confusion[samples[i].label][predicted]++;
+        correct += predicted == samples[i].label;
+    }
+
+    // volatile so the repeated predictions are not folded away
+    volatile uint32_t sink = 0;
+    int64_t start = now_ns();
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < count; i++) {
+            sink += classify(nn, &samples[i]);
+        }
+    }
+    double ns_per_inference = (double)(now_ns() - start) / ((double)rounds * count);
+
+    double accuracy = 100.0 * correct / count;
+    printf("engine: %s\n", COLOR_PREDICTOR_QUANTIZED ? "int8" : "float");
+    printf("samples: %d, accuracy: %.2f%%, %.1f ns per inference\n", count, accuracy, ns_per_inference);
+    printf("confusion (rows labeled, columns predicted):\n");
+    for (int label = 0; label < OUTPUT_SIZE; label++) {
+        printf("  %-6s", color_names[label]);
+        for (int predicted = 0; predicted < OUTPUT_SIZE; predicted++) {
+            printf(" %5u", confusion[label][predicted]);
+        }
+        printf("\n");
+    }
+
+    if (accuracy < min_accuracy) {
+        fprintf(stderr, "accuracy %.2f%% below the required %.2f%%\n", accuracy, min_accuracy);
+        return 1;
+    }
+    return 0;
+}
+
+// tile detection --------------------------------------------------------------------
+
+#define TILE_PERIOD_US  1000    // the color stream rate
+#define TILE_COUNT      16
+#define TILE_DWELL_SLACK 2      // samples, unconfident ones at the edges do not count for the tile
+
+// how many samples a tile lasts, from a crawl down to the vote window. TILE_VOTE_MAJORITY samples
+// are enough for a clean tile, but the log has two unconfident green readings in a row.
+static const int tile_dwells[] = {60, 25, 10, 6, TILE_VOTE_WINDOW};
+
+// next logged sample of a class, round robin
+static const sample_t *next_of(uint32_t label, int count)
+{
+    static int next[OUTPUT_SIZE];
+
+    for (int tries = 0; tries < count; tries++) {
+        const sample_t *sample = &samples[next[label]++ % count];
+        if (sample->label == label) {
+            return sample;
+        }
+    }
+    return &samples[0];
+}
+
+typedef struct {
+    tile_detector_t detector;
+    const uint32_t *colors;     // expected tile colors, repeating
+    int color_count;
+    int count;                  // logged samples
+    int dwell;
+    int64_t now;
+    int entries;
+    int exits;
+    int failures;
+} track_t;
+
+// classifies the next logged sample of label like tile_trigger does and checks what the detector makes of it
+static void feed(track_t *t, uint32_t label)
+{
+    const NeuralNetwork *nn = color_predictor_get_model();
+    const sample_t *sample = next_of(label, t->count);
+    float probabilities[OUTPUT_SIZE];
+    tile_detection_t left;
+
+    predict_color_probabilities(nn, sample->red, sample->green, sample->blue, sample->clear, probabilities);
+    unsigned int events = tile_detector_step(&t->detector, t->now,
+                                             tile_detector_label(probabilities, TILE_CONFIDENCE_THRESHOLD_PERCENT),
+                                             &left);
+    t->now += TILE_PERIOD_US;
+
+    if (events & TILE_DETECTOR_EXIT) {
+        int64_t dwell_us = left.last_us - left.entry_us + TILE_PERIOD_US;
+        if (dwell_us < (t->dwell - TILE_DWELL_SLACK) * TILE_PERIOD_US || dwell_us > t->dwell * TILE_PERIOD_US) {
+            printf("  tile %d: %lld us on it, expected %d\n", t->exits, (long long)dwell_us,
+                   t->dwell * TILE_PERIOD_US);
+            t->failures++;
+        }
+        t->exits++;
+    }
+    if (events & TILE_DETECTOR_ENTRY) {
+        if (t->entries >= TILE_COUNT || t->detector.tile.color != t->colors[t->entries % t->color_count]) {
+            printf("  unexpected %s tile after %d\n", color_names[t->detector.tile.color], t->entries);
+            t->failures++;
+        }
+        t->entries++;
+    }
+}
+
+// Drives a synthetic track past the detector: TILE_COUNT tiles of dwell samples each, built from
+// logged samples. Without a track class the tiles follow straight on each other, with one they are
+// separated by as much track and repeat colors. Longer tiles get a misclassified sample in the middle.
+static int replay_track(int count, uint8_t track_class, int dwell)
+{
+    static const uint32_t adjacent[] = {2, 0, 3, 1};            // green, red, white, black
+    static const uint32_t separated[] = {2, 2, 0, 3, 3, 0};     // no black, that is the track
+    bool on_track = track_class != TILE_NO_CLASS;
+    track_t t = {
+            .colors = on_track ? separated : adjacent,
+            .color_count = on_track ? 6 : 4,
+            .count = count,
+            .dwell = dwell,
+    };
+
+    tile_detector_init(&t.detector, track_class);
+    for (int tile = 0; tile < TILE_COUNT; tile++) {
+        uint32_t color = t.colors[tile % t.color_count];
+        for (int i = 0; on_track && i < dwell; i++) {
+            feed(&t, track_class);
+        }
+        for (int i = 0; i < dwell; i++) {
+            feed(&t, dwell >= 10 && i == dwell / 2 ? (color + 2) % OUTPUT_SIZE : color);
+        }
+    }
+    for (int i = 0; on_track && i < TILE_VOTE_WINDOW; i++) {
+        feed(&t, track_class);
+    }
+
+    // adjacent tiles never leave the last one
+    int expected_exits = on_track ? TILE_COUNT : TILE_COUNT - 1;
+    if (t.entries != TILE_COUNT || t.exits != expected_exits) {
+        printf("  %d entries and %d exits, expected %d and %d\n", t.entries, t.exits, TILE_COUNT, expected_exits);
+        t.failures++;
+    }
+    printf("%s, %d samples per tile: %s\n", on_track ? "tiles on track" : "adjacent tiles", dwell,
+           t.failures ? "FAIL" : "ok");
+    return t.failures;
+}
+
+static int replay_tiles(const char *path)
+{
+    int failures = 0;
+
+    int count = load_samples(path);
+    if (count <= 0) {
+        fprintf(stderr, "%s: no samples\n", path);
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(tile_dwells) / sizeof(tile_dwells[0]); i++) {
+        failures += replay_track(count, TILE_NO_CLASS, tile_dwells[i]);
+        failures += replay_track(count, 1, tile_dwells[i]);    // black track
+    }
+    return failures != 0;
+}
+
+// trace replay ----------------------------------------------------------------------
+
+static const char *game_names[] = {"red", "black", "green", "white", "yellow", "off"};
+static const char *led_names[] = {"const", "all", "back", "front", "front_alternate"};
+
+static int lookup(const char *name, const char *const *names, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// signed percent as in the control protocol, direction 1 is forward
+static int signed_speed(int speed, int direction)
+{
+    return direction ? speed : -speed;
+}
+
+// "packet <sequence> <offset_ms>:<a>:<b>:<duration> ..."
+static int replay_packet(char *args)
+{
+    uint8_t packet[CONTROL_PACKET_MAX_LEN];
+    control_packet_header_t header = {CONTROL_PROTOCOL_VERSION, 0, 0};
+    char *token = strtok(args, " \t");
+
+    if (token == NULL) {
+        return -1;
+    }
+    header.sequence = strtoul(token, NULL, 0);
+    while ((token = strtok(NULL, " \t")) != NULL && header.count < CONTROL_MAX_SETPOINTS) {
+        int offset, a, b, duration;
+        if (sscanf(token, "%d:%d:%d:%d", &offset, &a, &b, &duration) != 4) {
+            return -1;
+        }
+        control_setpoint_t setpoint = {offset, a, b, duration};
+        memcpy(packet + sizeof(header) + header.count * sizeof(setpoint), &setpoint, sizeof(setpoint));
+        header.count++;
+    }
+    memcpy(packet, &header, sizeof(header));
+    return control_protocol_receive(packet, sizeof(header) + header.count * sizeof(control_setpoint_t)) == ESP_OK ? 0 : -1;
+}
+
+// "rules <color> <duration_ms> <cooldown_ms> <speed_mode> <speed_arg> <led_mode> <priority>"
+static int replay_rules(const char *args)
+{
+    char color[16], led[24];
+    unsigned int duration, cooldown, mode, priority;
+    int arg;
+    uint8_t entry[1 + sizeof(game_effect_t)];
+
+    if (sscanf(args, "%15s %u %u %u %d %23s %u", color, &duration, &cooldown, &mode, &arg, led, &priority) != 7) {
+        return -1;
+    }
+    int index = lookup(color, game_names, GAME_EFFECT_COUNT);
+    int led_mode = lookup(led, led_names, 5);
+    if (index < 0 || led_mode < 0) {
+        return -1;
+    }
+    game_effect_t effect = {duration, cooldown, mode, arg, led_mode, priority};
+    entry[0] = index;
+    memcpy(entry + 1, &effect, sizeof(effect));
+    return game_effect_receive(entry, sizeof(entry)) == ESP_OK ? 0 : -1;
+}
+
+// returns 1 for a failed expectation, -1 for a line it does not understand
+static int replay_expect(const char *args, char *detail, size_t detail_len)
+{
+    char what[16], value[24];
+    int a, b;
+    shared_state_t state;
+
+    shared_state_read(&state);
+    if (sscanf(args, "speed %d %d", &a, &b) == 2) {
+        int actual_a = signed_speed(state.command.MotorASpeed, state.command.MotorADirection);
+        int actual_b = signed_speed(state.command.MotorBSpeed, state.command.MotorBDirection);
+        snprintf(detail, detail_len, "speed %d %d", actual_a, actual_b);
+        return actual_a != a || actual_b != b;
+    }
+    if (sscanf(args, "%15s %23s", what, value) != 2) {
+        return -1;
+    }
+    if (strcmp(what, "game") == 0) {
+        snprintf(detail, detail_len, "game %s", game_names[state.game]);
+        return lookup(value, game_names, GAME_OFF + 1) != (int)state.game;
+    }
+    if (strcmp(what, "timer") == 0) {
+        int64_t remaining = host_command_timer_remaining_ms();
+        if (remaining < 0) {
+            snprintf(detail, detail_len, "timer off");
+            return strcmp(value, "off") != 0;
+        }
+        snprintf(detail, detail_len, "timer %lld", (long long)remaining);
+        return strcmp(value, "off") == 0 || atoll(value) != remaining;
+    }
+    if (strcmp(what, "led") == 0) {
+        snprintf(detail, detail_len, "led %s", led_names[host_led_mode()]);
+        return lookup(value, led_names, 5) != (int)host_led_mode();
+    }
+    return -1;
+}
+
+// one event per line, "<ms> <event> <args>", times must not decrease, # starts a comment
+static int replay_trace(const char *path)
+{
+    char line[256];
+    int number = 0, failures = 0, expectations = 0;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char event[16], detail[64] = "";
+        long time_ms;
+        int consumed, result = 0;
+
+        number++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        if (sscanf(line, "%ld %15s %n", &time_ms, event, &consumed) != 2) {
+            continue;
+        }
+        char *args = line + consumed;
+        if (time_ms * 1000 < esp_timer_get_time()) {
+            fprintf(stderr, "%s:%d: time goes backwards\n", path, number);
+            fclose(file);
+            return 1;
+        }
+        host_advance_to(time_ms * 1000);
+
+        if (strcmp(event, "drive") == 0) {
+            int a, b, duration = 10;
+            result = sscanf(args, "%d %d %d", &a, &b, &duration) >= 2 ? 0 : -1;
+            set_motor_command((MotorCommand){abs(a), a >= 0, abs(b), b >= 0, duration});
+        } else if (strcmp(event, "packet") == 0) {
+            result = replay_packet(args);
+        } else if (strcmp(event, "tile") == 0) {
+            char color[16];
+            int index = sscanf(args, "%15s", color) == 1 ? lookup(color, game_names, GAME_EFFECT_COUNT) : -1;
+            if (index < 0) {
+                result = -1;
+            } else {
+                command_set_game_status(index);
+            }
+        } else if (strcmp(event, "freeze") == 0) {
+            controller_set_frozen(strncmp(args, "on", 2) == 0);
+        } else if (strcmp(event, "rules") == 0) {
+            result = replay_rules(args);
+        } else if (strcmp(event, "expect") == 0) {
+            expectations++;
+            result = replay_expect(args, detail, sizeof(detail));
+        } else {
+            result = -1;
+        }
+
+        if (result < 0) {
+            fprintf(stderr, "%s:%d: cannot replay '%s %s'\n", path, number, event, args);
+            failures++;
+        } else if (result > 0) {
+            fprintf(stderr, "%s:%d: expected %s, got %s\n", path, number, args, detail);
+            failures++;
+        }
+    }
+    fclose(file);
+
+    printf("%s: %d expectations, %d failures\n", path, expectations, failures);
+    return failures != 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *data = NULL;
+    const char *trace = NULL;
+    const char *tiles = NULL;
+    double min_accuracy = 0;
+    int rounds = 1000;
+    int failed = 0;
+
+    shared_state_init();
+    controller_init();
+    control_protocol_init();
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--data") == 0) {
+            data = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--min-accuracy") == 0) {
+            min_accuracy = atof(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--rounds") == 0) {
+            rounds = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--trace") == 0) {
+            // the game logic keeps its state, so one trace per run
+            trace = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--tiles") == 0) {
+            tiles = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--data file [--min-accuracy percent] [--rounds n]] [--trace file] "
+                            "[--tiles file]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (data != NULL) {
+        failed |= run_benchmark(data, min_accuracy, rounds > 0 ? rounds : 1);
+    }
+    if (trace != NULL) {
+        failed |= replay_trace(trace);
+    }
+    if (tiles != NULL) {
+        failed |= replay_tiles(tiles);
+    }
+    return failed;
+}
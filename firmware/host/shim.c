@@ -0,0 +1,267 @@
+// host implementations of the ESP-IDF and board functions the firmware logic calls
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "motor.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+
+// esp_timer on a virtual clock --------------------------------------------------
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    bool active;
+    int64_t due_us;
+    uint64_t period_us;     // 0 for one shot
+};
+
+static int64_t now_us = 0;
+
+// the timers that were ever created, in creation order
+#define HOST_MAX_TIMERS 32
+static esp_timer_handle_t timers[HOST_MAX_TIMERS];
+static int timer_count = 0;
+
+// every timer has to be known to host_advance_to, so creation registers it
+static esp_err_t register_timer(esp_timer_handle_t timer)
+{
+    if (timer_count == HOST_MAX_TIMERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    timers[timer_count++] = timer;
+    return ESP_OK;
+}
+
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    esp_timer_handle_t timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    *out_handle = timer;
+    return register_timer(timer);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->due_us = now_us + (int64_t)timeout_us;
+    timer->period_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    esp_err_t err = esp_timer_start_once(timer, period_us);
+    timer->period_us = period_us;
+    return err;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->active;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+static esp_timer_handle_t next_due(int64_t until_us)
+{
+    esp_timer_handle_t next = NULL;
+    for (int i = 0; i < timer_count; i++) {
+        if (timers[i]->active && timers[i]->due_us <= until_us && (next == NULL || timers[i]->due_us < next->due_us)) {
+            next = timers[i];
+        }
+    }
+    return next;
+}
+
+void host_advance_to(int64_t time_us)
+{
+    esp_timer_handle_t timer;
+
+    while ((timer = next_due(time_us)) != NULL) {
+        now_us = timer->due_us;
+        if (timer->period_us) {
+            timer->due_us += timer->period_us;
+        } else {
+            timer->active = false;
+        }
+        timer->callback(timer->arg);
+    }
+    if (time_us > now_us) {
+        now_us = time_us;
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return pdMS_TO_TICKS(now_us / 1000);
+}
+
+// FreeRTOS timers on the same clock ------------------------------------------------
+
+// one shot only, the controller's command watchdog is the only one
+typedef struct {
+    esp_timer_handle_t timer;
+    TimerCallbackFunction_t callback;
+    TickType_t period;
+} host_rtos_timer_t;
+
+static host_rtos_timer_t *last_rtos_timer;
+
+static void rtos_timer_expired(void *arg)
+{
+    host_rtos_timer_t *timer = arg;
+    timer->callback(timer);
+}
+
+// (re)starts the timer one period from now, like the timer task does for start, reset and change period
+static BaseType_t rtos_timer_restart(host_rtos_timer_t *timer)
+{
+    if (timer->period == 0) {
+        // configASSERT in the timer task on the target
+        fprintf(stderr, "timer period of 0 ticks\n");
+        abort();
+    }
+    esp_timer_stop(timer->timer);
+    esp_timer_start_once(timer->timer, (uint64_t)timer->period * portTICK_PERIOD_MS * 1000);
+    return pdPASS;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t reload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    (void)name, (void)reload, (void)id;
+    host_rtos_timer_t *timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) {
+        return NULL;
+    }
+    const esp_timer_create_args_t args = {.callback = rtos_timer_expired, .arg = timer};
+    if (esp_timer_create(&args, &timer->timer) != ESP_OK) {
+        free(timer);
+        return NULL;
+    }
+    timer->callback = callback;
+    timer->period = period;
+    last_rtos_timer = timer;
+    return timer;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return esp_timer_is_active(((host_rtos_timer_t *)timer)->timer) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait)
+{
+    (void)wait;
+    ((host_rtos_timer_t *)timer)->period = period;
+    return rtos_timer_restart(timer);
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait)
+{
+    (void)wait;
+    return rtos_timer_restart(timer);
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait)
+{
+    (void)wait;
+    return rtos_timer_restart(timer);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait)
+{
+    (void)wait;
+    esp_timer_stop(((host_rtos_timer_t *)timer)->timer);
+    return pdPASS;
+}
+
+int64_t host_command_timer_remaining_ms(void)
+{
+    if (last_rtos_timer == NULL || !esp_timer_is_active(last_rtos_timer->timer)) {
+        return -1;
+    }
+    return (last_rtos_timer->timer->due_us - now_us) / 1000;
+}
+
+// NVS, always empty --------------------------------------------------------------
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    (void)name;
+    *handle = 1;
+    return mode == NVS_READONLY ? ESP_ERR_NVS_NOT_FOUND : ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    (void)handle, (void)key, (void)value, (void)length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+{
+    (void)handle, (void)key, (void)value, (void)length;
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "error";
+}
+
+// board ---------------------------------------------------------------------------
+
+static led_flash led_mode = LED_CONST;
+
+void led_set_flash_mode(led_flash mode)
+{
+    led_mode = mode;
+}
+
+led_flash host_led_mode(void)
+{
+    return led_mode;
+}
+
+void motor_post_update(const MotorPairUpdate *update)
+{
+    (void)update;
+}
@@ -0,0 +1,9 @@
+// host shim: only the LEDC types the firmware headers name
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum { LEDC_LOW_SPEED_MODE } ledc_mode_t;
+typedef enum { LEDC_TIMER_0, LEDC_TIMER_1, LEDC_TIMER_2, LEDC_TIMER_3 } ledc_timer_t;
+typedef enum { LEDC_CHANNEL_0, LEDC_CHANNEL_1, LEDC_CHANNEL_2, LEDC_CHANNEL_3, LEDC_CHANNEL_4, LEDC_CHANNEL_5 } ledc_channel_t;
+typedef enum { LEDC_TIMER_10_BIT = 10, LEDC_TIMER_16_BIT = 16 } ledc_timer_bit_t;
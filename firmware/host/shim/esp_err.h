@@ -0,0 +1,19 @@
+// host shim of the ESP-IDF error codes used by the firmware logic
+#pragma once
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                      0
+#define ESP_FAIL                    -1
+#define ESP_ERR_NO_MEM              0x101
+#define ESP_ERR_INVALID_ARG         0x102
+#define ESP_ERR_INVALID_STATE       0x103
+#define ESP_ERR_INVALID_SIZE        0x104
+#define ESP_ERR_NOT_FOUND           0x105
+#define ESP_ERR_INVALID_VERSION     0x10A
+#define ESP_ERR_INVALID_CRC         0x109
+#define ESP_ERR_NVS_NOT_FOUND       0x1102
+
+const char *esp_err_to_name(esp_err_t code);
@@ -0,0 +1,20 @@
+// host shim of ESP_LOG, errors and warnings go to stderr, the rest only with HOST_LOG_VERBOSE
+#pragma once
+
+#include <stdio.h>
+
+#ifndef HOST_LOG_VERBOSE
+#define HOST_LOG_VERBOSE 0
+#endif
+
+// the format is not always a literal, so the prefix is printed on its own
+#define HOST_LOG(level, tag, format, ...) do {              \
+        fprintf(stderr, "%s (%s) ", level, tag);            \
+        fprintf(stderr, format, ##__VA_ARGS__);             \
+        fputc('\n', stderr);                                \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) do { if (HOST_LOG_VERBOSE) HOST_LOG("I", tag, format, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, format, ...) do { if (HOST_LOG_VERBOSE) HOST_LOG("D", tag, format, ##__VA_ARGS__); } while (0)
@@ -0,0 +1,39 @@
+// host shim of the FreeRTOS pieces the firmware logic uses, single threaded
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *QueueHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef void *TaskHandle_t;
+typedef void *TimerHandle_t;
+
+// storage of the static create calls, the shims never touch it
+typedef uint8_t StackType_t;
+typedef struct { int unused; } StaticTask_t;
+typedef struct { int unused; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+
+#define configTICK_RATE_HZ      100
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms) * configTICK_RATE_HZ / 1000)
+#define pdTICKS_TO_MS(ticks)    ((ticks) * 1000 / configTICK_RATE_HZ)
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY           0xffffffffu
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  1
+#define pdFAIL                  0
+#define IRAM_ATTR
+
+// one thread, so critical sections have nothing to exclude
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    {0}
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+
+TickType_t xTaskGetTickCount(void);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+
+// tasks are never started on the host, the harness calls into the logic directly
+static inline TaskHandle_t xTaskCreateStatic(TaskFunction_t task, const char *name, uint32_t stack, void *arg,
+                                             UBaseType_t priority, StackType_t *stack_buffer,
+                                             StaticTask_t *task_buffer)
+{
+    (void)task, (void)name, (void)stack, (void)arg, (void)priority, (void)stack_buffer, (void)task_buffer;
+    return NULL;
+}
+
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t task) { (void)task; return pdPASS; }
+static inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout)
+{
+    (void)clear, (void)timeout;
+    return 0;
+}
+static inline void vTaskDelay(TickType_t ticks) { (void)ticks; }
@@ -0,0 +1,2 @@
+// host shim, no ESP-IDF configuration
+#pragma once
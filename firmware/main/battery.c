@@ -1,52 +1,224 @@
 #include "battery.h"
-#include "esp_adc/adc_oneshot.h"
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_timer.h"
 #include "esp_log.h"
+#include "motor.h"
+#include "gatt_svr.h"
 
 static const char *TAG = "BATTERY";
 
 #define ADC_UNIT ADC_UNIT_1
 #define ADC_CHANNEL ADC_CHANNEL_2  // GPIO2 is ADC1_CHANNEL_2
 #define ADC_ATTEN ADC_ATTEN_DB_12
-#define ADC_BITWIDTH ADC_BITWIDTH_DEFAULT
+#define ADC_FRAME_BYTES (BATTERY_BURST_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES)
+#define ADC_READ_TIMEOUT_MS 20
 
-static adc_oneshot_unit_handle_t adc1_handle;
+static adc_continuous_handle_t adc_handle;
+static esp_timer_handle_t battery_timer = NULL;
+static TaskHandle_t battery_task_handle = NULL;
+static StackType_t battery_task_stack[BATTERY_TASK_STACK_SIZE];
+static StaticTask_t battery_task_buffer;
+static atomic_bool driving = false;
 
-esp_err_t battery_init(void) {
-    adc_oneshot_unit_init_cfg_t init_config1 = {
-            .unit_id = ADC_UNIT,
-            .ulp_mode = ADC_ULP_MODE_DISABLE,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config1, &adc1_handle));
+static atomic_uint battery_mv = 0;
+static atomic_uint battery_level = 0;
 
-    adc_oneshot_chan_cfg_t config = {
-            .atten = ADC_ATTEN,
-            .bitwidth = ADC_BITWIDTH,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, ADC_CHANNEL, &config));
+// resting voltage to state of charge of the single LiPo cell
+static const struct {
+    uint16_t millivolts;
+    uint8_t level;
+} soc_table[] = {
+        {3300, 0}, {3500, 5}, {3600, 10}, {3700, 25}, {3750, 40}, {3800, 55},
+        {3850, 65}, {3900, 75}, {4000, 85}, {4100, 95}, {4200, 100},
+};
+
+// correct the voltage readings
+// this is due to us reading through a 10k resistor instead of direct
+// this in turn creates a small voltage divider with the resistors inside the esp body
+// 3300 == 2556
+// 3700 == 2865
+// 4000 == 3025
+static uint32_t raw_to_millivolts(uint32_t raw)
+{
+    float millivolts = 1.4925f * raw - 511.83f;
+    return millivolts > 0 ? (uint32_t)millivolts : 0;
+}
+
+static uint8_t millivolts_to_level(uint32_t millivolts)
+{
+    const int last = sizeof(soc_table) / sizeof(soc_table[0]) - 1;
 
+    if (millivolts <= soc_table[0].millivolts) {
+        return 0;
+    }
+    for (int i = 1; i <= last; i++) {
+        if (millivolts < soc_table[i].millivolts) {
+            // linear between the two table points
+            uint32_t span = soc_table[i].millivolts - soc_table[i - 1].millivolts;
+            return soc_table[i - 1].level +
+                   (millivolts - soc_table[i - 1].millivolts) * (soc_table[i].level - soc_table[i - 1].level) / span;
+        }
+    }
+    return 100;
+}
+
+static int derated_speed_limit(uint32_t millivolts)
+{
+    if (millivolts >= BATTERY_DERATE_START_MV) {
+        return 100;
+    }
+    if (millivolts <= BATTERY_DERATE_END_MV) {
+        return BATTERY_DERATED_SPEED_PERCENT;
+    }
+    return BATTERY_DERATED_SPEED_PERCENT + (millivolts - BATTERY_DERATE_END_MV) *
+           (100 - BATTERY_DERATED_SPEED_PERCENT) / (BATTERY_DERATE_START_MV - BATTERY_DERATE_END_MV);
+}
+
+// one short DMA burst, the ADC is only running for its few milliseconds
+static esp_err_t read_burst(uint32_t *raw_average)
+{
+    static uint8_t frame[ADC_FRAME_BYTES];
+    uint32_t length = 0;
+    uint32_t sum = 0;
+    uint32_t count = 0;
+
+    esp_err_t err = adc_continuous_start(adc_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = adc_continuous_read(adc_handle, frame, sizeof(frame), &length, ADC_READ_TIMEOUT_MS);
+    adc_continuous_stop(adc_handle);
+    // drop whatever was converted past our frame, the next burst starts fresh
+    adc_continuous_flush_pool(adc_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t *result = (const adc_digi_output_data_t *)&frame[i];
+        if (result->type2.channel == ADC_CHANNEL) {
+            sum += result->type2.data;
+            count++;
+        }
+    }
+    if (count == 0) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    *raw_average = sum / count;
     return ESP_OK;
 }
 
-esp_err_t battery_read_voltage(float *voltage) {
-    int raw;
-    esp_err_t ret = adc_oneshot_read(adc1_handle, ADC_CHANNEL, &raw);
-    if (ret != ESP_OK) {
+static void battery_sample(void)
+{
+    uint32_t raw;
+
+    if (read_burst(&raw) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to read ADC value");
-        return ret;
+        return;
+    }
+    uint32_t sample = raw_to_millivolts(raw);
+
+    // first order filter with a time constant of 4 samples, seeded by the first one
+    uint32_t filtered = atomic_load(&battery_mv);
+    filtered = (filtered == 0) ? sample : (3 * filtered + sample) / 4;
+    atomic_store(&battery_mv, filtered);
+
+    motor_set_supply_voltage(filtered);
+    motor_set_speed_limit(derated_speed_limit(filtered));
+
+    // the level comes from the resting voltage only, the sag under load would make it jump around
+    if (!atomic_load(&driving)) {
+        uint8_t level = millivolts_to_level(filtered);
+        if (atomic_exchange(&battery_level, level) != level) {
+            ESP_LOGI(TAG, "Battery %lu mV, %d%%", filtered, level);
+            gatt_svr_battery_level_changed();
+        }
     }
+}
 
-    // Convert raw ADC value to voltage
-//    *voltage = (float)raw / (float)(1 << ADC_BITWIDTH) * 3.3f; // Assuming 0-3.3V range
-    *voltage = (float)raw;
+static void battery_timer_callback(void *arg)
+{
+    xTaskNotifyGive(battery_task_handle);
+}
 
-    // 3300 == 2556
-    // 3700 == 2865
-    // 4000 == 3025
+static void battery_task(void *pvParameters)
+{
+    while (1) {
+        battery_sample();
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
 
-    // correct the voltage readings
-    // this is due to us reading through a 10k resistor instead of direct
-    // this in turn creates a small voltage divider with the resistors inside the esp body
-    *voltage = (1.4925f * raw - 511.83f) / 1000.0f;
+esp_err_t battery_init(void) {
+    const adc_continuous_handle_cfg_t handle_config = {
+            .max_store_buf_size = 2 * ADC_FRAME_BYTES,
+            .conv_frame_size = ADC_FRAME_BYTES,
+    };
+    esp_err_t err = adc_continuous_new_handle(&handle_config, &adc_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the battery ADC: %s", esp_err_to_name(err));
+        return err;
+    }
 
-    return ESP_OK;
+    adc_digi_pattern_config_t pattern = {
+            .atten = ADC_ATTEN,
+            .channel = ADC_CHANNEL,
+            .unit = ADC_UNIT,
+            .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+    const adc_continuous_config_t config = {
+            .pattern_num = 1,
+            .adc_pattern = &pattern,
+            .sample_freq_hz = BATTERY_SAMPLE_FREQ_HZ,
+            .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+            .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
+    };
+    err = adc_continuous_config(adc_handle, &config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure the battery ADC: %s", esp_err_to_name(err));
+        // no task or timer either, the car runs on without battery readings
+        adc_continuous_deinit(adc_handle);
+        adc_handle = NULL;
+        return err;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+            .callback = battery_timer_callback,
+            .name = "battery",
+            .skip_unhandled_events = true,
+    };
+    err = esp_timer_create(&timer_args, &battery_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create battery timer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // samples once right away, so the feed-forward has a real value before the first drive
+    battery_task_handle = xTaskCreateStatic(battery_task, "battery_task", BATTERY_TASK_STACK_SIZE, NULL,
+                                            BATTERY_TASK_PRIORITY, battery_task_stack, &battery_task_buffer);
+    return esp_timer_start_periodic(battery_timer, BATTERY_IDLE_PERIOD_MS * 1000);
+}
+
+void battery_set_driving(bool is_driving)
+{
+    atomic_store(&driving, is_driving);
+    if (battery_timer == NULL) {
+        return;
+    }
+    esp_timer_stop(battery_timer);
+    esp_timer_start_periodic(battery_timer, (is_driving ? BATTERY_DRIVING_PERIOD_MS : BATTERY_IDLE_PERIOD_MS) * 1000);
+}
+
+uint32_t battery_get_millivolts(void)
+{
+    return atomic_load(&battery_mv);
+}
+
+uint8_t battery_get_level(void)
+{
+    return atomic_load(&battery_level);
 }
@@ -1,12 +1,33 @@
 #ifndef BATTERY_H
 #define BATTERY_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
 
-// Initializes the ADC for battery voltage measurement
+#define BATTERY_IDLE_PERIOD_MS      5000   // sample period while parked
+#define BATTERY_DRIVING_PERIOD_MS   50     // sample period while driving, tracks the sag under load
+#define BATTERY_SAMPLE_FREQ_HZ      20000  // ADC DMA rate during one burst
+#define BATTERY_BURST_SAMPLES       64     // conversions averaged per sample, about 3 ms of ADC time
+#define BATTERY_TASK_PRIORITY       3
+#define BATTERY_TASK_STACK_SIZE     2048   // bytes
+
+// low battery derating, on the filtered voltage under load
+#define BATTERY_DERATE_START_MV     3400   // full speed above this
+#define BATTERY_DERATE_END_MV       3200   // BATTERY_DERATED_SPEED_PERCENT at and below this
+#define BATTERY_DERATED_SPEED_PERCENT 50
+
+// Sets up the ADC and starts the background monitor. Every sample feeds the motor
+// feed-forward and derating; the level is published through the Battery Service.
 esp_err_t battery_init(void);
 
-// Reads the battery voltage
-esp_err_t battery_read_voltage(float *voltage);
+// Switches between the idle and driving sample period
+void battery_set_driving(bool driving);
+
+// Last filtered battery voltage, 0 before the first sample
+uint32_t battery_get_millivolts(void);
+
+// State of charge in percent from the resting voltage, for the Battery Level characteristic
+uint8_t battery_get_level(void);
 
 #endif // BATTERY_H
@@ -0,0 +1,73 @@
+#include "boot.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "boot";
+
+#define BOOT_STAGE_STACK_SIZE   3072
+#define BOOT_MAX_STAGES         4
+
+typedef struct {
+    const char *name;
+    esp_err_t (*run)(void);
+    EventBits_t ready_bit;
+} boot_stage_t;
+
+static EventGroupHandle_t ready_bits;
+static boot_stage_t stages[BOOT_MAX_STAGES];
+static int stage_count = 0;
+
+static void boot_stage_task(void *arg)
+{
+    const boot_stage_t *stage = arg;
+
+    esp_err_t err = stage->run();
+    if (err == ESP_OK) {
+        boot_set_ready(stage->ready_bit);
+        ESP_LOGI(TAG, "%s ready after %lld ms", stage->name, esp_timer_get_time() / 1000);
+    } else {
+        ESP_LOGE(TAG, "%s failed: %s", stage->name, esp_err_to_name(err));
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t boot_init(void)
+{
+    ready_bits = xEventGroupCreate();
+    if (ready_bits == NULL) {
+        ESP_LOGE(TAG, "Failed to create the ready event group");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t boot_start_stage(const char *name, esp_err_t (*stage)(void), EventBits_t ready_bit)
+{
+    if (stage_count == BOOT_MAX_STAGES) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    boot_stage_t *slot = &stages[stage_count++];
+    *slot = (boot_stage_t){name, stage, ready_bit};
+    if (xTaskCreate(boot_stage_task, name, BOOT_STAGE_STACK_SIZE, slot, BOOT_STAGE_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the %s stage task", name);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void boot_set_ready(EventBits_t bits)
+{
+    xEventGroupSetBits(ready_bits, bits);
+}
+
+bool boot_is_ready(EventBits_t bits)
+{
+    return (xEventGroupGetBits(ready_bits) & bits) == bits;
+}
+
+EventBits_t boot_wait(EventBits_t bits, uint32_t timeout_ms)
+{
+    return xEventGroupWaitBits(ready_bits, bits, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms)) & bits;
+}
@@ -0,0 +1,38 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+// Staged start up: independent hardware bring-up runs in parallel stage tasks, and every stage
+// sets its bit in one event group once it is ready. Whatever depends on a stage waits for its bit
+// instead of relying on the order of app_main; advertising waits for BOOT_CONTROL_READY, so the
+// first command a central sends is driven.
+
+#define BOOT_MOTOR_READY        (1 << 0)  // LEDC, ramps, motor task and LEDs
+#define BOOT_CONTROL_READY      (1 << 1)  // controller task, commands are driven from here on
+#define BOOT_BLE_SYNCED         (1 << 2)  // NimBLE host synced with the controller
+#define BOOT_SENSOR_READY       (1 << 3)  // color model, OPT4060, color stream, tile detection, calibration
+#define BOOT_BATTERY_READY      (1 << 4)  // ADC sampling
+
+#define BOOT_STAGE_PRIORITY     2       // above app_main, the stages mostly wait on the hardware
+// the slowest stage is a missing sensor: the config write and the bus wait each time out after
+// I2C_MASTER_TIMEOUT_MS (10 ms), plus the model and calibration reads from NVS
+#define BOOT_STAGE_TIMEOUT_MS   250
+
+esp_err_t boot_init(void);
+
+// Runs stage in a task of its own and sets ready_bit when it returns ESP_OK
+esp_err_t boot_start_stage(const char *name, esp_err_t (*stage)(void), EventBits_t ready_bit);
+
+void boot_set_ready(EventBits_t bits);
+
+// True if all of bits are set
+bool boot_is_ready(EventBits_t bits);
+
+// Waits until all of bits are set or timeout_ms passed, returns the bits of them that are set
+EventBits_t boot_wait(EventBits_t bits, uint32_t timeout_ms);
+
+#endif // BOOT_H
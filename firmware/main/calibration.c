@@ -0,0 +1,302 @@
+#include "calibration.h"
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "opt4060.h"
+#include "power.h"
+
+static const char *TAG = "calibration";
+
+#define CALIBRATION_NVS_NAMESPACE   "calib"
+#define CALIBRATION_NVS_KEY         "state"
+
+#define CHANNELS 4
+
+static const uint16_t reference_white[CHANNELS] = CALIBRATION_REFERENCE_WHITE;
+static const uint16_t reference_black[CHANNELS] = CALIBRATION_REFERENCE_BLACK;
+
+// mapped = raw * gain_q12 / 4096 + offset, per channel in r, g, b, c order
+typedef struct {
+    int32_t gain_q12[CHANNELS];
+    int32_t offset[CHANNELS];
+} channel_map_t;
+
+// state and map are guarded by calibration_lock, the map is read for every sample.
+// Only one change runs at a time, state.busy keeps the others out until it is done.
+static calibration_state_t state = {
+        .version = CALIBRATION_VERSION,
+        .range = CALIBRATION_DEFAULT_RANGE,
+        .conversion_time = OPT4060_CONVERSION_1MS,
+};
+static channel_map_t map;
+static portMUX_TYPE calibration_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// raw samples while a reference is captured
+static atomic_bool bypass = false;
+
+static esp_timer_handle_t capture_timer;
+static calibration_op_t capture_op;
+static uint32_t capture_cursor;
+static int64_t capture_start_us;
+
+static calibration_mode_t build_map(const calibration_state_t *calibration, channel_map_t *out)
+{
+    for (int i = 0; i < CHANNELS; i++) {
+        out->gain_q12[i] = 1 << 12;
+        out->offset[i] = 0;
+    }
+
+    if (calibration->black[3] != 0 && calibration->white[3] != 0) {
+        bool usable = true;
+        for (int i = 0; i < CHANNELS; i++) {
+            usable &= calibration->white[i] >= calibration->black[i] + CALIBRATION_MIN_SPAN;
+        }
+        if (usable) {
+            for (int i = 0; i < CHANNELS; i++) {
+                out->gain_q12[i] = ((reference_white[i] - reference_black[i]) << 12) /
+                                   (calibration->white[i] - calibration->black[i]);
+                out->offset[i] = reference_black[i] - ((calibration->black[i] * out->gain_q12[i]) >> 12);
+            }
+            return CALIBRATION_TWO_POINT;
+        }
+        ESP_LOGW(TAG, "White and black references too close, using the white gain only");
+    }
+
+    if (calibration->white[3] >= CALIBRATION_MIN_SPAN) {
+        for (int i = 0; i < CHANNELS; i++) {
+            out->gain_q12[i] = (reference_white[3] << 12) / calibration->white[3];
+        }
+        return CALIBRATION_GAIN;
+    }
+    return CALIBRATION_NONE;
+}
+
+// no auto range: the results are read without their exponent, so they are only linear in the light,
+// as both maps assume, while the range stays put
+static bool sensor_valid(uint8_t range, uint8_t conversion_time)
+{
+    return range <= OPT4060_RANGE_MAX && conversion_time <= OPT4060_CONVERSION_MAX;
+}
+
+static esp_err_t load_state(calibration_state_t *out)
+{
+    nvs_handle_t handle;
+    size_t len = sizeof(*out);
+
+    esp_err_t err = nvs_open(CALIBRATION_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_get_blob(handle, CALIBRATION_NVS_KEY, out, &len);
+    nvs_close(handle);
+
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (len != sizeof(*out) || out->version != CALIBRATION_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (!sensor_valid(out->range, out->conversion_time)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    out->busy = 0;
+    return ESP_OK;
+}
+
+static esp_err_t save_state(const calibration_state_t *calibration)
+{
+    nvs_handle_t handle;
+
+    esp_err_t err = nvs_open(CALIBRATION_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(handle, CALIBRATION_NVS_KEY, calibration, sizeof(*calibration));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+// publishes a changed calibration, ends the change and stores it
+static void commit(calibration_state_t *calibration)
+{
+    channel_map_t new_map;
+
+    calibration->mode = build_map(calibration, &new_map);
+    calibration->busy = 0;
+
+    portENTER_CRITICAL(&calibration_lock);
+    state = *calibration;
+    map = new_map;
+    portEXIT_CRITICAL(&calibration_lock);
+
+    esp_err_t err = save_state(calibration);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store the calibration: %s", esp_err_to_name(err));
+    }
+    ESP_LOGI(TAG, "Mode %d, white %u %u %u %u, black %u %u %u %u", calibration->mode,
+             calibration->white[0], calibration->white[1], calibration->white[2], calibration->white[3],
+             calibration->black[0], calibration->black[1], calibration->black[2], calibration->black[3]);
+}
+
+static void capture_timer_callback(void *arg)
+{
+    // skip what was sampled before the bypass took effect
+    int64_t from_us = capture_start_us + 2 * color_stream_period_us();
+    uint32_t sum[CHANNELS] = {0};
+    uint32_t count = 0;
+    color_sample_t sample;
+
+    while (color_stream_read(&capture_cursor, &sample)) {
+        if (sample.timestamp_us < from_us) {
+            continue;
+        }
+        sum[0] += sample.red;
+        sum[1] += sample.green;
+        sum[2] += sample.blue;
+        sum[3] += sample.clear;
+        count++;
+    }
+    power_set_calibrating(false);
+    atomic_store(&bypass, false);
+
+    calibration_state_t calibration;
+    calibration_get_state(&calibration);
+    if (count == 0) {
+        ESP_LOGE(TAG, "No samples to calibrate with");
+        portENTER_CRITICAL(&calibration_lock);
+        state.busy = 0;
+        portEXIT_CRITICAL(&calibration_lock);
+        return;
+    }
+
+    // the state is packed, so no pointers into it
+    uint16_t reference[CHANNELS];
+    for (int i = 0; i < CHANNELS; i++) {
+        reference[i] = sum[i] / count;
+    }
+    if (capture_op == CALIBRATION_OP_CAPTURE_WHITE) {
+        memcpy(calibration.white, reference, sizeof(reference));
+    } else {
+        memcpy(calibration.black, reference, sizeof(reference));
+    }
+    commit(&calibration);
+}
+
+esp_err_t calibration_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+            .callback = capture_timer_callback,
+            .name = "calibration",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &capture_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create capture timer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    calibration_state_t calibration;
+    err = load_state(&calibration);
+    if (err == ESP_OK) {
+        channel_map_t new_map;
+        calibration.mode = build_map(&calibration, &new_map);
+        portENTER_CRITICAL(&calibration_lock);
+        state = calibration;
+        map = new_map;
+        portEXIT_CRITICAL(&calibration_lock);
+    } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Stored calibration not usable (%s), using raw counts", esp_err_to_name(err));
+    }
+
+    color_stream_set_sensor(state.range, state.conversion_time);
+    return ESP_OK;
+}
+
+void calibration_apply(color_sample_t *sample)
+{
+    uint16_t *channels[CHANNELS] = {&sample->red, &sample->green, &sample->blue, &sample->clear};
+    channel_map_t current;
+    uint8_t mode;
+
+    if (atomic_load_explicit(&bypass, memory_order_relaxed)) {
+        return;
+    }
+
+    portENTER_CRITICAL(&calibration_lock);
+    mode = state.mode;
+    current = map;
+    portEXIT_CRITICAL(&calibration_lock);
+
+    if (mode == CALIBRATION_NONE) {
+        return;
+    }
+    for (int i = 0; i < CHANNELS; i++) {
+        int32_t value = ((*channels[i] * current.gain_q12[i]) >> 12) + current.offset[i];
+        *channels[i] = value < 0 ? 0 : value > CALIBRATION_MAX_COUNT ? CALIBRATION_MAX_COUNT : value;
+    }
+}
+
+esp_err_t calibration_receive(const uint8_t *data, uint16_t len)
+{
+    calibration_state_t calibration;
+
+    if (len == 0 || (data[0] == CALIBRATION_OP_SENSOR ? len != 3 : len != 1)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (data[0] == CALIBRATION_OP_SENSOR && !sensor_valid(data[1], data[2])) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (data[0] < CALIBRATION_OP_CAPTURE_WHITE || data[0] > CALIBRATION_OP_SENSOR) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&calibration_lock);
+    bool busy = state.busy;
+    state.busy = 1;
+    calibration = state;
+    portEXIT_CRITICAL(&calibration_lock);
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    switch (data[0]) {
+        case CALIBRATION_OP_CAPTURE_WHITE:
+        case CALIBRATION_OP_CAPTURE_BLACK:
+            // finished by capture_timer_callback
+            capture_op = data[0];
+            atomic_store(&bypass, true);
+            capture_start_us = esp_timer_get_time();
+            capture_cursor = color_stream_cursor();
+            power_set_calibrating(true);
+            esp_timer_start_once(capture_timer, CALIBRATION_CAPTURE_MS * 1000);
+            ESP_LOGI(TAG, "Capturing the %s reference", data[0] == CALIBRATION_OP_CAPTURE_WHITE ? "white" : "black");
+            return ESP_OK;
+
+        case CALIBRATION_OP_SENSOR:
+            // the counts depend on both settings, references taken with the old ones no longer fit
+            calibration.range = data[1];
+            calibration.conversion_time = data[2];
+            color_stream_set_sensor(data[1], data[2]);
+            // fall through
+        case CALIBRATION_OP_CLEAR:
+            memset(calibration.white, 0, sizeof(calibration.white));
+            memset(calibration.black, 0, sizeof(calibration.black));
+            commit(&calibration);
+            return ESP_OK;
+
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
+
+void calibration_get_state(calibration_state_t *out)
+{
+    portENTER_CRITICAL(&calibration_lock);
+    *out = state;
+    portEXIT_CRITICAL(&calibration_lock);
+}
@@ -0,0 +1,73 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "color_stream.h"
+
+// Lighting normalization in front of the classifier: every color stream sample is mapped from this
+// car's sensor under this venue's light into the counts of the reference white and black the model
+// was trained on, so a new venue or ride height takes a calibration instead of a new model.
+//
+// - two point, after a white and a black capture: each channel is mapped linearly so the captured
+//   references land on the reference ones, which covers per channel gain and ambient offset
+// - gain, after a white capture only: every channel is scaled by the clear channel ratio of the
+//   white reference, a pure brightness correction
+// - none: raw counts
+//
+// Consumers of the color stream (tiles, telemetry, training data capture) all see the mapped counts.
+// Sensor range and conversion time are set here as well, and kept in NVS with the references. The range
+// is a fixed one, auto range would rescale the counts by powers of two under the maps; a stored
+// calibration from an auto range firmware is dropped on boot.
+//
+// write: op (u8), for CALIBRATION_OP_SENSOR followed by range (u8) and conversion time (u8), see opt4060.h.
+//        A capture averages CALIBRATION_CAPTURE_MS of samples, the car has to sit still on the tile.
+// read:  calibration_state_t
+
+#define CALIBRATION_VERSION         1
+#define CALIBRATION_CAPTURE_MS      100     // the color stream ring keeps about 128 samples
+#define CALIBRATION_MIN_SPAN        64      // white - black counts a channel needs for a two point map
+#define CALIBRATION_MAX_COUNT       4095    // 12 bit results
+#ifndef CALIBRATION_DEFAULT_RANGE
+#define CALIBRATION_DEFAULT_RANGE   4       // mid scale until a venue sets its own, 0 - OPT4060_RANGE_MAX
+#endif
+
+// the training venue, averages of the white and black samples in scripts/color_data.txt: r, g, b, c
+#define CALIBRATION_REFERENCE_WHITE {1929, 1973, 1837, 2116}
+#define CALIBRATION_REFERENCE_BLACK {221, 462, 129, 1784}
+
+typedef enum {
+    CALIBRATION_NONE = 0,
+    CALIBRATION_GAIN,
+    CALIBRATION_TWO_POINT,
+} calibration_mode_t;
+
+typedef enum {
+    CALIBRATION_OP_CAPTURE_WHITE = 1,
+    CALIBRATION_OP_CAPTURE_BLACK,
+    CALIBRATION_OP_CLEAR,           // forget both references
+    CALIBRATION_OP_SENSOR,
+} calibration_op_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t mode;               // calibration_mode_t
+    uint8_t busy;               // 1 while a capture runs
+    uint8_t range;
+    uint8_t conversion_time;
+    uint16_t white[4];          // captured references, r, g, b, c, all 0 when not captured
+    uint16_t black[4];
+} calibration_state_t;
+
+// Loads the references and the sensor settings from NVS, call after color_stream_start
+esp_err_t calibration_init(void);
+
+// Maps a raw sample in place, called by the color stream for every sample
+void calibration_apply(color_sample_t *sample);
+
+esp_err_t calibration_receive(const uint8_t *data, uint16_t len);
+
+void calibration_get_state(calibration_state_t *state);
+
+#endif // CALIBRATION_H
@@ -0,0 +1,160 @@
+#include "capture.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include "color_stream.h"
+#include "gatt_svr.h"
+#include "power.h"
+
+static const char *TAG = "capture";
+
+// ATT notification header: opcode and attribute handle
+#define ATT_NOTIFY_OVERHEAD 3
+
+static esp_timer_handle_t flush_timer;
+static TaskHandle_t capture_task_handle = NULL;
+static StackType_t capture_task_stack[CAPTURE_TASK_STACK_SIZE];
+static StaticTask_t capture_task_buffer;
+
+// only written by the BLE host task, read by the capture task
+static volatile uint16_t capture_conn = BLE_HS_CONN_HANDLE_NONE;
+static volatile uint8_t capture_label = CAPTURE_LABEL_NONE;
+
+static void flush_timer_callback(void *arg)
+{
+    xTaskNotifyGive(capture_task_handle);
+}
+
+// samples per notification for the negotiated MTU
+static int batch_size(uint16_t conn_handle)
+{
+    int fit = (ble_att_mtu(conn_handle) - ATT_NOTIFY_OVERHEAD - (int)sizeof(capture_header_t)) /
+              (int)sizeof(capture_sample_t);
+    return fit < 1 ? 1 : fit > CAPTURE_MAX_BATCH ? CAPTURE_MAX_BATCH : fit;
+}
+
+// sends one batch, false if the host is out of buffers and the batch has to wait
+static bool send_batch(uint16_t conn_handle, const uint8_t *batch, size_t len)
+{
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(batch, len);
+    if (om == NULL) {
+        return false;
+    }
+    // the host frees om in any case
+    return ble_gatts_notify_custom(conn_handle, capture_val_handle, om) == 0;
+}
+
+static void capture_task(void *pvParameters)
+{
+    static uint8_t batch[sizeof(capture_header_t) + CAPTURE_MAX_BATCH * sizeof(capture_sample_t)];
+    capture_header_t header = {.version = CAPTURE_VERSION};
+    capture_sample_t *samples = (capture_sample_t *)(batch + sizeof(header));
+    uint32_t cursor = 0;
+    uint32_t dropped = 0;
+    bool pending = false;   // a full batch that did not fit into the host buffers yet
+    uint8_t label = CAPTURE_LABEL_NONE;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint16_t conn_handle = capture_conn;
+        if (capture_label != label) {
+            // a new label starts from the current sample, nothing of the old one leaks into it
+            label = capture_label;
+            cursor = color_stream_cursor();
+            header.count = 0;
+            dropped = 0;
+            pending = false;
+        }
+        if (label == CAPTURE_LABEL_NONE || conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+            continue;
+        }
+
+        int max = batch_size(conn_handle);
+        while (1) {
+            if (!pending) {
+                color_sample_t sample;
+                while (header.count < max) {
+                    uint32_t expected = cursor;
+                    if (!color_stream_read(&cursor, &sample)) {
+                        break;
+                    }
+                    // the ring skipped what we could not keep up with
+                    dropped += cursor - expected - 1;
+                    samples[header.count++] = (capture_sample_t) {sample.red, sample.green, sample.blue, sample.clear};
+                }
+                if (header.count < max) {
+                    break;  // partial batch, topped up on the next flush
+                }
+                header.label = label;
+                header.dropped = dropped > UINT8_MAX ? UINT8_MAX : dropped;
+                memcpy(batch, &header, sizeof(header));
+                pending = true;
+            }
+
+            if (!send_batch(conn_handle, batch, sizeof(header) + header.count * sizeof(capture_sample_t))) {
+                break;  // retried on the next flush, the ring keeps sampling meanwhile
+            }
+            header.sequence++;
+            header.count = 0;
+            dropped = 0;
+            pending = false;
+        }
+    }
+}
+
+esp_err_t capture_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+            .callback = flush_timer_callback,
+            .name = "capture",
+            .skip_unhandled_events = true,
+    };
+
+    esp_err_t err = esp_timer_create(&timer_args, &flush_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create capture timer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    capture_task_handle = xTaskCreateStatic(capture_task, "capture_task", CAPTURE_TASK_STACK_SIZE, NULL,
+                                            CAPTURE_TASK_PRIORITY, capture_task_stack, &capture_task_buffer);
+    return ESP_OK;
+}
+
+esp_err_t capture_set_label(uint16_t conn_handle, uint8_t label)
+{
+    if (label > CAPTURE_MAX_LABEL && label != CAPTURE_LABEL_NONE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    capture_conn = label == CAPTURE_LABEL_NONE ? BLE_HS_CONN_HANDLE_NONE : conn_handle;
+    capture_label = label;
+
+    esp_timer_stop(flush_timer);
+    if (label != CAPTURE_LABEL_NONE) {
+        esp_timer_start_periodic(flush_timer, CAPTURE_FLUSH_MS * 1000);
+    }
+    // the sensor otherwise only runs while driving
+    power_set_capture(label != CAPTURE_LABEL_NONE);
+    // let the task pick up the new label right away
+    xTaskNotifyGive(capture_task_handle);
+
+    ESP_LOGI(TAG, "Capture label %u", label);
+    return ESP_OK;
+}
+
+uint8_t capture_get_label(void)
+{
+    return capture_label;
+}
+
+void capture_disconnected(uint16_t conn_handle)
+{
+    if (conn_handle == capture_conn) {
+        capture_set_label(conn_handle, CAPTURE_LABEL_NONE);
+    }
+}
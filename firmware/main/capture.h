@@ -0,0 +1,51 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Training data capture: streams every color sensor sample, tagged with the label the trainer
+// is collecting, as notifications of the capture characteristic. All fields are little endian.
+//
+// write: label (u8), the class index as in game_status (0 red, 1 black, 2 green, 3 white),
+//        CAPTURE_LABEL_NONE stops the capture
+// read:  the active label, CAPTURE_LABEL_NONE when idle
+// notification: header, then count samples
+//
+// The car has to be subscribed to and parked; the sensor runs at its full rate while capturing, and the
+// samples are calibrated like every other, see calibration.h.
+
+#define CAPTURE_VERSION         1
+#define CAPTURE_LABEL_NONE      0xFF
+#define CAPTURE_MAX_LABEL       3
+#define CAPTURE_FLUSH_MS        20     // the color stream ring holds 128 ms, so this leaves plenty of slack
+#define CAPTURE_MAX_BATCH       32
+#define CAPTURE_TASK_PRIORITY   4
+#define CAPTURE_TASK_STACK_SIZE 2048    // bytes
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t label;
+    uint16_t sequence;      // per notification, a gap means notifications were lost
+    uint8_t count;
+    uint8_t dropped;        // samples the sensor produced that could not be sent, since the last batch
+} capture_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+    uint16_t clear;
+} capture_sample_t;
+
+esp_err_t capture_init(void);
+
+// Starts capturing samples for label, or stops with CAPTURE_LABEL_NONE
+esp_err_t capture_set_label(uint16_t conn_handle, uint8_t label);
+uint8_t capture_get_label(void);
+
+// Stops the capture when its central goes away
+void capture_disconnected(uint16_t conn_handle);
+
+#endif // CAPTURE_H
@@ -0,0 +1,94 @@
+// color_model.h
+// Generated by scripts/trainer.py -- do not edit by hand
+
+#ifndef COLOR_MODEL_H
+#define COLOR_MODEL_H
+
+#include "color_predictor.h"
+
+#if COLOR_PREDICTOR_QUANTIZED
+static const NeuralNetwork color_model = {
+        .input_weights = {
+                {3, 79, 25, 69, -37, 22, 3, -9, -6, -45, -2, -72, 7, 24, 19, -5},
+                {-8, -42, 62, 14, 6, -9, 17, 54, -34, 18, 40, 24, -49, 0, -70, -49},
+                {6, 46, 19, 34, -31, 54, -1, 36, -14, -2, -31, -32, -42, -2, -48, -35},
+                {-11, 8, -3, -1, -3, 9, -26, 21, 16, 43, 4, 61, -17, -19, 36, -14},
+        },
+        .hidden_bias1 = {0, 2667, -29775, -24784, 0, -19570, 0, -9675, 21342, 3614, -5790, 24334, 0, -3843, 72752, 0},
+        .hidden_weights1 = {
+                {-14, 30, -2, -8, 13, 3, 6, -11},
+                {-19, 1, 59, -46, -4, -8, 43, -14},
+                {35, -14, 49, 6, 12, 23, -25, 8},
+                {-13, 1, 52, -31, 24, 14, -9, -4},
+                {-7, 24, 19, 7, -5, 0, -8, -20},
+                {-13, 13, 28, -4, 23, -12, -13, 1},
+                {-4, -13, 0, 4, 11, 3, 26, -4},
+                {54, -1, 35, 0, -2, 4, -14, -3},
+                {-22, 0, -22, 8, 3, -12, 21, -3},
+                {24, -25, -1, 29, -5, -5, 1, 8},
+                {24, 23, 4, -1, 0, 6, -9, 0},
+                {50, -9, -28, 32, -4, -2, 8, -10},
+                {7, -15, -1, 8, 25, 27, 17, 8},
+                {15, 3, 8, -10, -10, 7, 21, 0},
+                {-52, -1, -8, -8, -6, 7, 67, -3},
+                {4, -8, -7, -2, 0, -26, 9, 1},
+        },
+        .hidden_bias2 = {10956, 1048, 52364, -32919, -3515, 6236, 64869, 0},
+        .hidden_weights2 = {
+                {-12, -76, 71, -33},
+                {14, -2, -17, 15},
+                {41, -70, -55, 62},
+                {-44, 6, 50, -9},
+                {-4, -17, -35, 22},
+                {21, -26, 13, 4},
+                {24, 80, -39, -31},
+                {16, -18, 21, -5},
+        },
+        .output_bias = {40508, -3686, 7649, -44472},
+        .input_shift = 5,
+        .hidden1_shift = 5,
+        .hidden2_shift = 5,
+};
+#else
+static const NeuralNetwork color_model = {
+        .input_weights = {
+                {0x1.9cffecp-4f, 0x1.3c0384p+1f, 0x1.8b2b0ep-1f, 0x1.159afcp+1f, -0x1.276526p+0f, 0x1.59e7b2p-1f, 0x1.7c1fdcp-4f, -0x1.2cce4ap-2f, -0x1.7d9458p-3f, -0x1.64f234p+0f, -0x1.e7127cp-5f, -0x1.1fe1f2p+1f, 0x1.d419d6p-3f, 0x1.783ffcp-1f, 0x1.2a55d4p-1f, -0x1.3c868ap-3f},
+                {-0x1.0e3b42p-2f, -0x1.506a4ap+0f, 0x1.f0b94p+0f, 0x1.cd7d76p-2f, 0x1.75f2e4p-3f, -0x1.2bdf6cp-2f, 0x1.0d30b8p-1f, 0x1.ae0eaep+0f, -0x1.0fe0f2p+0f, 0x1.20d1p-1f, 0x1.43e3ep+0f, 0x1.81f21cp-1f, -0x1.85c46cp+0f, 0x1.e70118p-8f, -0x1.170a6ep+1f, -0x1.868c76p+0f},
+                {0x1.8e4fd6p-3f, 0x1.6e16c2p+0f, 0x1.30f798p-1f, 0x1.139c6p+0f, -0x1.ef5b7ep-1f, 0x1.b0b5cep+0f, -0x1.3de51cp-6f, 0x1.22ac06p+0f, -0x1.baa8bp-2f, -0x1.fd16bp-5f, -0x1.edfbdp-1f, -0x1.020b4p+0f, -0x1.4c550cp+0f, -0x1.01fee8p-4f, -0x1.7eb714p+0f, -0x1.18e78p+0f},
+                {-0x1.697706p-2f, 0x1.eab264p-3f, -0x1.4d4d5p-4f, -0x1.5313a2p-6f, -0x1.9b17eep-4f, 0x1.21602ap-2f, -0x1.9eb936p-1f, 0x1.48458cp-1f, 0x1.071cf6p-1f, 0x1.599a26p+0f, 0x1.1a4e5ap-3f, 0x1.e68fa4p+0f, -0x1.15f806p-1f, -0x1.2c57acp-1f, 0x1.1ea9f2p+0f, -0x1.c9195cp-2f},
+        },
+        .hidden_bias1 = {0.0f, 0x1.4d5faap-5f, -0x1.d13c54p-2f, -0x1.833f5cp-2f, 0.0f, -0x1.31c8f2p-2f, 0.0f, -0x1.2e585p-3f, 0x1.4d7996p-2f, 0x1.c3cf72p-5f, -0x1.69deep-4f, 0x1.7c38dap-2f, 0.0f, -0x1.e065cp-5f, 0x1.1c2fd8p+0f, 0.0f},
+        .hidden_weights1 = {
+                {-0x1.bb7b22p-2f, 0x1.d84a0cp-1f, -0x1.222aa4p-4f, -0x1.ede706p-3f, 0x1.aaad9ap-2f, 0x1.51d216p-4f, 0x1.93d52ap-3f, -0x1.65aac2p-2f},
+                {-0x1.344f1ap-1f, 0x1.44c3aep-6f, 0x1.dbdc9ep+0f, -0x1.70438p+0f, -0x1.12f646p-3f, -0x1.fc4f26p-3f, 0x1.5602cp+0f, -0x1.ce8d9ap-2f},
+                {0x1.189d82p+0f, -0x1.bcd47ep-2f, 0x1.893744p+0f, 0x1.916492p-3f, 0x1.761c1ap-2f, 0x1.6fcfdp-1f, -0x1.90b24cp-1f, 0x1.fb30d4p-3f},
+                {-0x1.983cbcp-2f, 0x1.708e4p-6f, 0x1.a076b2p+0f, -0x1.f2ae62p-1f, 0x1.7fb6e4p-1f, 0x1.ba62d8p-2f, -0x1.288e5ap-2f, -0x1.0556b2p-3f},
+                {-0x1.b8069cp-3f, 0x1.80824p-1f, 0x1.2c0b84p-1f, 0x1.bd69eep-3f, -0x1.51354ap-3f, 0x1.5bbfaap-7f, -0x1.0e90bcp-2f, -0x1.44e0bep-1f},
+                {-0x1.a1054cp-2f, 0x1.91339p-2f, 0x1.b9848ep-1f, -0x1.df52fap-4f, 0x1.69d88ep-1f, -0x1.86dee8p-2f, -0x1.af6798p-2f, 0x1.22da6ap-6f},
+                {-0x1.e900dep-4f, -0x1.9d8f8p-2f, -0x1.e68a96p-7f, 0x1.fbd87cp-4f, 0x1.5a489ap-2f, 0x1.7541e2p-4f, 0x1.9da8bcp-1f, -0x1.fdea6p-4f},
+                {0x1.ad003p+0f, -0x1.6eb9d6p-6f, 0x1.1bdceap+0f, -0x1.ccac3ap-10f, -0x1.00ff72p-4f, 0x1.e9af88p-4f, -0x1.c23414p-2f, -0x1.5f3fb4p-4f},
+                {-0x1.66ce32p-1f, 0x1.93a6f6p-7f, -0x1.584382p-1f, 0x1.035a16p-2f, 0x1.b81832p-4f, -0x1.8554b6p-2f, 0x1.53751ap-1f, -0x1.50f598p-4f},
+                {0x1.7ee75p-1f, -0x1.97136ap-1f, -0x1.30acc6p-5f, 0x1.d0de0ep-1f, -0x1.4fee9ep-3f, -0x1.51a3fap-3f, 0x1.68b278p-6f, 0x1.0206c2p-2f},
+                {0x1.7dde32p-1f, 0x1.695588p-1f, 0x1.c81a22p-4f, -0x1.421a7ap-5f, 0x1.7a5b14p-7f, 0x1.6e9f36p-3f, -0x1.296e8ap-2f, 0x1.f42f56p-7f},
+                {0x1.8c1734p+0f, -0x1.1cbbap-2f, -0x1.bd01d8p-1f, 0x1.0060e4p+0f, -0x1.c81112p-4f, -0x1.80be36p-5f, 0x1.073afep-2f, -0x1.30d944p-2f},
+                {0x1.b4652ep-3f, -0x1.d7a3c4p-2f, -0x1.527ea2p-5f, 0x1.0e5a3cp-2f, 0x1.8c885ep-1f, 0x1.b6dc1p-1f, 0x1.174a1ap-1f, 0x1.047c78p-2f},
+                {0x1.d309bap-2f, 0x1.6811cp-4f, 0x1.0130c6p-2f, -0x1.3998c2p-2f, -0x1.48fb52p-2f, 0x1.c7bec4p-3f, 0x1.4f4edap-1f, -0x1.3a8328p-10f},
+                {-0x1.a2c826p+0f, -0x1.7991cep-5f, -0x1.0316f2p-2f, -0x1.02e98p-2f, -0x1.6b4d54p-3f, 0x1.b5d3b6p-3f, 0x1.0c4c5cp+1f, -0x1.65fd78p-4f},
+                {0x1.ecc6ap-4f, -0x1.06dd94p-2f, -0x1.baa272p-3f, -0x1.f62c1cp-5f, -0x1.e7d778p-8f, -0x1.9e1d98p-1f, 0x1.199bc8p-2f, 0x1.4cc0fcp-5f},
+        },
+        .hidden_bias2 = {0x1.565f9p-3f, 0x1.05fac8p-6f, 0x1.991818p-1f, -0x1.012e26p-1f, -0x1.b75fecp-5f, 0x1.85bdfp-4f, 0x1.faca9ep-1f, 0.0f},
+        .hidden_weights2 = {
+                {-0x1.8a6b8ap-2f, -0x1.2eb748p+1f, 0x1.1cbadcp+1f, -0x1.065e32p+0f},
+                {0x1.b479e6p-2f, -0x1.141a88p-4f, -0x1.15cb82p-1f, 0x1.ee468cp-2f},
+                {0x1.49f34ap+0f, -0x1.17619cp+1f, -0x1.baba14p+0f, 0x1.f32788p+0f},
+                {-0x1.623434p+0f, 0x1.825562p-3f, 0x1.92e898p+0f, -0x1.1563bp-2f},
+                {-0x1.faeaaep-4f, -0x1.0f5a9cp-1f, -0x1.19898ap+0f, 0x1.6328eap-1f},
+                {0x1.4ab86p-1f, -0x1.9f783ap-1f, 0x1.ac4222p-2f, 0x1.1474acp-3f},
+                {0x1.80be6cp-1f, 0x1.3e4b7ap+1f, -0x1.35576p+0f, -0x1.f1241ap-1f},
+                {0x1.f24cd8p-2f, -0x1.23a376p-1f, 0x1.4b4872p-1f, -0x1.49782ep-3f},
+        },
+        .output_bias = {0x1.3c78bp-1f, -0x1.ccb6fap-5f, 0x1.de0c66p-4f, -0x1.5b6f26p-1f},
+};
+#endif
+
+#endif // COLOR_MODEL_H
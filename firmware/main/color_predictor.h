@@ -8,6 +8,33 @@
 #define HIDDEN_SIZE2 8
 #define OUTPUT_SIZE 4
 
+// Select the inference engine at build time.
+// 1 - int8 weights with int32 accumulators, no soft-float and no softmax
+// 0 - original float network
+#ifndef COLOR_PREDICTOR_QUANTIZED
+#define COLOR_PREDICTOR_QUANTIZED 1
+#endif
+
+// fractional bits of the fixed point activations
+// raw 12 bit sensor counts divided by 2048 are already in this format
+#define NN_ACTIVATION_FRAC_BITS 11
+// largest weight shift, the logit scale 2^(NN_ACTIVATION_FRAC_BITS + shift) still fits 32 bits
+#define NN_MAX_WEIGHT_SHIFT     (31 - NN_ACTIVATION_FRAC_BITS)
+
+#if COLOR_PREDICTOR_QUANTIZED
+// weights are stored as w * 2^shift, biases as b * 2^(NN_ACTIVATION_FRAC_BITS + shift)
+typedef struct {
+    int8_t input_weights[INPUT_SIZE][HIDDEN_SIZE1];
+    int8_t hidden_weights1[HIDDEN_SIZE1][HIDDEN_SIZE2];
+    int8_t hidden_weights2[HIDDEN_SIZE2][OUTPUT_SIZE];
+    int32_t hidden_bias1[HIDDEN_SIZE1];
+    int32_t hidden_bias2[HIDDEN_SIZE2];
+    int32_t output_bias[OUTPUT_SIZE];
+    uint8_t input_shift;
+    uint8_t hidden1_shift;
+    uint8_t hidden2_shift;
+} NeuralNetwork;
+#else
 typedef struct {
     float input_weights[INPUT_SIZE][HIDDEN_SIZE1];
     float hidden_weights1[HIDDEN_SIZE1][HIDDEN_SIZE2];
@@ -16,8 +43,22 @@ typedef struct {
     float hidden_bias2[HIDDEN_SIZE2];
     float output_bias[OUTPUT_SIZE];
 } NeuralNetwork;
+#endif
+
+uint32_t predict_color(const NeuralNetwork* nn, uint16_t red, uint16_t green, uint16_t blue, uint16_t clear);
+
+// Like predict_color, and fills probabilities[OUTPUT_SIZE] with the softmax of the outputs.
+// Costs a soft-float softmax on top of the integer forward pass.
+uint32_t predict_color_probabilities(const NeuralNetwork* nn, uint16_t red, uint16_t green, uint16_t blue,
+                                     uint16_t clear, float* probabilities);
+
+// Returns the model currently in use
+const NeuralNetwork* color_predictor_get_model(void);
+
+// Returns the model generated into color_model.h by scripts/trainer.py
+const NeuralNetwork* color_predictor_get_builtin_model(void);
 
-uint32_t predict_color(NeuralNetwork* nn, float red, float green, float blue, float clear);
-void initialize_neural_network(NeuralNetwork* nn);
+// Atomically switches the model used by subsequent predictions
+void color_predictor_set_model(const NeuralNetwork* nn);
 
 #endif // COLOR_PREDICTOR_H
@@ -0,0 +1,207 @@
+#include "color_stream.h"
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "opt4060.h"
+#include "calibration.h"
+#include "trace.h"
+
+static const char *TAG = "ColorStream";
+
+#define COLOR_STREAM_MASK (COLOR_STREAM_SIZE - 1)
+
+// single producer ring: only the sampling task writes slots and head,
+// consumers never block it and detect an overwritten slot through head
+static color_sample_t ring[COLOR_STREAM_SIZE];
+static atomic_uint_fast32_t head = 0;   // total number of samples written
+
+static TaskHandle_t color_stream_task_handle = NULL;
+static StackType_t color_stream_task_stack[COLOR_STREAM_TASK_STACK_SIZE];
+static StaticTask_t color_stream_task_buffer;
+static TaskHandle_t _Atomic listener = NULL;
+static esp_timer_handle_t color_stream_timer = NULL;
+static atomic_uint period_us = COLOR_STREAM_PERIOD_US;
+
+// sensor configuration waiting for the sampling task, SENSOR_PENDING | range << 8 | conversion time
+#define SENSOR_PENDING 0x10000u
+static atomic_uint pending_sensor = 0;
+
+static void color_stream_timer_callback(void *arg)
+{
+    xTaskNotifyGive(color_stream_task_handle);
+}
+
+// sampling task only, no read in flight
+static void apply_sensor(unsigned int config)
+{
+    uint8_t range = (config >> 8) & 0xFF;
+    uint8_t conversion_time = config & 0xFF;
+
+    if (opt4060_configure(range, conversion_time) != ESP_OK) {
+        return;
+    }
+    uint32_t period = opt4060_conversion_time_us(conversion_time);
+    atomic_store(&period_us, period);
+    if (color_stream_timer != NULL && esp_timer_is_active(color_stream_timer)) {
+        esp_timer_stop(color_stream_timer);
+        esp_timer_start_periodic(color_stream_timer, period);
+    }
+    ESP_LOGI(TAG, "Range %d, %lu us per sample", range, period);
+}
+
+static void color_stream_task(void *pvParameters)
+{
+    color_sample_t sample;
+    bool read_pending = false;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // the read queued on the previous tick has long finished on the bus by now, so
+        // collecting it does not wait; queue the next one and go back to sleep.
+        // A new sensor configuration goes in instead of the next read, while the bus is idle.
+        unsigned int sensor = atomic_exchange(&pending_sensor, 0);
+        bool have_sample;
+        TRACE_SPAN(TRACE_I2C_READ,
+                   have_sample = read_pending && opt4060_read_color_finish(&sample.red, &sample.green, &sample.blue,
+                                                                           &sample.clear, 1) == ESP_OK;
+                   read_pending = !sensor && opt4060_read_color_start() == ESP_OK);
+        if (sensor) {
+            apply_sensor(sensor);
+        }
+
+        if (!have_sample) {
+            continue;
+        }
+        sample.timestamp_us = esp_timer_get_time();
+        calibration_apply(&sample);
+
+        uint32_t index = atomic_load_explicit(&head, memory_order_relaxed);
+        ring[index & COLOR_STREAM_MASK] = sample;
+        atomic_store_explicit(&head, index + 1, memory_order_release);
+
+        TaskHandle_t task = atomic_load_explicit(&listener, memory_order_relaxed);
+        if (task != NULL) {
+            xTaskNotifyGive(task);
+        }
+    }
+}
+
+esp_err_t color_stream_start(void)
+{
+    const esp_timer_create_args_t timer_args = {
+            .callback = color_stream_timer_callback,
+            .name = "color_stream",
+            .skip_unhandled_events = true,
+    };
+
+    color_stream_task_handle = xTaskCreateStatic(color_stream_task, "color_stream_task",
+                                                 COLOR_STREAM_TASK_STACK_SIZE, NULL, COLOR_STREAM_TASK_PRIORITY,
+                                                 color_stream_task_stack, &color_stream_task_buffer);
+
+    esp_err_t err = esp_timer_create(&timer_args, &color_stream_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create color stream timer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+void color_stream_set_active(bool active)
+{
+    if (color_stream_timer == NULL) {
+        return;
+    }
+
+    if (active && !esp_timer_is_active(color_stream_timer)) {
+        esp_timer_start_periodic(color_stream_timer, atomic_load(&period_us));
+    } else if (!active) {
+        esp_timer_stop(color_stream_timer);
+    }
+}
+
+void color_stream_set_sensor(uint8_t range, uint8_t conversion_time)
+{
+    atomic_store(&pending_sensor, SENSOR_PENDING | range << 8 | conversion_time);
+    if (color_stream_task_handle != NULL) {
+        xTaskNotifyGive(color_stream_task_handle);
+    }
+}
+
+void color_stream_set_listener(TaskHandle_t task)
+{
+    atomic_store(&listener, task);
+}
+
+uint32_t color_stream_period_us(void)
+{
+    return atomic_load(&period_us);
+}
+
+// copies slot index, false if the producer lapped it while we were copying
+static bool copy_sample(uint32_t index, color_sample_t *sample)
+{
+    *sample = ring[index & COLOR_STREAM_MASK];
+    atomic_thread_fence(memory_order_acquire);
+    uint32_t written = atomic_load_explicit(&head, memory_order_relaxed);
+    return written - index <= COLOR_STREAM_SIZE - 1;
+}
+
+bool color_stream_latest(color_sample_t *sample)
+{
+    while (1) {
+        uint32_t written = atomic_load_explicit(&head, memory_order_acquire);
+        if (written == 0) {
+            return false;
+        }
+        if (copy_sample(written - 1, sample)) {
+            return true;
+        }
+    }
+}
+
+uint32_t color_stream_cursor(void)
+{
+    return atomic_load_explicit(&head, memory_order_acquire);
+}
+
+bool color_stream_read(uint32_t *cursor, color_sample_t *sample)
+{
+    while (1) {
+        uint32_t written = atomic_load_explicit(&head, memory_order_acquire);
+        if (*cursor == written) {
+            return false;
+        }
+        if (written - *cursor > COLOR_STREAM_SIZE - 1) {
+            *cursor = written - (COLOR_STREAM_SIZE - 1);
+        }
+        if (copy_sample(*cursor, sample)) {
+            (*cursor)++;
+            return true;
+        }
+    }
+}
+
+size_t color_stream_window(int64_t from_us, int64_t to_us, color_sample_t *samples, size_t max)
+{
+    uint32_t written = atomic_load_explicit(&head, memory_order_acquire);
+    size_t count = 0;
+
+    // walk back from the newest sample until the window start or the oldest kept one
+    for (uint32_t age = 1; age <= written && age < COLOR_STREAM_SIZE; age++) {
+        color_sample_t sample;
+        if (!copy_sample(written - age, &sample)) {
+            break;  // lapped, everything older is gone as well
+        }
+        if (sample.timestamp_us < from_us) {
+            break;
+        }
+        if (sample.timestamp_us <= to_us && count < max) {
+            samples[count++] = sample;
+        }
+    }
+    return count;
+}
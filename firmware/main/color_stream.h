@@ -0,0 +1,57 @@
+#ifndef COLOR_STREAM_H
+#define COLOR_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define COLOR_STREAM_PERIOD_US      1000   // default, matches the 1 ms continuous conversion set in opt4060_init
+#define COLOR_STREAM_SIZE           128    // samples kept, must be a power of two
+#define COLOR_STREAM_TASK_PRIORITY  8
+#define COLOR_STREAM_TASK_STACK_SIZE 2048  // bytes
+
+// One RGBC reading from the OPT4060
+typedef struct {
+    int64_t timestamp_us;   // esp_timer_get_time() when collected, at most one period after the bus read
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+    uint16_t clear;
+} color_sample_t;
+
+// Creates the sampling task, sampling begins with color_stream_set_active. opt4060_init must have been called.
+esp_err_t color_stream_start(void);
+
+// Starts or pauses the sampling, the last sample stays readable while paused
+void color_stream_set_active(bool active);
+
+// Reconfigures the sensor between two reads, see opt4060_configure, and samples once per conversion
+// from then on. Applied by the sampling task, also while paused.
+void color_stream_set_sensor(uint8_t range, uint8_t conversion_time);
+
+// Notifies task with xTaskNotifyGive after every new sample, NULL for none. There is one listener,
+// the other consumers poll.
+void color_stream_set_listener(TaskHandle_t task);
+
+// Current sampling period
+uint32_t color_stream_period_us(void);
+
+// Copies the newest sample. Returns false if nothing has been sampled yet.
+bool color_stream_latest(color_sample_t *sample);
+
+// Cursor for color_stream_read, each consumer keeps its own
+uint32_t color_stream_cursor(void);
+
+// Copies the next unread sample after *cursor and advances it.
+// A consumer that falls more than COLOR_STREAM_SIZE behind skips to the oldest kept sample.
+// Returns false if there is no new sample.
+bool color_stream_read(uint32_t *cursor, color_sample_t *sample);
+
+// Copies up to max kept samples with from_us <= timestamp_us <= to_us, newest first.
+// Returns the number copied.
+size_t color_stream_window(int64_t from_us, int64_t to_us, color_sample_t *samples, size_t max);
+
+#endif // COLOR_STREAM_H
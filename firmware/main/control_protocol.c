@@ -0,0 +1,123 @@
+#include "control_protocol.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "controller.h"
+
+static const char *TAG = "control";
+
+// trajectory still to be applied, offsets are relative to trajectory_start_us
+static control_setpoint_t pending[CONTROL_MAX_SETPOINTS];
+static uint8_t pending_count = 0;
+static uint8_t pending_next = 0;
+static int64_t trajectory_start_us = 0;
+
+static uint16_t last_sequence = 0;
+static bool have_sequence = false;
+
+static esp_timer_handle_t setpoint_timer;
+// held while a setpoint is picked and applied, so a setpoint of a replaced
+// trajectory can never be applied after the first one of its replacement
+static SemaphoreHandle_t control_mutex;
+static StaticSemaphore_t control_mutex_buffer;
+
+static void apply_setpoint(const control_setpoint_t *setpoint)
+{
+    MotorCommand command = {abs(setpoint->speed_a), setpoint->speed_a >= 0,
+                            abs(setpoint->speed_b), setpoint->speed_b >= 0,
+                            setpoint->duration};
+    set_motor_command(command);
+}
+
+// applies every setpoint that is due and arms the timer for the next one, control_mutex held
+static void run_trajectory(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    while (pending_next < pending_count &&
+           trajectory_start_us + pending[pending_next].offset_ms * 1000LL <= now) {
+        apply_setpoint(&pending[pending_next]);
+        pending_next++;
+    }
+
+    if (pending_next < pending_count) {
+        int64_t due = trajectory_start_us + pending[pending_next].offset_ms * 1000LL;
+        esp_timer_start_once(setpoint_timer, due - now);
+    }
+}
+
+static void setpoint_timer_callback(void *arg)
+{
+    (void)arg;
+    xSemaphoreTake(control_mutex, portMAX_DELAY);
+    run_trajectory();
+    xSemaphoreGive(control_mutex);
+}
+
+esp_err_t control_protocol_init(void)
+{
+    control_mutex = xSemaphoreCreateMutexStatic(&control_mutex_buffer);
+
+    const esp_timer_create_args_t timer_args = {
+            .callback = setpoint_timer_callback,
+            .name = "control_setpoint",
+    };
+    return esp_timer_create(&timer_args, &setpoint_timer);
+}
+
+esp_err_t control_protocol_receive(const uint8_t *data, uint16_t len)
+{
+    control_packet_header_t header;
+
+    if (len < sizeof(header)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (header.version != CONTROL_PROTOCOL_VERSION) {
+        ESP_LOGE(TAG, "Unsupported control protocol version %d", header.version);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (header.count == 0 || header.count > CONTROL_MAX_SETPOINTS ||
+        len != sizeof(header) + header.count * sizeof(control_setpoint_t)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(control_mutex, portMAX_DELAY);
+
+    // drop anything older than what we already acted on, wrap around safe
+    if (have_sequence && (int16_t)(header.sequence - last_sequence) <= 0) {
+        xSemaphoreGive(control_mutex);
+        COMMAND_LOGI(TAG, "Dropping stale packet %u", header.sequence);
+        return ESP_OK;
+    }
+    last_sequence = header.sequence;
+    have_sequence = true;
+
+    // the new trajectory replaces whatever was still pending
+    esp_timer_stop(setpoint_timer);
+    memcpy(pending, data + sizeof(header), header.count * sizeof(control_setpoint_t));
+    pending_count = header.count;
+    pending_next = 0;
+    trajectory_start_us = esp_timer_get_time();
+    run_trajectory();
+
+    xSemaphoreGive(control_mutex);
+
+    COMMAND_LOGI(TAG, "Packet %u with %d setpoints", header.sequence, header.count);
+    return ESP_OK;
+}
+
+void control_protocol_reset(void)
+{
+    xSemaphoreTake(control_mutex, portMAX_DELAY);
+    esp_timer_stop(setpoint_timer);
+    pending_count = 0;
+    pending_next = 0;
+    have_sequence = false;
+    xSemaphoreGive(control_mutex);
+}
@@ -0,0 +1,44 @@
+#ifndef CONTROL_PROTOCOL_H
+#define CONTROL_PROTOCOL_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Binary control protocol, written to the control characteristic (write or write without response).
+// All fields are little endian.
+//
+// header:   version (u8), setpoint count (u8), sequence (u16)
+// setpoint: time offset ms from packet arrival (u16), motor A speed (s8), motor B speed (s8), duration (u8)
+//
+// Speeds are signed percent, positive is forward. Duration is in 100 ms units like MotorCommand.seconds,
+// 0 stops the car whatever the speeds.
+// Packets with a sequence number that is not newer than the last accepted one are dropped.
+// Setpoints after the first one form a short trajectory; a newer packet replaces whatever is still pending.
+
+#define CONTROL_PROTOCOL_VERSION    1
+#define CONTROL_MAX_SETPOINTS       16
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t count;
+    uint16_t sequence;
+} control_packet_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t offset_ms;
+    int8_t speed_a;
+    int8_t speed_b;
+    uint8_t duration;
+} control_setpoint_t;
+
+#define CONTROL_PACKET_MAX_LEN (sizeof(control_packet_header_t) + CONTROL_MAX_SETPOINTS * sizeof(control_setpoint_t))
+
+esp_err_t control_protocol_init(void);
+
+// Handles one received control packet
+esp_err_t control_protocol_receive(const uint8_t *data, uint16_t len);
+
+// Forget the last sequence number, called when a new driver connects
+void control_protocol_reset(void);
+
+#endif // CONTROL_PROTOCOL_H
@@ -7,9 +7,25 @@
 #include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
+#include "esp_log.h"
 
 #include "led.h"
 
+// per command logging on the BLE -> controller -> motor path, off by default
+// since at the default log level the UART output dominates command latency
+#ifndef CONTROLLER_LOG_COMMANDS
+#define CONTROLLER_LOG_COMMANDS 0
+#endif
+
+#if CONTROLLER_LOG_COMMANDS
+#define COMMAND_LOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+#else
+#define COMMAND_LOGI(tag, format, ...) do {} while (0)
+#endif
+
+#define CONTROLLER_TASK_PRIORITY 5
+#define CONTROLLER_TASK_STACK_SIZE 2048  // bytes
+
 // Define the MotorCommand structure
 typedef struct {
     int MotorASpeed;
@@ -30,7 +46,10 @@ typedef enum {
 } game_status;
 
 void command_set_game_status(uint32_t status);
+game_status command_get_game_status(void);
 void set_motor_command(MotorCommand command);
 void controller_init(void);
+// While frozen the motors are held stopped and driver commands are dropped
+void controller_set_frozen(bool frozen);
 
 #endif // CONTROLLER_H
@@ -0,0 +1,310 @@
+#include "game_effect.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "led.h"
+#include "shared_state.h"
+
+static const char *TAG = "game_effect";
+
+#define GAME_NVS_NAMESPACE  "game"
+#define GAME_NVS_KEY        "effects"
+
+#define SPIN_HOLD           10      // 100 ms units, like MotorCommand.seconds
+
+// the rules the car shipped with
+static const game_effect_t default_effects[GAME_EFFECT_COUNT] = {
+        [GAME_RED]    = {1000,  0,    GAME_SPEED_OFFSET, 10,  LED_CONST,                 1},
+        [GAME_BLACK]  = {10000, 0,    GAME_SPEED_OFFSET, -10, LED_FLASH_BACK,            1},
+        [GAME_GREEN]  = {1000,  5000, GAME_SPEED_SPIN,   60,  LED_FLASH_ALL,             2},
+        [GAME_WHITE]  = {10000, 0,    GAME_SPEED_OFFSET, 10,  LED_FLASH_FRONT_ALTERNATE, 1},
+        [GAME_YELLOW] = {1000,  0,    GAME_SPEED_NONE,   0,   LED_CONST,                 0},
+};
+
+// what NVS holds, the version guards against tables of an older layout
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    game_effect_t effects[GAME_EFFECT_COUNT];
+} game_effect_store_t;
+
+// table, run state and apply order, all guarded by effect_lock
+static game_effect_t effects[GAME_EFFECT_COUNT];
+static uint8_t apply_order[GAME_EFFECT_COUNT];     // colors by ascending priority
+static int64_t cooldown_until_us[GAME_EFFECT_COUNT];
+static atomic_uint active_mask = 0;                 // bit per running color, read lock free on the hot path
+static portMUX_TYPE effect_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_timer_handle_t effect_timers[GAME_EFFECT_COUNT];
+// serializes publishing the running effects, so the LED pattern and the game state
+// in shared_state always match the newest set
+static SemaphoreHandle_t publish_mutex;
+static StaticSemaphore_t publish_mutex_buffer;
+
+// effect_lock held
+static void build_apply_order(void)
+{
+    for (int i = 0; i < GAME_EFFECT_COUNT; i++) {
+        int j = i;
+        for (; j > 0 && effects[apply_order[j - 1]].priority > effects[i].priority; j--) {
+            apply_order[j] = apply_order[j - 1];
+        }
+        apply_order[j] = i;
+    }
+}
+
+static bool effect_valid(const game_effect_t *effect)
+{
+    return effect->speed_mode < GAME_SPEED_MODE_COUNT && effect->led_mode <= LED_FLASH_FRONT_ALTERNATE;
+}
+
+// highest priority running effect and the LED pattern it asks for, effect_lock held
+static game_status current_effect(unsigned int active, led_flash *mode)
+{
+    game_status current = GAME_OFF;
+
+    *mode = LED_CONST;
+    for (int i = 0; i < GAME_EFFECT_COUNT; i++) {
+        uint8_t color = apply_order[i];
+        if (active & (1u << color)) {
+            current = color;
+            if (effects[color].led_mode != LED_CONST) {
+                *mode = effects[color].led_mode;
+            }
+        }
+    }
+    return current;
+}
+
+// call after every change of the running effects
+static void publish_effects(void)
+{
+    led_flash mode;
+
+    xSemaphoreTake(publish_mutex, portMAX_DELAY);
+
+    unsigned int active = atomic_load(&active_mask);
+    portENTER_CRITICAL(&effect_lock);
+    game_status current = current_effect(active, &mode);
+    portEXIT_CRITICAL(&effect_lock);
+
+    shared_state_publish_game(current);
+    led_set_flash_mode(mode);
+
+    xSemaphoreGive(publish_mutex);
+}
+
+static void effect_timer_callback(void *arg)
+{
+    game_status color = (uintptr_t)arg;
+
+    atomic_fetch_and(&active_mask, ~(1u << color));
+    publish_effects();
+    ESP_LOGD(TAG, "Effect %d done", color);
+}
+
+static esp_err_t load_effects(void)
+{
+    nvs_handle_t handle;
+    game_effect_store_t store;
+    size_t len = sizeof(store);
+
+    esp_err_t err = nvs_open(GAME_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_get_blob(handle, GAME_NVS_KEY, &store, &len);
+    nvs_close(handle);
+
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (len != sizeof(store) || store.version != GAME_EFFECT_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    for (int i = 0; i < GAME_EFFECT_COUNT; i++) {
+        if (!effect_valid(&store.effects[i])) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    memcpy(effects, store.effects, sizeof(effects));
+    return ESP_OK;
+}
+
+static esp_err_t save_effects(const game_effect_t table[GAME_EFFECT_COUNT])
+{
+    nvs_handle_t handle;
+    game_effect_store_t store = {.version = GAME_EFFECT_VERSION};
+    memcpy(store.effects, table, sizeof(store.effects));
+
+    esp_err_t err = nvs_open(GAME_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(handle, GAME_NVS_KEY, &store, sizeof(store));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t game_effect_init(void)
+{
+    publish_mutex = xSemaphoreCreateMutexStatic(&publish_mutex_buffer);
+
+    for (int i = 0; i < GAME_EFFECT_COUNT; i++) {
+        const esp_timer_create_args_t timer_args = {
+                .callback = effect_timer_callback,
+                .arg = (void *)(uintptr_t)i,
+                .name = "game_effect",
+        };
+        esp_err_t err = esp_timer_create(&timer_args, &effect_timers[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create effect timer: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    esp_err_t err = load_effects();
+    if (err != ESP_OK) {
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "Stored game rules not usable (%s), using the built in ones", esp_err_to_name(err));
+        }
+        memcpy(effects, default_effects, sizeof(effects));
+    }
+    build_apply_order();
+    return ESP_OK;
+}
+
+bool game_effect_trigger(game_status color)
+{
+    if (color >= GAME_EFFECT_COUNT) {
+        return false;
+    }
+
+    int64_t now = esp_timer_get_time();
+    uint32_t duration_ms;
+    bool start;
+
+    portENTER_CRITICAL(&effect_lock);
+    duration_ms = effects[color].duration_ms;
+    start = duration_ms != 0 && !(atomic_load(&active_mask) & (1u << color)) && now >= cooldown_until_us[color];
+    if (start) {
+        cooldown_until_us[color] = now + effects[color].cooldown_ms * 1000LL;
+        atomic_fetch_or(&active_mask, 1u << color);
+    }
+    portEXIT_CRITICAL(&effect_lock);
+
+    if (!start) {
+        ESP_LOGD(TAG, "Effect %d ignored", color);
+        return false;
+    }
+
+    esp_timer_start_once(effect_timers[color], duration_ms * 1000ULL);
+    publish_effects();
+    ESP_LOGD(TAG, "Effect %d for %" PRIu32 " ms", color, duration_ms);
+    return true;
+}
+
+static int clamp_speed(int speed)
+{
+    return speed < 0 ? 0 : speed > 100 ? 100 : speed;
+}
+
+static void apply_speed(const game_effect_t *effect, MotorCommand *command)
+{
+    switch (effect->speed_mode) {
+        case GAME_SPEED_OFFSET:
+            // only while driving, a car that stands still keeps standing
+            if (command->MotorASpeed > abs(effect->speed_arg) && command->MotorBSpeed > abs(effect->speed_arg)) {
+                command->MotorASpeed = clamp_speed(command->MotorASpeed + effect->speed_arg);
+                command->MotorBSpeed = clamp_speed(command->MotorBSpeed + effect->speed_arg);
+            }
+            break;
+        case GAME_SPEED_SCALE:
+            command->MotorASpeed = clamp_speed(command->MotorASpeed * effect->speed_arg / 100);
+            command->MotorBSpeed = clamp_speed(command->MotorBSpeed * effect->speed_arg / 100);
+            break;
+        case GAME_SPEED_SPIN:
+            command->MotorASpeed = clamp_speed(effect->speed_arg);
+            command->MotorADirection = 1;
+            command->MotorBSpeed = clamp_speed(effect->speed_arg);
+            command->MotorBDirection = 0;
+            command->seconds = SPIN_HOLD;
+            break;
+        default:
+            break;
+    }
+}
+
+void game_effect_apply(MotorCommand *command)
+{
+    game_effect_t running[GAME_EFFECT_COUNT];
+    int count = 0;
+
+    unsigned int active = atomic_load(&active_mask);
+    if (active == 0) {
+        return;
+    }
+
+    portENTER_CRITICAL(&effect_lock);
+    for (int i = 0; i < GAME_EFFECT_COUNT; i++) {
+        uint8_t color = apply_order[i];
+        if (active & (1u << color)) {
+            running[count++] = effects[color];
+        }
+    }
+    portEXIT_CRITICAL(&effect_lock);
+
+    for (int i = 0; i < count; i++) {
+        apply_speed(&running[i], command);
+    }
+}
+
+esp_err_t game_effect_receive(const uint8_t *data, uint16_t len)
+{
+    const size_t entry_len = 1 + sizeof(game_effect_t);
+    game_effect_t table[GAME_EFFECT_COUNT];
+
+    if (len == 0 || len % entry_len != 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    game_effect_get_table(table);
+    for (const uint8_t *entry = data; entry < data + len; entry += entry_len) {
+        game_effect_t effect;
+        memcpy(&effect, entry + 1, sizeof(effect));
+        if (entry[0] >= GAME_EFFECT_COUNT || !effect_valid(&effect)) {
+            ESP_LOGE(TAG, "Invalid game rule for color %d", entry[0]);
+            return ESP_ERR_INVALID_ARG;
+        }
+        table[entry[0]] = effect;
+    }
+
+    // all entries of a write take effect together
+    portENTER_CRITICAL(&effect_lock);
+    memcpy(effects, table, sizeof(effects));
+    build_apply_order();
+    portEXIT_CRITICAL(&effect_lock);
+    publish_effects();
+
+    esp_err_t err = save_effects(table);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store game rules: %s", esp_err_to_name(err));
+    }
+    ESP_LOGI(TAG, "Game rules updated");
+    return ESP_OK;
+}
+
+void game_effect_get_table(game_effect_t table[GAME_EFFECT_COUNT])
+{
+    portENTER_CRITICAL(&effect_lock);
+    memcpy(table, effects, sizeof(effects));
+    portEXIT_CRITICAL(&effect_lock);
+}
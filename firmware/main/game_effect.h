@@ -0,0 +1,53 @@
+#ifndef GAME_EFFECT_H
+#define GAME_EFFECT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "controller.h"
+
+// Data driven game rules: one effect per tile color, looked up by game_status. Effects of
+// different colors run side by side, each on its own timer; their speed transforms are
+// applied in ascending priority, so the highest priority one has the last word, and it
+// also picks the LED pattern. It is published as the game state in shared_state.
+//
+// The table can be replaced over the game rules characteristic and is kept in NVS.
+// write: one or more entries of color (u8) followed by game_effect_t, all little endian
+// read:  the whole table, GAME_EFFECT_COUNT game_effect_t in color order
+
+#define GAME_EFFECT_COUNT       GAME_OFF    // every game_status except GAME_OFF
+#define GAME_EFFECT_VERSION     1           // bump when game_effect_t changes, older NVS tables are dropped
+#define GAME_EFFECT_MAX_WRITE   (GAME_EFFECT_COUNT * (1 + sizeof(game_effect_t)))
+
+typedef enum {
+    GAME_SPEED_NONE = 0,
+    GAME_SPEED_OFFSET,      // adds speed_arg percent to both motors while both run faster than |speed_arg|
+    GAME_SPEED_SCALE,       // scales both motors to speed_arg percent
+    GAME_SPEED_SPIN,        // overrides the driver, motors turn opposite ways at speed_arg percent
+    GAME_SPEED_MODE_COUNT
+} game_speed_mode_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t duration_ms;   // 0 disables the color
+    uint16_t cooldown_ms;   // from the start of the effect, the color is ignored until it passed
+    uint8_t speed_mode;     // game_speed_mode_t
+    int8_t speed_arg;
+    uint8_t led_mode;       // led_flash, LED_CONST leaves the LEDs to other effects
+    uint8_t priority;       // higher wins where effects overlap
+} game_effect_t;
+
+// Loads the table from NVS, or the built in rules if there is none. NVS must be initialized.
+esp_err_t game_effect_init(void);
+
+// Starts the effect of a color, false if it is disabled, already running or cooling down
+bool game_effect_trigger(game_status color);
+
+// Applies the speed transforms of every running effect to a driver command
+void game_effect_apply(MotorCommand *command);
+
+// Handles a game rules write, the new entries apply to the next trigger of their color
+esp_err_t game_effect_receive(const uint8_t *data, uint16_t len);
+
+void game_effect_get_table(game_effect_t table[GAME_EFFECT_COUNT]);
+
+#endif // GAME_EFFECT_H
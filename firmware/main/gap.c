@@ -1,10 +1,128 @@
 #include "gap.h"
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
 #include "led.h"
+#include "control_protocol.h"
+#include "race_broadcast.h"
+#include "telemetry.h"
+#include "capture.h"
+#include "gatt_svr.h"
+#include "boot.h"
 
 uint8_t addr_type;
 
+// advertising and scanning run, cleared when the host resets; both sync_cb and app_main may start them
+static atomic_bool started = false;
+
+static const struct ble_gap_upd_params active_params = {
+  .itvl_min = GAP_ACTIVE_ITVL_MIN,
+  .itvl_max = GAP_ACTIVE_ITVL_MAX,
+  .latency = GAP_ACTIVE_LATENCY,
+  .supervision_timeout = GAP_SUPERVISION_TIMEOUT,
+};
+
+static const struct ble_gap_upd_params idle_params = {
+  .itvl_min = GAP_IDLE_ITVL_MIN,
+  .itvl_max = GAP_IDLE_ITVL_MAX,
+  .latency = GAP_IDLE_LATENCY,
+  .supervision_timeout = GAP_SUPERVISION_TIMEOUT,
+};
+
+// written from the host task, the idle timer and control writes, read by diagnostics
+static portMUX_TYPE link_lock = portMUX_INITIALIZER_UNLOCKED;
+static gap_link_info_t link = {.conn_handle = BLE_HS_CONN_HANDLE_NONE};
+// an update was refused because another one was in flight, retry once it completes
+static bool update_retry = false;
+
+static esp_timer_handle_t idle_timer;
+
 int gap_event_handler(struct ble_gap_event *event, void *arg);
 
+// asks the central for the parameters of the current mode
+static void request_params(uint16_t conn_handle, bool idle) {
+  int rc = ble_gap_update_params(conn_handle, idle ? &idle_params : &active_params);
+
+  portENTER_CRITICAL(&link_lock);
+  update_retry = rc == BLE_HS_EALREADY;
+  portEXIT_CRITICAL(&link_lock);
+
+  if (rc != 0 && rc != BLE_HS_EALREADY) {
+    ESP_LOGE(LOG_TAG_GAP, "Error requesting %s connection parameters: rc=%d",
+             idle ? "idle" : "active", rc);
+  }
+}
+
+// copies the negotiated interval, latency and timeout into link
+static void refresh_link(uint16_t conn_handle) {
+  struct ble_gap_conn_desc desc;
+
+  if (ble_gap_conn_find(conn_handle, &desc) != 0) {
+    return;
+  }
+
+  portENTER_CRITICAL(&link_lock);
+  link.interval = desc.conn_itvl;
+  link.latency = desc.conn_latency;
+  link.supervision_timeout = desc.supervision_timeout;
+  portEXIT_CRITICAL(&link_lock);
+
+  ESP_LOGI(LOG_TAG_GAP, "GAP: Connection params: interval=%d.%02d ms, latency=%d, timeout=%d ms",
+           desc.conn_itvl * 5 / 4, desc.conn_itvl * 125 % 100, desc.conn_latency,
+           desc.supervision_timeout * 10);
+}
+
+static void idle_timer_callback(void *arg) {
+  uint16_t conn_handle;
+
+  portENTER_CRITICAL(&link_lock);
+  conn_handle = link.conn_handle;
+  link.idle = 1;
+  portEXIT_CRITICAL(&link_lock);
+
+  if (conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+    request_params(conn_handle, true);
+  }
+}
+
+esp_err_t gap_init(void) {
+  const esp_timer_create_args_t timer_args = {
+    .callback = idle_timer_callback,
+    .name = "gap_idle",
+  };
+
+  return esp_timer_create(&timer_args, &idle_timer);
+}
+
+void gap_link_activity(void) {
+  uint16_t conn_handle;
+  bool was_idle;
+
+  portENTER_CRITICAL(&link_lock);
+  conn_handle = link.conn_handle;
+  was_idle = link.idle;
+  link.idle = 0;
+  portEXIT_CRITICAL(&link_lock);
+
+  if (conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+    return;
+  }
+
+  esp_timer_stop(idle_timer);
+  esp_timer_start_once(idle_timer, GAP_IDLE_TIMEOUT_MS * 1000ULL);
+
+  if (was_idle) {
+    request_params(conn_handle, false);
+  }
+}
+
+void gap_get_link_info(gap_link_info_t *info) {
+  portENTER_CRITICAL(&link_lock);
+  *info = link;
+  portEXIT_CRITICAL(&link_lock);
+}
+
 void advertise() {
   struct ble_gap_adv_params adv_params;
   struct ble_hs_adv_fields fields;
@@ -44,17 +162,38 @@ void advertise() {
 
 void reset_cb(int reason) {
   ESP_LOGE(LOG_TAG_GAP, "BLE reset: reason = %d", reason);
+  atomic_store(&started, false);
 }
 
-void sync_cb(void) {
+void gap_start(void) {
+  if (atomic_exchange(&started, true)) {
+    return;
+  }
+
   // determine best adress type
   ble_hs_id_infer_auto(0, &addr_type);
 
   // start avertising
   advertise();
+
+  // listen for the race director next to the driver connection
+  race_broadcast_start(addr_type);
+}
+
+void sync_cb(void) {
+  boot_set_ready(BOOT_BLE_SYNCED);
+
+  // before the control path is live app_main starts it, a command now would be lost
+  if (boot_is_ready(BOOT_CONTROL_READY)) {
+    gap_start();
+  }
 }
 
 int gap_event_handler(struct ble_gap_event *event, void *arg) {
+  bool retry;
+  bool idle;
+  int rc;
+
   switch (event->type) {
     case BLE_GAP_EVENT_CONNECT:
       // A new connection was established or a connection attempt failed
@@ -62,16 +201,52 @@ int gap_event_handler(struct ble_gap_event *event, void *arg) {
                event->connect.status == 0 ? "established" : "failed",
                event->connect.status);
 
+      if (event->connect.status != 0) {
+        advertise();
+        break;
+      }
+
       // turn on the front LEDS
       set_led(3,true);
       set_led(2,true);
 
+      // a new driver starts its own sequence numbers
+      control_protocol_reset();
+
+      portENTER_CRITICAL(&link_lock);
+      link = (gap_link_info_t) {
+        .conn_handle = event->connect.conn_handle,
+        .tx_phy = BLE_GAP_LE_PHY_1M,
+        .rx_phy = BLE_GAP_LE_PHY_1M,
+        .mtu = 23,
+      };
+      portEXIT_CRITICAL(&link_lock);
+      refresh_link(event->connect.conn_handle);
+
+      // don't leave latency up to the central: short interval and 2M PHY for the session,
+      // the idle timer relaxes it again if nobody drives
+      rc = ble_gap_set_prefered_le_phy(event->connect.conn_handle, BLE_GAP_LE_PHY_2M_MASK,
+                                       BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+      if (rc != 0) {
+        ESP_LOGE(LOG_TAG_GAP, "Error requesting 2M PHY: rc=%d", rc);
+      }
+      request_params(event->connect.conn_handle, false);
+      esp_timer_start_once(idle_timer, GAP_IDLE_TIMEOUT_MS * 1000ULL);
+
       break;
 
     case BLE_GAP_EVENT_DISCONNECT:
       ESP_LOGD(LOG_TAG_GAP, "GAP: Disconnect: reason=%d\n",
                event->disconnect.reason);
 
+      esp_timer_stop(idle_timer);
+      telemetry_set_subscribed(event->disconnect.conn.conn_handle, false);
+      capture_disconnected(event->disconnect.conn.conn_handle);
+      portENTER_CRITICAL(&link_lock);
+      link = (gap_link_info_t) {.conn_handle = BLE_HS_CONN_HANDLE_NONE};
+      update_retry = false;
+      portEXIT_CRITICAL(&link_lock);
+
       // turn off the front LEDS
       set_led(3,false);
       set_led(2,false);
@@ -91,6 +266,10 @@ int gap_event_handler(struct ble_gap_event *event, void *arg) {
         ESP_LOGI(LOG_TAG_GAP, "GAP: Subscribe: conn_handle=%d",
                event->connect.conn_handle);
 
+        if (event->subscribe.attr_handle == telemetry_val_handle) {
+            telemetry_set_subscribed(event->subscribe.conn_handle, event->subscribe.cur_notify);
+        }
+
         // turn on the front headlines
         set_led(0,true);
         set_led(1,true);
@@ -102,6 +281,33 @@ int gap_event_handler(struct ble_gap_event *event, void *arg) {
     case BLE_GAP_EVENT_MTU:
         ESP_LOGI(LOG_TAG_GAP, "GAP: MTU update: conn_handle=%d, mtu=%d",
                event->mtu.conn_handle, event->mtu.value);
+      portENTER_CRITICAL(&link_lock);
+      link.mtu = event->mtu.value;
+      portEXIT_CRITICAL(&link_lock);
+      break;
+
+    case BLE_GAP_EVENT_CONN_UPDATE:
+      refresh_link(event->conn_update.conn_handle);
+
+      // the mode changed while the previous request was still pending
+      portENTER_CRITICAL(&link_lock);
+      retry = update_retry;
+      idle = link.idle;
+      portEXIT_CRITICAL(&link_lock);
+      if (retry) {
+        request_params(event->conn_update.conn_handle, idle);
+      }
+      break;
+
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+      ESP_LOGI(LOG_TAG_GAP, "GAP: PHY update: status=%d, tx=%d, rx=%d",
+               event->phy_updated.status, event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+      if (event->phy_updated.status == 0) {
+        portENTER_CRITICAL(&link_lock);
+        link.tx_phy = event->phy_updated.tx_phy;
+        link.rx_phy = event->phy_updated.rx_phy;
+        portEXIT_CRITICAL(&link_lock);
+      }
       break;
   }
 
@@ -8,9 +8,39 @@
 
 #define LOG_TAG_GAP "gap"
 
+// connection parameters, intervals in 1.25 ms units, supervision timeout in 10 ms units
+#define GAP_ACTIVE_ITVL_MIN         6      // 7.5 ms while driving
+#define GAP_ACTIVE_ITVL_MAX         12     // 15 ms
+#define GAP_ACTIVE_LATENCY          0
+#define GAP_IDLE_ITVL_MIN           80     // 100 ms once nothing is driving the car
+#define GAP_IDLE_ITVL_MAX           160    // 200 ms
+#define GAP_IDLE_LATENCY            4      // may skip 4 connection events
+#define GAP_SUPERVISION_TIMEOUT     400    // 4 s, longer than (1 + latency) * interval * 2 in both modes
+#define GAP_IDLE_TIMEOUT_MS         5000   // no control writes for this long relaxes the link
+
+// currently negotiated link, for diagnostics
+typedef struct __attribute__((packed)) {
+  uint16_t conn_handle;          // BLE_HS_CONN_HANDLE_NONE when not connected
+  uint16_t interval;             // 1.25 ms units
+  uint16_t latency;
+  uint16_t supervision_timeout;  // 10 ms units
+  uint8_t tx_phy;                // BLE_GAP_LE_PHY_1M or BLE_GAP_LE_PHY_2M
+  uint8_t rx_phy;
+  uint16_t mtu;
+  uint8_t idle;                  // 1 when the relaxed parameters were requested
+} gap_link_info_t;
+
 static const char device_name[] = "Racer3";
 
+esp_err_t gap_init(void);
 void advertise();
 void reset_cb(int reason);
 void sync_cb(void);
-void host_task(void *param);
\ No newline at end of file
+// Starts advertising and the race director scan, once the host is synced and BOOT_CONTROL_READY is set
+void gap_start(void);
+void host_task(void *param);
+
+// Called for every control write, switches back to the low latency parameters when idle
+void gap_link_activity(void);
+
+void gap_get_link_info(gap_link_info_t *info);
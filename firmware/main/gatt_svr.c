@@ -2,16 +2,33 @@
 #include "mbedtls/aes.h"
 #include <string.h>
 #include "controller.h"
-
-
-uint8_t gatt_svr_chr_ota_control_val;
-uint8_t gatt_svr_chr_ota_data_val[128];
+#include "model_store.h"
+#include "control_protocol.h"
+#include "gap.h"
+#include "battery.h"
+#include "telemetry.h"
+#include "capture.h"
+#include "game_effect.h"
+#include "calibration.h"
+#include "ota.h"
+#include "trace.h"
+
+
+uint8_t gatt_svr_chr_ota_control_val[1 + sizeof(ota_request_t)];
+uint8_t gatt_svr_chr_ota_data_val[sizeof(ota_chunk_header_t) + BLE_ATT_ATTR_MAX_LEN];
+uint8_t gatt_svr_chr_drive_val[5];
+uint8_t gatt_svr_chr_model_val[2 + BLE_ATT_ATTR_MAX_LEN];
+uint8_t gatt_svr_chr_control_val[CONTROL_PACKET_MAX_LEN];
+uint8_t gatt_svr_chr_game_rules_val[GAME_EFFECT_MAX_WRITE];
+uint8_t gatt_svr_chr_calibration_val[3];
 
 uint16_t ota_control_val_handle;
 uint16_t ota_data_val_handle;
-
-uint16_t num_pkgs_received = 0;
-uint16_t packet_size = 0;
+uint16_t model_val_handle;
+uint16_t control_val_handle;
+uint16_t battery_level_val_handle;
+uint16_t telemetry_val_handle;
+uint16_t capture_val_handle;
 
 static const char *manuf_name = "DreamNight LLC";
 static const char *model_num = "Racer3";
@@ -28,11 +45,53 @@ static int gatt_svr_chr_ota_data_cb(uint16_t conn_handle, uint16_t attr_handle,
                                     struct ble_gatt_access_ctxt *ctxt,
                                     void *arg);
 
+static int gatt_svr_chr_drive_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt,
+                                 void *arg);
+
+static int gatt_svr_chr_model_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt,
+                                 void *arg);
+
+static int gatt_svr_chr_control_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                   struct ble_gatt_access_ctxt *ctxt,
+                                   void *arg);
+
+static int gatt_svr_chr_link_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                struct ble_gatt_access_ctxt *ctxt,
+                                void *arg);
+
+static int gatt_svr_chr_telemetry_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                     struct ble_gatt_access_ctxt *ctxt,
+                                     void *arg);
+
+static int gatt_svr_chr_capture_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                   struct ble_gatt_access_ctxt *ctxt,
+                                   void *arg);
+
+static int gatt_svr_chr_game_rules_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                      struct ble_gatt_access_ctxt *ctxt,
+                                      void *arg);
+
+static int gatt_svr_chr_calibration_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                       struct ble_gatt_access_ctxt *ctxt,
+                                       void *arg);
+
+#if TRACE_ENABLE
+static int gatt_svr_chr_trace_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt,
+                                 void *arg);
+#endif
+
 static int gatt_svr_chr_access_device_info(uint16_t conn_handle,
                                            uint16_t attr_handle,
                                            struct ble_gatt_access_ctxt *ctxt,
                                            void *arg);
 
+static int gatt_svr_chr_battery_level_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                         struct ble_gatt_access_ctxt *ctxt,
+                                         void *arg);
+
 static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
         {// Service: Device Information
                 .type = BLE_GATT_SVC_TYPE_PRIMARY,
@@ -56,6 +115,23 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
                         },
                 }},
 
+        {// Service: Battery
+                .type = BLE_GATT_SVC_TYPE_PRIMARY,
+                .uuid = BLE_UUID16_DECLARE(GATT_BATTERY_SERVICE_UUID),
+                .characteristics =
+                (struct ble_gatt_chr_def[]) {
+                        {
+                                // Characteristic: Battery Level, notified when it changes
+                                .uuid = BLE_UUID16_DECLARE(GATT_BATTERY_LEVEL_UUID),
+                                .access_cb = gatt_svr_chr_battery_level_cb,
+                                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+                                .val_handle = &battery_level_val_handle,
+                        },
+                        {
+                                0,
+                        },
+                }},
+
         {
                 // service: OTA Service
                 .type = BLE_GATT_SVC_TYPE_PRIMARY,
@@ -74,9 +150,71 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
                                 // characteristic: OTA data
                                 .uuid = &gatt_svr_chr_ota_data_uuid.u,
                                 .access_cb = gatt_svr_chr_ota_data_cb,
-                                .flags = BLE_GATT_CHR_F_WRITE,
+                                .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP,
                                 .val_handle = &ota_data_val_handle,
                         },
+                        {
+                                // characteristic: 5 byte drive command
+                                .uuid = &gatt_svr_chr_drive_uuid.u,
+                                .access_cb = gatt_svr_chr_drive_cb,
+                                .flags = BLE_GATT_CHR_F_WRITE,
+                        },
+                        {
+                                // characteristic: control
+                                .uuid = &gatt_svr_chr_control_uuid.u,
+                                .access_cb = gatt_svr_chr_control_cb,
+                                .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP,
+                                .val_handle = &control_val_handle,
+                        },
+                        {
+                                // characteristic: color model upload
+                                .uuid = &gatt_svr_chr_model_uuid.u,
+                                .access_cb = gatt_svr_chr_model_cb,
+                                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+                                .val_handle = &model_val_handle,
+                        },
+                        {
+                                // characteristic: link diagnostics
+                                .uuid = &gatt_svr_chr_link_uuid.u,
+                                .access_cb = gatt_svr_chr_link_cb,
+                                .flags = BLE_GATT_CHR_F_READ,
+                        },
+                        {
+                                // characteristic: telemetry stream
+                                .uuid = &gatt_svr_chr_telemetry_uuid.u,
+                                .access_cb = gatt_svr_chr_telemetry_cb,
+                                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE |
+                                         BLE_GATT_CHR_F_NOTIFY,
+                                .val_handle = &telemetry_val_handle,
+                        },
+                        {
+                                // characteristic: training data capture
+                                .uuid = &gatt_svr_chr_capture_uuid.u,
+                                .access_cb = gatt_svr_chr_capture_cb,
+                                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE |
+                                         BLE_GATT_CHR_F_NOTIFY,
+                                .val_handle = &capture_val_handle,
+                        },
+                        {
+                                // characteristic: game rules
+                                .uuid = &gatt_svr_chr_game_rules_uuid.u,
+                                .access_cb = gatt_svr_chr_game_rules_cb,
+                                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+                        },
+                        {
+                                // characteristic: sensor calibration
+                                .uuid = &gatt_svr_chr_calibration_uuid.u,
+                                .access_cb = gatt_svr_chr_calibration_cb,
+                                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+                        },
+#if TRACE_ENABLE
+                        {
+                                // characteristic: latency trace
+                                .uuid = &gatt_svr_chr_trace_uuid.u,
+                                .access_cb = gatt_svr_chr_trace_cb,
+                                .flags = BLE_GATT_CHR_F_READ,
+                        },
+#endif
                         {
                                 0,
                         }},
@@ -128,128 +266,318 @@ static int gatt_svr_chr_write(struct os_mbuf *om, uint16_t min_len,
     return 0;
 }
 
-static void update_ota_control(uint16_t conn_handle) {
-    struct os_mbuf *om;
-    esp_err_t err;
+static int gatt_svr_chr_ota_control_cb(uint16_t conn_handle,
+                                       uint16_t attr_handle,
+                                       struct ble_gatt_access_ctxt *ctxt,
+                                       void *arg) {
+    ota_status_t status;
+    uint16_t len;
+    int rc;
+
+    switch (ctxt->op) {
+        case BLE_GATT_ACCESS_OP_READ_CHR:
+            // a client is reading the current state of the update
+            ota_get_status(&status);
+            rc = os_mbuf_append(ctxt->om, &status, sizeof(status));
+            return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+        case BLE_GATT_ACCESS_OP_WRITE_CHR:
+            // a request or done, answered with a notification
+            rc = gatt_svr_chr_write(ctxt->om, 1, sizeof(gatt_svr_chr_ota_control_val),
+                                    gatt_svr_chr_ota_control_val, &len);
+            if (rc != 0) {
+                return rc;
+            }
+            gap_link_activity();
+            ota_control_receive(conn_handle, gatt_svr_chr_ota_control_val, len);
+            return 0;
+
+        default:
+            break;
+    }
+
+    // this shouldn't happen
+    assert(0);
+    return BLE_ATT_ERR_UNLIKELY;
+}
+
+
+// firmware image chunks, usually sent as write without response and acknowledged on OTA control
+static int gatt_svr_chr_ota_data_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                    struct ble_gatt_access_ctxt *ctxt,
+                                    void *arg) {
+    int rc;
+    uint16_t len;
+
+    rc = gatt_svr_chr_write(ctxt->om, sizeof(ota_chunk_header_t) + 1, sizeof(gatt_svr_chr_ota_data_val),
+                            gatt_svr_chr_ota_data_val, &len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    // keeps the fast connection interval for the whole transfer
+    gap_link_activity();
+    ota_data_receive(conn_handle, gatt_svr_chr_ota_data_val, len);
+    return 0;
+}
+
+// the original 5 byte command: speed A, direction A, speed B, direction B, duration in 100 ms
+static int gatt_svr_chr_drive_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt,
+                                 void *arg) {
+    int rc;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        assert(0);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    TRACE_ORIGIN_NOW(TRACE_FLOW_COMMAND);
+
+    rc = gatt_svr_chr_write(ctxt->om, sizeof(gatt_svr_chr_drive_val), sizeof(gatt_svr_chr_drive_val),
+                            gatt_svr_chr_drive_val, NULL);
+    if (rc != 0) {
+        return rc;
+    }
+
+    COMMAND_LOGI(LOG_TAG_GATT_SVR, "Received packet data:%i, %i, %i, %i, %i", gatt_svr_chr_drive_val[0],
+                 gatt_svr_chr_drive_val[1], gatt_svr_chr_drive_val[2], gatt_svr_chr_drive_val[3],
+                 gatt_svr_chr_drive_val[4]);
+
+    MotorCommand command = {gatt_svr_chr_drive_val[0], gatt_svr_chr_drive_val[1],
+                            gatt_svr_chr_drive_val[2], gatt_svr_chr_drive_val[3],
+                            gatt_svr_chr_drive_val[4]};
+    set_motor_command(command);
+    gap_link_activity();
+    return 0;
+}
+
+// versioned binary control packets, usually sent as write without response
+static int gatt_svr_chr_control_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                   struct ble_gatt_access_ctxt *ctxt,
+                                   void *arg) {
+    int rc;
+    uint16_t len;
 
-    // check which value has been received
-    switch (gatt_svr_chr_ota_control_val) {
-        case SVR_CHR_OTA_CONTROL_REQUEST:
-            // OTA request
-            ESP_LOGD(LOG_TAG_GATT_SVR, "OTA has been requested via BLE.");
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        assert(0);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
 
-            // is this only the initial request, or does this happen on every transaction?
+    TRACE_ORIGIN_NOW(TRACE_FLOW_COMMAND);
 
-            // this is saying back to the other device that we are good to go
-            gatt_svr_chr_ota_control_val = SVR_CHR_OTA_CONTROL_REQUEST_ACK;
+    rc = gatt_svr_chr_write(ctxt->om, sizeof(control_packet_header_t), sizeof(gatt_svr_chr_control_val),
+                            gatt_svr_chr_control_val, &len);
+    if (rc != 0) {
+        return rc;
+    }
 
-            // this would say that we are not good to go
-//      gatt_svr_chr_ota_control_val = SVR_CHR_OTA_CONTROL_REQUEST_NAK;
+    gap_link_activity();
+    return control_protocol_receive(gatt_svr_chr_control_val, len) == ESP_OK ? 0 : BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+}
 
-            // retrieve the packet size from OTA data
-            packet_size =
-                    (gatt_svr_chr_ota_data_val[1] << 8) + gatt_svr_chr_ota_data_val[0];
-            ESP_LOGI(LOG_TAG_GATT_SVR, "Packet size is: %d", packet_size);
+// color model upload, every write is a little endian offset followed by a chunk of the blob
+static int gatt_svr_chr_model_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt,
+                                 void *arg) {
+    int rc;
+    uint32_t version;
+    uint16_t len;
 
-            // clear the var
-            num_pkgs_received = 0;
+    switch (ctxt->op) {
+        case BLE_GATT_ACCESS_OP_READ_CHR:
+            version = model_store_active_version();
+            rc = os_mbuf_append(ctxt->om, &version, sizeof(version));
+            return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
 
-            // notify the client via BLE that the OTA has been acknowledged (or not)
-            om = ble_hs_mbuf_from_flat(&gatt_svr_chr_ota_control_val,
-                                       sizeof(gatt_svr_chr_ota_control_val));
-            ble_gattc_notify_custom(conn_handle, ota_control_val_handle, om);
-            ESP_LOGD(LOG_TAG_GATT_SVR, "OTA request acknowledgement has been sent.");
+        case BLE_GATT_ACCESS_OP_WRITE_CHR:
+            rc = gatt_svr_chr_write(ctxt->om, 3, sizeof(gatt_svr_chr_model_val),
+                                    gatt_svr_chr_model_val, &len);
+            if (rc != 0) {
+                return rc;
+            }
+
+            if (model_store_write((gatt_svr_chr_model_val[1] << 8) + gatt_svr_chr_model_val[0],
+                                  &gatt_svr_chr_model_val[2], len - 2) != ESP_OK) {
+                return BLE_ATT_ERR_UNLIKELY;
+            }
+            return 0;
 
+        default:
             break;
+    }
 
-            // this case is saying we are done with the comms and are closing the channel
-        case SVR_CHR_OTA_CONTROL_DONE:
+    assert(0);
+    return BLE_ATT_ERR_UNLIKELY;
+}
 
-            // if needed, we can run checks of any kind here before telling the
-            // other device if we are ok to terminate the channel
+// negotiated connection parameters and PHY, see gap_link_info_t
+static int gatt_svr_chr_link_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                struct ble_gatt_access_ctxt *ctxt,
+                                void *arg) {
+    gap_link_info_t info;
 
-            // i.e. turn off all motors before closing connection
-            gatt_svr_chr_ota_control_val = SVR_CHR_OTA_CONTROL_DONE_ACK;
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+        assert(0);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
 
-            // or
-//        gatt_svr_chr_ota_control_val = SVR_CHR_OTA_CONTROL_DONE_NAK;
+    gap_get_link_info(&info);
+    return os_mbuf_append(ctxt->om, &info, sizeof(info)) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
 
+// sample rate of the telemetry stream, the records themselves are only notified
+static int gatt_svr_chr_telemetry_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                     struct ble_gatt_access_ctxt *ctxt,
+                                     void *arg) {
+    uint16_t rate;
+    uint16_t len;
+    int rc;
 
-            // notify the client via BLE that DONE has been acknowledged
-            om = ble_hs_mbuf_from_flat(&gatt_svr_chr_ota_control_val,
-                                       sizeof(gatt_svr_chr_ota_control_val));
+    switch (ctxt->op) {
+        case BLE_GATT_ACCESS_OP_READ_CHR:
+            rate = telemetry_get_rate();
+            rc = os_mbuf_append(ctxt->om, &rate, sizeof(rate));
+            return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
 
-            ble_gattc_notify_custom(conn_handle, ota_control_val_handle, om);
-            ESP_LOGD(LOG_TAG_GATT_SVR, "OTA DONE acknowledgement has been sent.");
+        case BLE_GATT_ACCESS_OP_WRITE_CHR:
+            rc = gatt_svr_chr_write(ctxt->om, sizeof(rate), sizeof(rate), &rate, &len);
+            if (rc != 0) {
+                return rc;
+            }
+            return telemetry_set_rate(rate) == ESP_OK ? 0 : BLE_ATT_ERR_VALUE_NOT_ALLOWED;
 
+        default:
             break;
+    }
+
+    assert(0);
+    return BLE_ATT_ERR_UNLIKELY;
+}
+
+// label of the training data capture, the samples themselves are only notified
+static int gatt_svr_chr_capture_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                   struct ble_gatt_access_ctxt *ctxt,
+                                   void *arg) {
+    uint8_t label;
+    uint16_t len;
+    int rc;
+
+    switch (ctxt->op) {
+        case BLE_GATT_ACCESS_OP_READ_CHR:
+            label = capture_get_label();
+            rc = os_mbuf_append(ctxt->om, &label, sizeof(label));
+            return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+        case BLE_GATT_ACCESS_OP_WRITE_CHR:
+            rc = gatt_svr_chr_write(ctxt->om, sizeof(label), sizeof(label), &label, &len);
+            if (rc != 0) {
+                return rc;
+            }
+            return capture_set_label(conn_handle, label) == ESP_OK ? 0 : BLE_ATT_ERR_VALUE_NOT_ALLOWED;
 
         default:
             break;
     }
 
+    assert(0);
+    return BLE_ATT_ERR_UNLIKELY;
+}
+
+// effect table, see game_effect.h for the format
+static int gatt_svr_chr_game_rules_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                      struct ble_gatt_access_ctxt *ctxt,
+                                      void *arg) {
+    game_effect_t table[GAME_EFFECT_COUNT];
+    uint16_t len;
+    int rc;
+
+    switch (ctxt->op) {
+        case BLE_GATT_ACCESS_OP_READ_CHR:
+            game_effect_get_table(table);
+            rc = os_mbuf_append(ctxt->om, table, sizeof(table));
+            return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+        case BLE_GATT_ACCESS_OP_WRITE_CHR:
+            rc = gatt_svr_chr_write(ctxt->om, 1, sizeof(gatt_svr_chr_game_rules_val),
+                                    gatt_svr_chr_game_rules_val, &len);
+            if (rc != 0) {
+                return rc;
+            }
+            return game_effect_receive(gatt_svr_chr_game_rules_val, len) == ESP_OK ? 0 : BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+
+        default:
+            break;
+    }
 
+    assert(0);
+    return BLE_ATT_ERR_UNLIKELY;
 }
 
-static int gatt_svr_chr_ota_control_cb(uint16_t conn_handle,
-                                       uint16_t attr_handle,
+// references and sensor settings, see calibration.h for the format
+static int gatt_svr_chr_calibration_cb(uint16_t conn_handle, uint16_t attr_handle,
                                        struct ble_gatt_access_ctxt *ctxt,
                                        void *arg) {
+    calibration_state_t calibration;
+    uint16_t len;
     int rc;
-    uint8_t length = sizeof(gatt_svr_chr_ota_control_val);
 
     switch (ctxt->op) {
         case BLE_GATT_ACCESS_OP_READ_CHR:
-            // a client is reading the current value of ota control
-            rc = os_mbuf_append(ctxt->om, &gatt_svr_chr_ota_control_val, length);
+            calibration_get_state(&calibration);
+            rc = os_mbuf_append(ctxt->om, &calibration, sizeof(calibration));
             return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
-            break;
 
         case BLE_GATT_ACCESS_OP_WRITE_CHR:
-            // a client is writing a value to ota control
-            rc = gatt_svr_chr_write(ctxt->om, 1, length,
-                                    &gatt_svr_chr_ota_control_val, NULL);
-
-            // write the new value control:
-            update_ota_control(conn_handle);
-            return rc;
-            break;
+            rc = gatt_svr_chr_write(ctxt->om, 1, sizeof(gatt_svr_chr_calibration_val),
+                                    gatt_svr_chr_calibration_val, &len);
+            if (rc != 0) {
+                return rc;
+            }
+            return calibration_receive(gatt_svr_chr_calibration_val, len) == ESP_OK ? 0 : BLE_ATT_ERR_VALUE_NOT_ALLOWED;
 
         default:
             break;
     }
 
-    // this shouldn't happen
     assert(0);
     return BLE_ATT_ERR_UNLIKELY;
 }
 
+#if TRACE_ENABLE
+// latency histograms, see trace.h
+static int gatt_svr_chr_trace_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt,
+                                 void *arg) {
+    trace_summary_t summary[TRACE_ID_COUNT];
 
-// this is where we will recieve the actual data over characteristic OTA Data
-static int gatt_svr_chr_ota_data_cb(uint16_t conn_handle, uint16_t attr_handle,
-                                    struct ble_gatt_access_ctxt *ctxt,
-                                    void *arg) {
-    int rc;
-    esp_err_t err;
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+        assert(0);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
 
-    // store the received data into gatt_svr_chr_ota_data_val
-    rc = gatt_svr_chr_write(ctxt->om, 1, sizeof(gatt_svr_chr_ota_data_val),
-                            gatt_svr_chr_ota_data_val, NULL);
+    trace_get_summary(summary);
+    return os_mbuf_append(ctxt->om, summary, sizeof(summary)) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+#endif
 
-    ESP_LOGI(LOG_TAG_GATT_SVR, "Received packet data:%i, %i, %i, %i, %i", gatt_svr_chr_ota_data_val[0],
-             gatt_svr_chr_ota_data_val[1], gatt_svr_chr_ota_data_val[2], gatt_svr_chr_ota_data_val[3],
-             gatt_svr_chr_ota_data_val[4]);
+static int gatt_svr_chr_battery_level_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                         struct ble_gatt_access_ctxt *ctxt,
+                                         void *arg) {
+    uint8_t level;
 
-    // Example command to set motor speeds and direction for 10 seconds
-    MotorCommand command = {gatt_svr_chr_ota_data_val[0], gatt_svr_chr_ota_data_val[1],
-                            gatt_svr_chr_ota_data_val[2], gatt_svr_chr_ota_data_val[3],
-                            gatt_svr_chr_ota_data_val[4]};
-    set_motor_command(command);
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+        assert(0);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
 
-    num_pkgs_received++;
-    ESP_LOGI(LOG_TAG_GATT_SVR, "Received packet %d", num_pkgs_received);
+    level = battery_get_level();
+    return os_mbuf_append(ctxt->om, &level, sizeof(level)) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
 
-    return rc;
+void gatt_svr_battery_level_changed(void) {
+    // pushed to every subscribed central, nobody has to poll for it
+    ble_gatts_chr_updated(battery_level_val_handle);
 }
 
 void gatt_svr_init() {
@@ -11,6 +11,8 @@
 #define GATT_DEVICE_INFO_UUID 0x180A
 #define GATT_MANUFACTURER_NAME_UUID 0x2A29
 #define GATT_MODEL_NUMBER_UUID 0x2A24
+#define GATT_BATTERY_SERVICE_UUID 0x180F
+#define GATT_BATTERY_LEVEL_UUID 0x2A19
 
 typedef enum {
   SVR_CHR_OTA_CONTROL_NOP,
@@ -20,6 +22,8 @@ typedef enum {
   SVR_CHR_OTA_CONTROL_DONE,
   SVR_CHR_OTA_CONTROL_DONE_ACK,
   SVR_CHR_OTA_CONTROL_DONE_NAK,
+  SVR_CHR_OTA_CONTROL_DATA_ACK,
+  SVR_CHR_OTA_CONTROL_DATA_NAK,
 } svr_chr_ota_control_val_t;
 
 
@@ -29,18 +33,80 @@ static const ble_uuid128_t gatt_svr_svc_ota_uuid =
         BLE_UUID128_INIT(0xd8, 0xe6, 0xfd, 0x1d, 0x4a, 024, 0xc6, 0xb1, 0x53, 0x4c,
                          0x4c, 0x59, 0x6d, 0xd9, 0xf1, 0xd6);
 
-// characteristic: OTA Control
+// characteristic: OTA Control, see ota.h
 // 7ad671aa-21c0-46a4-b722-270e3ae3d830
 static const ble_uuid128_t gatt_svr_chr_ota_control_uuid =
         BLE_UUID128_INIT(0x30, 0xd8, 0xe3, 0x3a, 0x0e, 0x27, 0x22, 0xb7, 0xa4, 0x46,
                          0xc0, 0x21, 0xaa, 0x71, 0xd6, 0x7a);
 
-// characteristic: OTA Data
+// characteristic: OTA Data, firmware image chunks, see ota.h
 // 23408888-1f40-4cd8-9b89-ca8d45f8a5b0
 static const ble_uuid128_t gatt_svr_chr_ota_data_uuid =
         BLE_UUID128_INIT(0xb0, 0xa5, 0xf8, 0x45, 0x8d, 0xca, 0x89, 0x9b, 0xd8, 0x4c,
                          0x40, 0x1f, 0x88, 0x88, 0x40, 0x23);
 
+// characteristic: Drive, the original 5 byte MotorCommand
+// c4a27e19-3d58-4b6f-91e2-7f0b5d83a6c1
+static const ble_uuid128_t gatt_svr_chr_drive_uuid =
+        BLE_UUID128_INIT(0xc1, 0xa6, 0x83, 0x5d, 0x0b, 0x7f, 0xe2, 0x91, 0x6f, 0x4b,
+                         0x58, 0x3d, 0x19, 0x7e, 0xa2, 0xc4);
 
+// characteristic: Control, see control_protocol.h for the packet format
+// 5b2e8d34-7c1a-4e0b-9f6d-2a8c3e71b4d2
+static const ble_uuid128_t gatt_svr_chr_control_uuid =
+        BLE_UUID128_INIT(0xd2, 0xb4, 0x71, 0x3e, 0x8c, 0x2a, 0x6d, 0x9f, 0x0b, 0x4e,
+                         0x1a, 0x7c, 0x34, 0x8d, 0x2e, 0x5b);
 
-void gatt_svr_init();
\ No newline at end of file
+// characteristic: Color Model
+// write: [offset lo, offset hi, blob bytes...], read: active model version
+// 9d3c62a4-3b8e-4f1a-9a1c-6a5c8e2b7f10
+static const ble_uuid128_t gatt_svr_chr_model_uuid =
+        BLE_UUID128_INIT(0x10, 0x7f, 0x2b, 0x8e, 0x5c, 0x6a, 0x1c, 0x9a, 0x1a, 0x4f,
+                         0x8e, 0x3b, 0xa4, 0x62, 0x3c, 0x9d);
+
+// characteristic: Link, read only gap_link_info_t for diagnostics
+// a1f4c2d9-6e3b-4b8a-8d57-3c9e0f12ab64
+static const ble_uuid128_t gatt_svr_chr_link_uuid =
+        BLE_UUID128_INIT(0x64, 0xab, 0x12, 0x0f, 0x9e, 0x3c, 0x57, 0x8d, 0x8a, 0x4b,
+                         0x3b, 0x6e, 0xd9, 0xc2, 0xf4, 0xa1);
+
+// characteristic: Telemetry, notify batches of telemetry_record_t, read/write: rate in Hz (u16)
+// e7b3a615-2f4c-4d8e-b0a9-58c1d6e4f372
+static const ble_uuid128_t gatt_svr_chr_telemetry_uuid =
+        BLE_UUID128_INIT(0x72, 0xf3, 0xe4, 0xd6, 0xc1, 0x58, 0xa9, 0xb0, 0x8e, 0x4d,
+                         0x4c, 0x2f, 0x15, 0xa6, 0xb3, 0xe7);
+
+
+
+// characteristic: Capture, see capture.h
+// 4c8e1f27-93b5-4a6d-8e02-d7f3b9a15c48
+static const ble_uuid128_t gatt_svr_chr_capture_uuid =
+        BLE_UUID128_INIT(0x48, 0x5c, 0xa1, 0xb9, 0xf3, 0xd7, 0x02, 0x8e, 0x6d, 0x4a,
+                         0xb5, 0x93, 0x27, 0x1f, 0x8e, 0x4c);
+
+// characteristic: Game Rules, see game_effect.h
+// 0b7d9e42-5c1f-4a83-9e6b-f2a4c8d31e57
+static const ble_uuid128_t gatt_svr_chr_game_rules_uuid =
+        BLE_UUID128_INIT(0x57, 0x1e, 0xd3, 0xc8, 0xa4, 0xf2, 0x6b, 0x9e, 0x83, 0x4a,
+                         0x1f, 0x5c, 0x42, 0x9e, 0x7d, 0x0b);
+
+// characteristic: Calibration, see calibration.h
+// 3e8b5d21-a6c4-4f97-8b13-c52e0d9a7f64
+static const ble_uuid128_t gatt_svr_chr_calibration_uuid =
+        BLE_UUID128_INIT(0x64, 0x7f, 0x9a, 0x0d, 0x2e, 0xc5, 0x13, 0x8b, 0x97, 0x4f,
+                         0xc4, 0xa6, 0x21, 0x5d, 0x8b, 0x3e);
+
+// characteristic: Trace, read only TRACE_ID_COUNT trace_summary_t, only with TRACE_ENABLE
+// 6f2a8c51-d94e-4b17-a3c6-1e5b7d09f8a2
+static const ble_uuid128_t gatt_svr_chr_trace_uuid =
+        BLE_UUID128_INIT(0xa2, 0xf8, 0x09, 0x7d, 0x5b, 0x1e, 0xc6, 0xa3, 0x17, 0x4b,
+                         0x4e, 0xd9, 0x51, 0x8c, 0x2a, 0x6f);
+
+extern uint16_t ota_control_val_handle;
+extern uint16_t telemetry_val_handle;
+extern uint16_t capture_val_handle;
+
+void gatt_svr_init();
+
+// Notifies subscribers of the Battery Level characteristic, called when battery_get_level changes
+void gatt_svr_battery_level_changed(void);
\ No newline at end of file
@@ -3,30 +3,62 @@
 
 static const char *TAG = "i2c_config";
 
+static i2c_master_bus_handle_t bus_handle = NULL;
+
 esp_err_t i2c_master_init(void)
 {
-    int i2c_master_port = I2C_MASTER_NUM;
-    i2c_config_t conf = {
-            .mode = I2C_MODE_MASTER,
+    if (bus_handle != NULL) {
+        return ESP_OK;
+    }
+
+    // a non zero queue depth puts the bus in asynchronous mode: transactions return
+    // right away and complete from the I2C ISR (the ESP32-H2 I2C has no DMA)
+    i2c_master_bus_config_t conf = {
+            .i2c_port = I2C_MASTER_NUM,
             .sda_io_num = I2C_MASTER_SDA_IO,
-            .sda_pullup_en = GPIO_PULLUP_ENABLE,
             .scl_io_num = I2C_MASTER_SCL_IO,
-            .scl_pullup_en = GPIO_PULLUP_ENABLE,
-            .master.clk_speed = I2C_MASTER_FREQ_HZ,
+            .clk_source = I2C_CLK_SRC_DEFAULT,
+            .glitch_ignore_cnt = 7,
+            .trans_queue_depth = I2C_MASTER_TRANS_QUEUE_DEPTH,
+            .flags.enable_internal_pullup = true,
     };
 
-    esp_err_t err = i2c_param_config(i2c_master_port, &conf);
+    esp_err_t err = i2c_new_master_bus(&conf, &bus_handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "I2C parameter configuration failed. Error: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "I2C bus creation failed. Error: %s", esp_err_to_name(err));
         return err;
     }
 
-    err = i2c_driver_install(i2c_master_port, conf.mode, I2C_MASTER_RX_BUF_DISABLE, I2C_MASTER_TX_BUF_DISABLE, 0);
+    ESP_LOGI(TAG, "I2C master initialized successfully at %d Hz", I2C_MASTER_FREQ_HZ);
+    return ESP_OK;
+}
+
+esp_err_t i2c_config_add_device(uint16_t address, i2c_master_dev_handle_t *device)
+{
+    return i2c_config_add_device_at(address, I2C_MASTER_FREQ_HZ, device);
+}
+
+esp_err_t i2c_config_add_device_at(uint16_t address, uint32_t scl_speed_hz, i2c_master_dev_handle_t *device)
+{
+    esp_err_t err = i2c_master_init();
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "I2C driver installation failed. Error: %s", esp_err_to_name(err));
         return err;
     }
 
-    ESP_LOGI(TAG, "I2C master initialized successfully");
-    return ESP_OK;
+    i2c_device_config_t dev_conf = {
+            .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+            .device_address = address,
+            .scl_speed_hz = scl_speed_hz,
+    };
+
+    err = i2c_master_bus_add_device(bus_handle, &dev_conf, device);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Adding I2C device 0x%02x failed. Error: %s", address, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t i2c_config_wait_all_done(void)
+{
+    return i2c_master_bus_wait_all_done(bus_handle, I2C_MASTER_TIMEOUT_MS);
 }
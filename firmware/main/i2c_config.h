@@ -1,17 +1,21 @@
 #ifndef I2C_CONFIG_H
 #define I2C_CONFIG_H
 
-#include "driver/i2c.h"
+#include "driver/i2c_master.h"
 
-// I2C configuration
+// I2C configuration, the one bus shared by every I2C device on the car
 #define I2C_MASTER_SCL_IO           0                  // GPIO number for I2C master clock (IO0)
 #define I2C_MASTER_SDA_IO           1                  // GPIO number for I2C master data (IO1)
 #define I2C_MASTER_NUM              0                  // I2C master i2c port number
-#define I2C_MASTER_FREQ_HZ          400000             // I2C master clock frequency (400 kHz)
-#define I2C_MASTER_TX_BUF_DISABLE   0                  // I2C master doesn't need buffer
-#define I2C_MASTER_RX_BUF_DISABLE   0                  // I2C master doesn't need buffer
+#define I2C_MASTER_FREQ_HZ          400000             // I2C master clock frequency (400 kHz fast mode)
+#define I2C_MASTER_TRANS_QUEUE_DEPTH 4                 // queued asynchronous transactions
+#define I2C_MASTER_TIMEOUT_MS       10                 // timeout for waiting on a transaction
 
 // Function prototypes
 esp_err_t i2c_master_init(void);
+esp_err_t i2c_config_add_device(uint16_t address, i2c_master_dev_handle_t *device);
+// Like i2c_config_add_device, at scl_speed_hz instead of I2C_MASTER_FREQ_HZ
+esp_err_t i2c_config_add_device_at(uint16_t address, uint32_t scl_speed_hz, i2c_master_dev_handle_t *device);
+esp_err_t i2c_config_wait_all_done(void);
 
 #endif // I2C_CONFIG_H
@@ -1,66 +1,167 @@
 // led.c
 
 #include "led.h"
+#include "sdkconfig.h"
+#include "freertos/semphr.h"
 #include "driver/gpio.h"
-#include <stdio.h>
+#include "esp_log.h"
+#include "esp_rom_gpio.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/ledc_periph.h"
+#include "shared_state.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
 
-// Shared configuration structure
-led_config_t led_config = {
+static const char *TAG = "led";
+
+// only touched under led_mutex, everyone else reads the copy published in shared_state
+static led_config_t led_config = {
         .mode = LED_CONST,
         .flash_period = pdMS_TO_TICKS(500), // Default 500ms
+        .brightness = LED_MAX_BRIGHTNESS,
         .led_state = {false, false, false, false}
 };
 
 static const int led_gpios[NUM_LEDS] = {LED_1_GPIO, LED_2_GPIO, LED_3_GPIO, LED_4_GPIO};
 
-static int get_gpio_num(int led_index)
-{
-    if (led_index >= 0 && led_index < NUM_LEDS) {
-        return led_gpios[led_index];
-    }
-    return -1;
-}
-
-static void led_task(void *pvParameters)
-{
-    TickType_t xLastWakeTime = xTaskGetTickCount();
-    bool toggle = false;
-
-    while (1) {
-        switch (led_config.mode) {
-            case LED_CONST:
-                // Apply current LED states
-                for (int i = 0; i < NUM_LEDS; i++) {
-                    gpio_set_level(led_gpios[i], led_config.led_state[i] ? 1 : 0);
-                }
-                vTaskDelay(led_config.flash_period);
-                break;
-            case LED_FLASH_ALL:
-                for (int i = 0; i < NUM_LEDS; i++) {
-                    gpio_set_level(led_gpios[i], toggle ? 1 : 0);
-                }
-                toggle = !toggle;
-                vTaskDelayUntil(&xLastWakeTime, led_config.flash_period);
-                break;
-            case LED_FLASH_BACK:
-                gpio_set_level(led_gpios[0], toggle ? 1 : 0);
-                gpio_set_level(led_gpios[1], toggle ? 1 : 0);
-                toggle = !toggle;
-                vTaskDelayUntil(&xLastWakeTime, led_config.flash_period);
-                break;
-            case LED_FLASH_FRONT:
-                gpio_set_level(led_gpios[2], toggle ? 1 : 0);
-                gpio_set_level(led_gpios[3], toggle ? 1 : 0);
-                toggle = !toggle;
-                vTaskDelayUntil(&xLastWakeTime, led_config.flash_period);
-                break;
-            case LED_FLASH_FRONT_ALTERNATE:
-                gpio_set_level(led_gpios[2], toggle ? 1 : 0);
-                gpio_set_level(led_gpios[3], toggle ? 0 : 1);
-                toggle = !toggle;
-                vTaskDelayUntil(&xLastWakeTime, led_config.flash_period);
-                break;
+// what drives an LED pin
+typedef enum {
+    LED_OUT_OFF,
+    LED_OUT_ON,             // plain GPIO high, full brightness
+    LED_OUT_DIMMED,         // steady channel
+    LED_OUT_FLASH,          // flash channel
+    LED_OUT_FLASH_INVERTED, // flash channel, opposite phase
+} led_output_t;
+
+// every change reprograms the hardware under this, nothing runs in between
+static SemaphoreHandle_t led_mutex = NULL;
+static StaticSemaphore_t led_mutex_buffer;
+
+#if CONFIG_PM_ENABLE
+// LEDC stops in light sleep, held while a channel drives any LED
+static esp_pm_lock_handle_t led_pm_lock;
+static bool led_pm_lock_held = false;
+#endif
+
+static TickType_t flash_period_applied = 0;
+
+// LEDC takes whole Hz, so periods above 500 ms end up flashing at 1 Hz
+static uint32_t flash_freq_hz(TickType_t period)
+{
+    uint32_t period_ms = pdTICKS_TO_MS(period);
+    uint32_t freq_hz = period_ms ? (500 + period_ms / 2) / period_ms : 0;
+    return freq_hz ? freq_hz : 1;
+}
+
+static led_output_t led_output(int led_index)
+{
+    led_output_t steady = !led_config.led_state[led_index] ? LED_OUT_OFF :
+                          led_config.brightness >= LED_MAX_BRIGHTNESS ? LED_OUT_ON : LED_OUT_DIMMED;
+
+    switch (led_config.mode) {
+        case LED_FLASH_ALL:
+            return LED_OUT_FLASH;
+        case LED_FLASH_BACK:
+            return led_index <= 1 ? LED_OUT_FLASH : steady;
+        case LED_FLASH_FRONT:
+            return led_index >= 2 ? LED_OUT_FLASH : steady;
+        case LED_FLASH_FRONT_ALTERNATE:
+            return led_index == 2 ? LED_OUT_FLASH : led_index == 3 ? LED_OUT_FLASH_INVERTED : steady;
+        case LED_CONST:
+        default:
+            return steady;
+    }
+}
+
+static void route_led(int gpio, led_output_t output)
+{
+    switch (output) {
+        case LED_OUT_OFF:
+        case LED_OUT_ON:
+            esp_rom_gpio_connect_out_signal(gpio, SIG_GPIO_OUT_IDX, false, false);
+            gpio_set_level(gpio, output == LED_OUT_ON);
+            break;
+        case LED_OUT_DIMMED:
+            esp_rom_gpio_connect_out_signal(gpio, ledc_periph_signal[LEDC_LOW_SPEED_MODE].sig_out0_idx +
+                                            LED_STEADY_CHANNEL, false, false);
+            break;
+        case LED_OUT_FLASH:
+        case LED_OUT_FLASH_INVERTED:
+            esp_rom_gpio_connect_out_signal(gpio, ledc_periph_signal[LEDC_LOW_SPEED_MODE].sig_out0_idx +
+                                            LED_FLASH_CHANNEL, output == LED_OUT_FLASH_INVERTED, false);
+            break;
+    }
+}
+
+// square law, so equal brightness steps look roughly equal
+static uint32_t brightness_to_duty(uint8_t percent)
+{
+    uint32_t max_duty = (1 << LED_STEADY_DUTY_RES) - 1;
+    return max_duty * percent * percent / (LED_MAX_BRIGHTNESS * LED_MAX_BRIGHTNESS);
+}
+
+// programs both channels and the pin routing for the current led_config, led_mutex held
+static void led_apply(void)
+{
+    bool dimmed = false;
+    bool flashing = false;
+
+    for (int i = 0; i < NUM_LEDS; i++) {
+        led_output_t output = led_output(i);
+        dimmed = dimmed || output == LED_OUT_DIMMED;
+        flashing = flashing || output == LED_OUT_FLASH || output == LED_OUT_FLASH_INVERTED;
+    }
+
+#if CONFIG_PM_ENABLE
+    if ((dimmed || flashing) != led_pm_lock_held) {
+        led_pm_lock_held = dimmed || flashing;
+        if (led_pm_lock_held) {
+            esp_pm_lock_acquire(led_pm_lock);
+        } else {
+            esp_pm_lock_release(led_pm_lock);
+        }
+    }
+#endif
+
+    // unused timers are paused, so the LEDs cost nothing while they are steady
+    if (dimmed) {
+        ledc_set_duty(LEDC_LOW_SPEED_MODE, LED_STEADY_CHANNEL, brightness_to_duty(led_config.brightness));
+        ledc_update_duty(LEDC_LOW_SPEED_MODE, LED_STEADY_CHANNEL);
+        ledc_timer_resume(LEDC_LOW_SPEED_MODE, LED_STEADY_TIMER);
+    } else {
+        ledc_timer_pause(LEDC_LOW_SPEED_MODE, LED_STEADY_TIMER);
+    }
+
+    if (flashing) {
+        if (led_config.flash_period != flash_period_applied) {
+            ledc_set_freq(LEDC_LOW_SPEED_MODE, LED_FLASH_TIMER, flash_freq_hz(led_config.flash_period));
+            flash_period_applied = led_config.flash_period;
         }
+        ledc_timer_resume(LEDC_LOW_SPEED_MODE, LED_FLASH_TIMER);
+    } else {
+        ledc_timer_pause(LEDC_LOW_SPEED_MODE, LED_FLASH_TIMER);
+    }
+
+    for (int i = 0; i < NUM_LEDS; i++) {
+        route_led(led_gpios[i], led_output(i));
+    }
+}
+
+// every change of led_config goes between these two; before led_init it only lands in led_config
+static void led_change_begin(void)
+{
+    if (led_mutex != NULL) {
+        xSemaphoreTake(led_mutex, portMAX_DELAY);
+    }
+}
+
+static void led_change_end(void)
+{
+    if (led_mutex != NULL) {
+        led_apply();
+        shared_state_publish_led(&led_config);
+        xSemaphoreGive(led_mutex);
     }
 }
 
@@ -74,6 +175,38 @@ static void configure_led(int gpio)
             .pull_up_en = 0
     };
     gpio_config(&io_conf);
+
+    // hold the level through light sleep
+    gpio_sleep_sel_dis(gpio);
+}
+
+static esp_err_t configure_led_channel(ledc_timer_t timer, ledc_channel_t channel, ledc_timer_bit_t resolution,
+                                       uint32_t freq_hz, uint32_t duty)
+{
+    // same clock source as the motor timer, LEDC has one source for all timers
+    const ledc_timer_config_t timer_config = {
+            .speed_mode = LEDC_LOW_SPEED_MODE,
+            .timer_num = timer,
+            .duty_resolution = resolution,
+            .freq_hz = freq_hz,
+            .clk_cfg = LEDC_USE_XTAL_CLK,
+    };
+    esp_err_t err = ledc_timer_config(&timer_config);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // bound to the first LED only to satisfy the driver, led_apply routes the pins
+    const ledc_channel_config_t channel_config = {
+            .speed_mode = LEDC_LOW_SPEED_MODE,
+            .channel = channel,
+            .timer_sel = timer,
+            .intr_type = LEDC_INTR_DISABLE,
+            .gpio_num = led_gpios[0],
+            .duty = duty,
+            .hpoint = 0,
+    };
+    return ledc_channel_config(&channel_config);
 }
 
 void led_init(void)
@@ -82,33 +215,74 @@ void led_init(void)
         configure_led(led_gpios[i]);
     }
 
-    xTaskCreate(led_task, "led_task", 2048, NULL, 10, NULL);
+    esp_err_t err = configure_led_channel(LED_STEADY_TIMER, LED_STEADY_CHANNEL, LED_STEADY_DUTY_RES,
+                                          LED_STEADY_FREQ_HZ, 0);
+    if (err == ESP_OK) {
+        // 50 % duty: on for one flash period, off for the next
+        err = configure_led_channel(LED_FLASH_TIMER, LED_FLASH_CHANNEL, LED_FLASH_DUTY_RES,
+                                    flash_freq_hz(led_config.flash_period), 1 << (LED_FLASH_DUTY_RES - 1));
+        flash_period_applied = led_config.flash_period;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "LED channel config failed: %s", esp_err_to_name(err));
+        return;
+    }
+
+#if CONFIG_PM_ENABLE
+    err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "leds", &led_pm_lock);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create LED power lock: %s", esp_err_to_name(err));
+        return;
+    }
+#endif
+
+    led_mutex = xSemaphoreCreateMutexStatic(&led_mutex_buffer);
+
+    led_change_begin();
+    led_change_end();
 }
 
 void set_led(int led_index, bool state)
 {
     if (led_index < 0 || led_index >= NUM_LEDS) {
-        printf("Invalid LED index\n");
+        ESP_LOGE(TAG, "Invalid LED index %d", led_index);
         return;
     }
 
+    led_change_begin();
     led_config.led_state[led_index] = state;
-    if (led_config.mode == LED_CONST) {
-        gpio_set_level(led_gpios[led_index], state ? 1 : 0);
-    }
-    printf("LED %d (GPIO %d) set to %s\n", led_index, led_gpios[led_index], state ? "ON" : "OFF");
+    led_change_end();
+    ESP_LOGD(TAG, "LED %d (GPIO %d) set to %s", led_index, led_gpios[led_index], state ? "ON" : "OFF");
 }
 
 void led_set_flash_mode(led_flash mode)
 {
+    led_change_begin();
     led_config.mode = mode;
-    printf("LED flash mode set to %d\n", mode);
+    led_change_end();
+    ESP_LOGD(TAG, "LED flash mode set to %d", mode);
 }
 
 void led_set_flash_period(TickType_t period)
 {
+    led_change_begin();
     led_config.flash_period = period;
-    printf("LED flash period set to %u ticks\n", (unsigned int)period);
+    led_change_end();
+    ESP_LOGD(TAG, "LED flash period set to %u ticks", (unsigned int)period);
+}
+
+void led_set_brightness(uint8_t percent)
+{
+    percent = percent > LED_MAX_BRIGHTNESS ? LED_MAX_BRIGHTNESS : percent;
+    led_change_begin();
+    led_config.brightness = percent;
+    led_change_end();
+    ESP_LOGD(TAG, "LED brightness set to %d%%", percent);
+}
+
+void led_get_config(led_config_t *config)
+{
+    shared_state_led(config);
 }
 
 void led_all_on(void)
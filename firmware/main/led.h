@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "driver/ledc.h"
 
 #define NUM_LEDS 4
 
@@ -14,6 +15,17 @@
 #define LED_3_GPIO 25
 #define LED_4_GPIO 22
 
+// hardware pattern engine: the motors own LEDC channels 0-3 on timer 0, the LEDs share the
+// other two channels through the GPIO matrix, one for dimmed steady LEDs, one for flashing
+#define LED_STEADY_TIMER        LEDC_TIMER_1
+#define LED_STEADY_CHANNEL      LEDC_CHANNEL_4
+#define LED_STEADY_FREQ_HZ      2000
+#define LED_STEADY_DUTY_RES     LEDC_TIMER_10_BIT
+#define LED_FLASH_TIMER         LEDC_TIMER_2
+#define LED_FLASH_CHANNEL       LEDC_CHANNEL_5
+#define LED_FLASH_DUTY_RES      LEDC_TIMER_16_BIT  // reaches below 1 Hz from the 32 MHz XTAL
+#define LED_MAX_BRIGHTNESS      100
+
 // LED states
 typedef enum {
     LED_CONST = 0,
@@ -25,12 +37,13 @@ typedef enum {
 
 typedef struct {
     led_flash mode;
-    TickType_t flash_period;
+    TickType_t flash_period;    // time on, and time off, of a flashing LED
+    uint8_t brightness;         // percent, for steady LEDs; flashing LEDs always flash at full power
     bool led_state[NUM_LEDS];
 } led_config_t;
 
-// Extern declaration of the shared configuration
-extern led_config_t led_config;
+// Copy of the current configuration, never blocks
+void led_get_config(led_config_t *config);
 
 // Original function prototypes
 void led_init(void);
@@ -39,6 +52,7 @@ void set_led(int led_index, bool state);
 // New function prototypes
 void led_set_flash_mode(led_flash mode);
 void led_set_flash_period(TickType_t period);
+void led_set_brightness(uint8_t percent);
 void led_all_on(void);
 void led_all_off(void);
 void led_front_on(void);
@@ -27,64 +27,40 @@
 // battery
 #include "battery.h"
 
-// interrupt on gpio
-#include "gpio_interrupt.h"
-
 // i2c config for the color sensor
 #include "i2c_config.h"
 
 #include "opt4060.h"
 #include "color_predictor.h"
-
-
-#define LEDC_TIMER              LEDC_TIMER_0
-#define LEDC_MODE               LEDC_LOW_SPEED_MODE
-#define LEDC_DUTY_RES           LEDC_TIMER_10_BIT // Set duty resolution to 13 bits
-#define LEDC_FREQUENCY          (15000) // Frequency in Hertz. Set frequency at 15 kHz
-
-#define MOTOR_A_FWD_GPIO        13
-#define MOTOR_A_BWD_GPIO        14
-#define MOTOR_B_FWD_GPIO        4
-#define MOTOR_B_BWD_GPIO        5
-
-// Global variables
-static bool motor_direction[NUM_MOTORS] = {true, true}; // true for forward, false for backward
-
-QueueHandle_t gpio_intr_evt_queue = NULL;
-NeuralNetwork nn;
-
-void gpio_interrupt_task(void *pvParameters)
-{
-    uint32_t io_num;
-    for(;;) {
-        if(xQueueReceive(gpio_intr_evt_queue, &io_num, portMAX_DELAY)) {
-            printf("GPIO[%lu] interrupt occurred (falling edge)!\n", io_num);
-
-            uint16_t red, green, blue, clear;
-            opt4060_read_color(&red, &green, &blue, &clear);
-            ESP_LOGD("main", "Color values - Red: %d, Green: %d, Blue: %d, Clear: %d, Color: White", red, green, blue, clear);
-
-            if (gpio_get_level(INTERRUPT_PIN) == 0) {
-                uint32_t color = predict_color(&nn, red, green, blue, clear);
-                command_set_game_status(color);
-            }
-        }
-    }
-}
-
-void app_main(void)
+#include "model_store.h"
+#include "color_stream.h"
+#include "control_protocol.h"
+#include "race_broadcast.h"
+#include "power.h"
+#include "tile_trigger.h"
+#include "telemetry.h"
+#include "capture.h"
+#include "calibration.h"
+#include "ota.h"
+#include "boot.h"
+#include "shared_state.h"
+#include "trace.h"
+#include "mem_audit.h"
+
+
+// motor task, queue and start semaphore live here for the whole run, not on the heap
+static StackType_t motor_task_stack[MOTOR_TASK_STACK_SIZE];
+static StaticTask_t motor_task_buffer;
+static uint8_t motor_queue_storage[MOTOR_QUEUE_SIZE * sizeof(MotorPairUpdate)];
+static StaticQueue_t motor_queue_buffer;
+static StaticSemaphore_t motor_start_semaphore_buffer;
+
+// LEDC for the motors and LEDs, and the motor task
+static esp_err_t motor_stage(void)
 {
-    ledc_timer_config_t ledc_timer = {
-            .speed_mode       = LEDC_MODE,
-            .timer_num        = LEDC_TIMER,
-            .duty_resolution  = LEDC_DUTY_RES,
-            .freq_hz          = LEDC_FREQUENCY,
-            .clk_cfg          = LEDC_AUTO_CLK
-    };
-    esp_err_t err = ledc_timer_config(&ledc_timer);
+    esp_err_t err = motor_pwm_init();
     if (err != ESP_OK) {
-        printf("LEDC Timer Config failed: %s\n", esp_err_to_name(err));
-        return;
+        return err;
     }
 
     // Initialize LEDs
@@ -93,34 +69,22 @@ void app_main(void)
     // set the blink rate to 100ms
     led_set_flash_period(pdMS_TO_TICKS(100));
 
-    // Configure Motors
-    configure_motor_pwm(MOTOR_A_FWD_GPIO, LEDC_CHANNEL_0);
-    configure_motor_pwm(MOTOR_A_BWD_GPIO, LEDC_CHANNEL_1);
-    configure_motor_pwm(MOTOR_B_FWD_GPIO, LEDC_CHANNEL_2);
-    configure_motor_pwm(MOTOR_B_BWD_GPIO, LEDC_CHANNEL_3);
+    // soft start / direction change ramps run off their own timer
+    err = motor_ramp_init();
+    if (err != ESP_OK) {
+        return err;
+    }
 
     // Create motor queue
-    motor_queue[0] = xQueueCreate(MOTOR_QUEUE_SIZE, sizeof(MotorUpdate));
-    if (motor_queue[0] == NULL) {
-        printf("Failed to create motor queue\n");
-        return;
-    }
-    motor_queue[1] = xQueueCreate(MOTOR_QUEUE_SIZE, sizeof(MotorUpdate));
-    if (motor_queue[1] == NULL) {
-        printf("Failed to create motor queue\n");
-        return;
-    }
+    motor_queue = xQueueCreateStatic(MOTOR_QUEUE_SIZE, sizeof(MotorPairUpdate), motor_queue_storage,
+                                     &motor_queue_buffer);
 
     // Create semaphore for synchronizing motor start
-    motor_start_semaphore = xSemaphoreCreateCounting(4,0);
-    if (motor_start_semaphore == NULL) {
-        printf("Failed to create motor start semaphore\n");
-        return;
-    }
+    motor_start_semaphore = xSemaphoreCreateCountingStatic(4, 0, &motor_start_semaphore_buffer);
 
-    // Create motor tasks for Motor A and Motor B
-    xTaskCreate(motor_task, "motor_task_A", 2048, (void *)0, 1, NULL);
-    xTaskCreate(motor_task, "motor_task_B", 2048, (void *)1, 1, NULL);
+    // Create the motor task driving Motor A and Motor B
+    xTaskCreateStatic(motor_task, "motor_task", MOTOR_TASK_STACK_SIZE, NULL, MOTOR_TASK_PRIORITY,
+                      motor_task_stack, &motor_task_buffer);
 
     // Turn on all LEDs
     for (int i = 0; i < NUM_LEDS; i++) {
@@ -131,9 +95,76 @@ void app_main(void)
     set_led(2,false);
     set_led(1,true);
     set_led(0,true);
+    return ESP_OK;
+}
+
+// I2C and the color sensor, and everything built on its samples
+static esp_err_t sensor_stage(void)
+{
+    // pick up a model uploaded over BLE before the first sample is classified
+    model_store_init();
+
+    // color sensor, a missing one costs the I2C timeout here and not in app_main
+    esp_err_t err = opt4060_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // the sensor is sampled whenever the car is driving, or while scripts/capture.py collects training data
+    err = color_stream_start();
+    if (err != ESP_OK) {
+        return err;
+    }
+    // tiles are detected on that stream
+    err = tile_trigger_start();
+    if (err != ESP_OK) {
+        return err;
+    }
+    // venue calibration and sensor settings from NVS
+    return calibration_init();
+}
+
+// ADC sampling of the battery voltage
+static esp_err_t battery_stage(void)
+{
+    return battery_init();
+}
+
+void app_main(void)
+{
+    // DFS and light sleep, before the peripherals below pick their clocks
+    if (power_init() != ESP_OK || shared_state_init() != ESP_OK || boot_init() != ESP_OK) {
+        return;
+    }
+    TRACE_INIT();
+    MEM_AUDIT_INIT();
+
+    // NVS holds the uploaded color model, the calibration and the game rules, every stage may read it
+    esp_err_t nvs_err = nvs_flash_init();
+    if (nvs_err == ESP_ERR_NVS_NO_FREE_PAGES || nvs_err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        nvs_err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(nvs_err);
+
+    // independent hardware bring-up, in parallel with the BLE stack below
+    if (boot_start_stage("motor", motor_stage, BOOT_MOTOR_READY) != ESP_OK ||
+        boot_start_stage("sensor", sensor_stage, BOOT_SENSOR_READY) != ESP_OK ||
+        boot_start_stage("battery", battery_stage, BOOT_BATTERY_READY) != ESP_OK) {
+        return;
+    }
 
+    // binary control protocol, needs to exist before the first BLE write
+    if (control_protocol_init() != ESP_OK) {
+        return;
+    }
 
     // BLE Setup -------------------
+    // the host syncs in the background, sync_cb holds advertising back until the control path is live
+    if (gap_init() != ESP_OK || race_broadcast_init() != ESP_OK || telemetry_init() != ESP_OK ||
+        capture_init() != ESP_OK || ota_init() != ESP_OK) {
+        return;
+    }
     nimble_port_init();
     ble_hs_cfg.sync_cb = sync_cb;
     ble_hs_cfg.reset_cb = reset_cb;
@@ -141,36 +172,30 @@ void app_main(void)
     ble_svc_gap_device_name_set(device_name);
     nimble_port_freertos_init(host_task);
 
-    // Initialize the motor controller
-    controller_init();
-
-    esp_err_t ret = battery_init();
-    if (ret != ESP_OK) {
-        ESP_LOGE("main", "Battery initialization failed");
+    // Initialize the motor controller, it feeds the motor queue
+    if (boot_wait(BOOT_MOTOR_READY, BOOT_STAGE_TIMEOUT_MS) != BOOT_MOTOR_READY) {
+        ESP_LOGE("main", "Motors not ready, not advertising");
         return;
     }
+    controller_init();
+    boot_set_ready(BOOT_CONTROL_READY);
+    if (boot_is_ready(BOOT_BLE_SYNCED)) {
+        gap_start();
+    }
 
+    // came up far enough to take the next update, keep this image
+    ota_confirm_image();
 
-    initialize_neural_network(&nn);
-
-    // initilize interrupt for HAL
-    configure_gpio_interrupt();
-    gpio_intr_evt_queue = gpio_interrupt_get_evt_queue();
-    xTaskCreate(gpio_interrupt_task, "gpio_interrupt_task", 2048, NULL, 10, NULL);
-
-    // color sensor
-    opt4060_init();
-
-
-    while (1) {
-
-//        // uncomment this for training data collection
-//        uint16_t red, green, blue, clear;
-//        opt4060_read_color(&red, &green, &blue, &clear);
-//        // NOTE "Color: White" is hardcoded -- rename this to the color you are training for
-//        ESP_LOGI("main", "Color values - Red: %d, Green: %d, Blue: %d, Clear: %d, Color: Black", red, green, blue, clear);
-
-        vTaskDelay(100 / portTICK_PERIOD_MS);  // Delay
-
+    EventBits_t ready = boot_wait(BOOT_SENSOR_READY | BOOT_BATTERY_READY, BOOT_STAGE_TIMEOUT_MS);
+    if (!(ready & BOOT_SENSOR_READY)) {
+        ESP_LOGE("main", "Color sensor not ready, no tiles");
+    }
+    if (!(ready & BOOT_BATTERY_READY)) {
+        ESP_LOGE("main", "Battery initialization failed");
     }
+    // a command may have come in before the color stream existed
+    power_update();
+
+    // everything runs from tasks, timers and interrupts from here on; returning
+    // deletes the main task instead of waking it every 100 ms for nothing
 }
@@ -0,0 +1,82 @@
+#include "mem_audit.h"
+
+#if MEM_AUDIT_ENABLE
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include "battery.h"
+#include "capture.h"
+#include "color_stream.h"
+#include "controller.h"
+#include "motor.h"
+#include "telemetry.h"
+#include "tile_trigger.h"
+
+static const char *TAG = "mem_audit";
+
+// without the FreeRTOS trace facility there is no list of all tasks, so they are looked up by
+// name; one that is not running, like the boot stages once they are done, is left out
+static const struct {
+    const char *name;
+    uint32_t stack_size;    // bytes
+} tasks[] = {
+        {"motor_task",          MOTOR_TASK_STACK_SIZE},
+        {"controller_task",     CONTROLLER_TASK_STACK_SIZE},
+        {"color_stream_task",   COLOR_STREAM_TASK_STACK_SIZE},
+        {"tile_trigger_task",   TILE_TRIGGER_TASK_STACK_SIZE},
+        {"battery_task",        BATTERY_TASK_STACK_SIZE},
+        {"telemetry_task",      TELEMETRY_TASK_STACK_SIZE},
+        {"capture_task",        CAPTURE_TASK_STACK_SIZE},
+        {"nimble_host",         CONFIG_BT_NIMBLE_HOST_TASK_STACK_SIZE},
+        {"esp_timer",           CONFIG_ESP_TIMER_TASK_STACK_SIZE},
+        {CONFIG_FREERTOS_TIMER_SERVICE_TASK_NAME, CONFIG_FREERTOS_TIMER_TASK_STACK_DEPTH},
+        {"IDLE",                CONFIG_FREERTOS_IDLE_TASK_STACKSIZE},
+};
+
+static void report_timer_callback(void *arg)
+{
+    for (int i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++) {
+        TaskHandle_t handle = xTaskGetHandle(tasks[i].name);
+        if (handle == NULL) {
+            continue;
+        }
+        // the least free stack since the task started
+        uint32_t unused = uxTaskGetStackHighWaterMark(handle);
+        ESP_LOGI(TAG, "%-18s %5lu of %5lu bytes used, %lu left", tasks[i].name,
+                 tasks[i].stack_size - unused, tasks[i].stack_size, unused);
+    }
+
+    size_t free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+    ESP_LOGI(TAG, "heap %u free, %u lowest, %u largest block, %u%% fragmented",
+             (unsigned int)free, (unsigned int)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+             (unsigned int)largest, free ? (unsigned int)(100 - largest * 100 / free) : 0);
+
+    int mbufs = os_msys_count();
+    ESP_LOGI(TAG, "msys %d of %d mbufs in use", mbufs - os_msys_num_free(), mbufs);
+}
+
+void mem_audit_init(void)
+{
+    static esp_timer_handle_t report_timer;
+    const esp_timer_create_args_t timer_args = {
+            .callback = report_timer_callback,
+            .name = "mem_audit_report",
+    };
+
+    esp_err_t err = esp_timer_create(&timer_args, &report_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(report_timer, MEM_AUDIT_PERIOD_MS * 1000ULL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the memory audit report: %s", esp_err_to_name(err));
+    }
+}
+
+#endif // MEM_AUDIT_ENABLE
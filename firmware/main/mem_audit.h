@@ -0,0 +1,26 @@
+#ifndef MEM_AUDIT_H
+#define MEM_AUDIT_H
+
+// Memory budget audit, off by default; with MEM_AUDIT_ENABLE=0 MEM_AUDIT_INIT() expands to nothing.
+// Reports on the console every MEM_AUDIT_PERIOD_MS: the stack high water mark of every long lived
+// task against its stack size, the free heap with its low water mark and largest free block, and
+// the NimBLE msys mbufs in use. Stack sizes are in bytes, which is what ESP-IDF FreeRTOS counts in.
+#ifndef MEM_AUDIT_ENABLE
+#define MEM_AUDIT_ENABLE 0
+#endif
+
+#define MEM_AUDIT_PERIOD_MS 10000
+
+#if MEM_AUDIT_ENABLE
+
+void mem_audit_init(void);
+
+#define MEM_AUDIT_INIT()    mem_audit_init()
+
+#else
+
+#define MEM_AUDIT_INIT()    do {} while (0)
+
+#endif // MEM_AUDIT_ENABLE
+
+#endif // MEM_AUDIT_H
@@ -0,0 +1,186 @@
+#include "model_store.h"
+#include <string.h>
+#include <stdbool.h>
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "color_predictor.h"
+
+static const char *TAG = "ModelStore";
+
+#define MODEL_NVS_NAMESPACE     "model"
+#define MODEL_NVS_KEY_HEADER    "header"
+#define MODEL_NVS_KEY_PAYLOAD   "payload"
+
+// two RAM slots: uploads always land in the one that is not in use, then the
+// predictor pointer is swapped over to it
+static NeuralNetwork model_slots[2];
+static int upload_slot = 0;
+
+static model_blob_header_t upload_header;
+static uint32_t upload_received = 0;
+
+static uint32_t active_version = 0;
+
+static esp_err_t check_header(const model_blob_header_t *header)
+{
+    if (header->magic != MODEL_BLOB_MAGIC) {
+        ESP_LOGE(TAG, "Bad model magic 0x%08lx", header->magic);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (header->format != MODEL_BLOB_FORMAT || header->quantized != COLOR_PREDICTOR_QUANTIZED) {
+        ESP_LOGE(TAG, "Model format %d (quantized %d) not supported", header->format, header->quantized);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (header->payload_size != sizeof(NeuralNetwork)) {
+        ESP_LOGE(TAG, "Model payload is %d bytes, expected %d", header->payload_size, (int)sizeof(NeuralNetwork));
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t check_payload(const model_blob_header_t *header, const NeuralNetwork *payload)
+{
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)payload, sizeof(NeuralNetwork));
+    if (crc != header->crc32) {
+        ESP_LOGE(TAG, "Model CRC mismatch: got 0x%08lx, expected 0x%08lx", crc, header->crc32);
+        return ESP_ERR_INVALID_CRC;
+    }
+#if COLOR_PREDICTOR_QUANTIZED
+    // the shifts feed straight into shift operations on the inference path, 0 is handled there
+    const uint8_t shifts[] = {payload->input_shift, payload->hidden1_shift, payload->hidden2_shift};
+    for (int i = 0; i < sizeof(shifts); i++) {
+        if (shifts[i] > NN_MAX_WEIGHT_SHIFT) {
+            ESP_LOGE(TAG, "Model layer %d shift %d above %d", i, shifts[i], NN_MAX_WEIGHT_SHIFT);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+#endif
+    return ESP_OK;
+}
+
+static void activate_slot(const model_blob_header_t *header, int slot)
+{
+    color_predictor_set_model(&model_slots[slot]);
+    active_version = header->version;
+    upload_slot = 1 - slot;
+    ESP_LOGI(TAG, "Model version %lu active", active_version);
+}
+
+static esp_err_t save_model(const model_blob_header_t *header, const NeuralNetwork *payload)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(MODEL_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_set_blob(handle, MODEL_NVS_KEY_PAYLOAD, payload, sizeof(NeuralNetwork));
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, MODEL_NVS_KEY_HEADER, header, sizeof(model_blob_header_t));
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t model_store_init(void)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(MODEL_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "No stored model, using built in model");
+        return ESP_OK;
+    }
+
+    model_blob_header_t header;
+    size_t header_len = sizeof(header);
+    size_t payload_len = sizeof(NeuralNetwork);
+    err = nvs_get_blob(handle, MODEL_NVS_KEY_HEADER, &header, &header_len);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(handle, MODEL_NVS_KEY_PAYLOAD, &model_slots[upload_slot], &payload_len);
+    }
+    nvs_close(handle);
+
+    if (err == ESP_OK && header_len == sizeof(header) && payload_len == sizeof(NeuralNetwork)) {
+        err = check_header(&header);
+        if (err == ESP_OK) {
+            err = check_payload(&header, &model_slots[upload_slot]);
+        }
+        if (err == ESP_OK) {
+            activate_slot(&header, upload_slot);
+            return ESP_OK;
+        }
+    }
+
+    ESP_LOGW(TAG, "Stored model unusable (%s), using built in model", esp_err_to_name(err));
+    return ESP_OK;
+}
+
+esp_err_t model_store_write(uint16_t offset, const uint8_t *data, uint16_t len)
+{
+    const uint32_t blob_size = sizeof(model_blob_header_t) + sizeof(NeuralNetwork);
+
+    if (offset == 0) {
+        upload_received = 0;
+    }
+
+    // chunks have to arrive in order, anything else restarts the upload from scratch
+    if (offset != upload_received || offset + len > blob_size) {
+        ESP_LOGE(TAG, "Unexpected model chunk at %d (%d bytes)", offset, len);
+        upload_received = 0;
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t *header_bytes = (uint8_t *)&upload_header;
+    uint8_t *payload_bytes = (uint8_t *)&model_slots[upload_slot];
+    for (uint16_t i = 0; i < len; i++) {
+        uint32_t pos = offset + i;
+        if (pos < sizeof(model_blob_header_t)) {
+            header_bytes[pos] = data[i];
+        } else {
+            payload_bytes[pos - sizeof(model_blob_header_t)] = data[i];
+        }
+    }
+
+    uint32_t previous = upload_received;
+    upload_received += len;
+
+    esp_err_t err;
+    // reject a bad model as soon as its header is in, before the payload is streamed
+    if (previous < sizeof(model_blob_header_t) && upload_received >= sizeof(model_blob_header_t)) {
+        err = check_header(&upload_header);
+        if (err != ESP_OK) {
+            upload_received = 0;
+            return err;
+        }
+    }
+
+    if (upload_received < blob_size) {
+        return ESP_OK;
+    }
+
+    upload_received = 0;
+
+    err = check_payload(&upload_header, &model_slots[upload_slot]);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = save_model(&upload_header, &model_slots[upload_slot]);
+    if (err != ESP_OK) {
+        // still usable until the next reboot
+        ESP_LOGE(TAG, "Failed to store model: %s", esp_err_to_name(err));
+    }
+
+    activate_slot(&upload_header, upload_slot);
+    return ESP_OK;
+}
+
+uint32_t model_store_active_version(void)
+{
+    return active_version;
+}
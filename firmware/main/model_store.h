@@ -0,0 +1,31 @@
+#ifndef MODEL_STORE_H
+#define MODEL_STORE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define MODEL_BLOB_MAGIC            0x4E4E4352  // "RCNN" little endian
+#define MODEL_BLOB_FORMAT           1          // bump when the blob layout changes
+
+// Header in front of every uploaded model, followed by payload_size bytes of NeuralNetwork
+typedef struct __attribute__((packed)) {
+    uint32_t magic;         // MODEL_BLOB_MAGIC
+    uint8_t format;         // MODEL_BLOB_FORMAT
+    uint8_t quantized;      // must match COLOR_PREDICTOR_QUANTIZED of this firmware
+    uint16_t payload_size;  // must match sizeof(NeuralNetwork)
+    uint32_t version;       // model version chosen by the trainer, 0 is the built in model
+    uint32_t crc32;         // CRC32 of the payload
+} model_blob_header_t;
+
+// Loads the last uploaded model from NVS, falls back to the built in model
+esp_err_t model_store_init(void);
+
+// Writes one chunk of a model blob (header + payload) at the given offset.
+// Writing at offset 0 starts a new upload. Once the last byte arrives the blob
+// is validated, persisted to NVS and swapped in.
+esp_err_t model_store_write(uint16_t offset, const uint8_t *data, uint16_t len);
+
+// Version of the model currently in use
+uint32_t model_store_active_version(void);
+
+#endif // MODEL_STORE_H
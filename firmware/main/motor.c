@@ -1,17 +1,38 @@
 #include "motor.h"
+#include "controller.h"
+#include "power.h"
+#include "trace.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
 
 
-QueueHandle_t motor_queue[2];
+QueueHandle_t motor_queue;
 SemaphoreHandle_t motor_start_semaphore;
 
+// ramp engine state, signed speeds in percent, positive is forward
+static int ramp_current[NUM_MOTORS] = {0};
+static int ramp_target[NUM_MOTORS] = {0};
+static bool ramp_running = false;
+static esp_timer_handle_t ramp_timer;
+static portMUX_TYPE ramp_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// last battery voltage from the battery monitor
+static atomic_uint supply_mv = MOTOR_REFERENCE_MV;
+// top speed in percent, lowered on a low battery
+static atomic_int speed_limit = 100;
+// last duty written per motor, negative is backward, for telemetry
+static int applied_duty[NUM_MOTORS] = {0};
+
 void configure_motor_pwm(int gpio, ledc_channel_t channel)
 {
     ledc_channel_config_t ledc_channel = {
             .speed_mode     = LEDC_LOW_SPEED_MODE,
             .channel        = channel,
-            .timer_sel      = LEDC_TIMER_0,
+            .timer_sel      = MOTOR_PWM_TIMER,
             .intr_type      = LEDC_INTR_DISABLE,
             .gpio_num       = gpio,
             .duty           = 0,
@@ -21,102 +42,317 @@ void configure_motor_pwm(int gpio, ledc_channel_t channel)
     if (err != ESP_OK) {
         ESP_LOGE("motor","LEDC Channel Config failed for GPIO %d: %s", gpio, esp_err_to_name(err));
     }
+
+    // keep driving the bridge inputs low in light sleep instead of floating them
+    gpio_sleep_sel_dis(gpio);
 }
 
-void set_motor_speed(int motor_index, int speed_percent, bool direction)
+esp_err_t motor_pwm_init(void)
 {
-    if (motor_index < 0 || motor_index >= NUM_MOTORS) {
-        ESP_LOGE("motor","Invalid motor index");
-        return;
+    ledc_timer_config_t ledc_timer = {
+            .speed_mode       = LEDC_LOW_SPEED_MODE,
+            .timer_num        = MOTOR_PWM_TIMER,
+            .duty_resolution  = LEDC_TIMER_10_BIT,
+            .freq_hz          = MOTOR_PWM_FREQ_HZ,
+            .clk_cfg          = LEDC_USE_XTAL_CLK  // unaffected by DFS, 32 MHz is plenty for 15 kHz at 10 bits
+    };
+    esp_err_t err = ledc_timer_config(&ledc_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE("motor", "LEDC Timer Config failed: %s", esp_err_to_name(err));
+        return err;
     }
 
-    // Ensure speed_percent is between MIN_SPEED_PERCENT and 100
-    speed_percent = (speed_percent < MIN_SPEED_PERCENT) ? 0 : (speed_percent > 100) ? 100 : speed_percent;
+    configure_motor_pwm(MOTOR_A_FWD_GPIO, LEDC_CHANNEL_0);
+    configure_motor_pwm(MOTOR_A_BWD_GPIO, LEDC_CHANNEL_1);
+    configure_motor_pwm(MOTOR_B_FWD_GPIO, LEDC_CHANNEL_2);
+    configure_motor_pwm(MOTOR_B_BWD_GPIO, LEDC_CHANNEL_3);
+    return ESP_OK;
+}
 
-    // Map MIN_SPEED_PERCENT-100 to MIN_DUTY-MAX_DUTY
-    int duty;
-    if (speed_percent == 0) {
-        duty = 0;
-    } else {
-        int min_duty = (MIN_SPEED_PERCENT * MAX_DUTY) / 100;
-        duty = min_duty + ((speed_percent - MIN_SPEED_PERCENT) * (MAX_DUTY - min_duty)) / (100 - MIN_SPEED_PERCENT);
+// Map MIN_SPEED_PERCENT-100 to MIN_DUTY-MAX_DUTY, anything below MIN_SPEED_PERCENT is off,
+// then scale for the battery voltage; above the reference voltage the top speeds keep some headroom,
+// below it they saturate at MAX_DUTY
+static int speed_to_duty(int speed_percent)
+{
+    if (speed_percent < MIN_SPEED_PERCENT) {
+        return 0;
+    }
+    if (speed_percent > 100) {
+        speed_percent = 100;
     }
 
+    int min_duty = (MIN_SPEED_PERCENT * MAX_DUTY) / 100;
+    int duty = min_duty + ((speed_percent - MIN_SPEED_PERCENT) * (MAX_DUTY - min_duty)) / (100 - MIN_SPEED_PERCENT);
+
+    duty = duty * MOTOR_REFERENCE_MV / atomic_load_explicit(&supply_mv, memory_order_relaxed);
+    return duty > MAX_DUTY ? MAX_DUTY : duty;
+}
+
+static void set_motor_duty(int motor_index, int duty, bool direction)
+{
     ledc_channel_t fwd_channel = (ledc_channel_t)(motor_index * 2);
     ledc_channel_t bwd_channel = (ledc_channel_t)(motor_index * 2 + 1);
 
     ledc_set_duty(LEDC_LOW_SPEED_MODE, fwd_channel, direction ? duty : 0);
     ledc_set_duty(LEDC_LOW_SPEED_MODE, bwd_channel, direction ? 0 : duty);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, fwd_channel);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, bwd_channel);
+    applied_duty[motor_index] = direction ? duty : -duty;
+}
+
+static void update_motor_duty(int motor_index)
+{
+    ledc_update_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)(motor_index * 2));
+    ledc_update_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)(motor_index * 2 + 1));
+}
+
+void set_motor_speed(int motor_index, int speed_percent, bool direction)
+{
+    if (motor_index < 0 || motor_index >= NUM_MOTORS) {
+        ESP_LOGE("motor","Invalid motor index");
+        return;
+    }
+
+    int duty = speed_to_duty(speed_percent);
+    set_motor_duty(motor_index, duty, direction);
+    update_motor_duty(motor_index);
+    TRACE_POINT(TRACE_MOTOR_DUTY);
 
     ESP_LOGD("motor","Motor %d set to speed %d%% (duty %d), direction %s",
            motor_index, speed_percent, duty, direction ? "FORWARD" : "BACKWARD");
 }
 
-void soft_start_motor(int motor_index, int target_speed, bool target_direction)
+void set_motor_speeds(const MotorPairUpdate *update)
 {
-    static int current_speed[NUM_MOTORS] = {0};
-    static bool current_direction[NUM_MOTORS] = {true, true};
+    // stage every channel first, then latch them back to back so both wheels
+    // switch on the same PWM period
+    for (int i = 0; i < NUM_MOTORS; i++) {
+        set_motor_duty(i, speed_to_duty(update->motor[i].speed_percent), update->motor[i].direction);
+    }
+    for (int i = 0; i < NUM_MOTORS; i++) {
+        update_motor_duty(i);
+    }
+    TRACE_POINT(TRACE_MOTOR_DUTY);
 
-    int start_speed = current_speed[motor_index];
-    bool start_direction = current_direction[motor_index];
+    ESP_LOGD("motor","Motors set to speed %d%% / %d%%, direction %d / %d",
+           update->motor[0].speed_percent, update->motor[1].speed_percent,
+           update->motor[0].direction, update->motor[1].direction);
+}
 
-    // If direction is changing, first slow down to 0
-    if (start_direction != target_direction && start_speed > 0) {
-        ESP_LOGD("motor","slow stopping motor %i", motor_index);
-        for (int speed = start_speed; speed >= MIN_SPEED_PERCENT; speed--) {
-            set_motor_speed(motor_index, speed, start_direction);
-            vTaskDelay(SOFT_START_DELAY_MS / portTICK_PERIOD_MS);
-        }
-        set_motor_speed(motor_index, 0, start_direction);
-        start_speed = 0;
-    }
-
-    // Now ramp up to target speed in the correct direction
-    if (target_speed > 0) {
-        ESP_LOGD("motor","ramping up motor %i", motor_index);
-        if (start_speed == 0) {
-            ESP_LOGD("motor","initial speed was 0 %i", motor_index);
-            set_motor_speed(motor_index, MIN_SPEED_PERCENT, target_direction);
-            vTaskDelay(SOFT_START_DELAY_MS * 2 / portTICK_PERIOD_MS);  // Longer delay for initial start
-            start_speed = MIN_SPEED_PERCENT;
-        }
+void motor_post_update(const MotorPairUpdate *update)
+{
+    // a pending update that was not applied yet is simply replaced
+    xQueueOverwrite(motor_queue, update);
+}
+
+// clamps a signed speed to the current speed limit
+static int limit_speed(int speed)
+{
+    int limit = atomic_load_explicit(&speed_limit, memory_order_relaxed);
+    return (speed > limit) ? limit : (speed < -limit) ? -limit : speed;
+}
+
+// signed speed in percent, positive is forward, with the dead band below MIN_SPEED_PERCENT folded to 0
+static int signed_speed(int speed_percent, bool direction)
+{
+    speed_percent = (speed_percent < MIN_SPEED_PERCENT) ? 0 : (speed_percent > 100) ? 100 : speed_percent;
+    return limit_speed(direction ? speed_percent : -speed_percent);
+}
 
-        int step = (target_speed > start_speed) ? 1 : -1;
-        for (int speed = start_speed; speed != target_speed; speed += step) {
-            set_motor_speed(motor_index, speed, target_direction);
-            vTaskDelay(SOFT_START_DELAY_MS / portTICK_PERIOD_MS);
+// one ramp tick from current towards target
+static int ramp_step(int current, int target)
+{
+    if (current == target) {
+        return current;
+    }
+    int next = (target > current) ? current + MOTOR_RAMP_STEP_PERCENT : current - MOTOR_RAMP_STEP_PERCENT;
+    if ((target > current && next > target) || (target < current && next < target)) {
+        next = target;
+    }
+
+    // a direction change always stops at 0 for one tick first
+    if ((current > 0 && next < 0) || (current < 0 && next > 0)) {
+        return 0;
+    }
+
+    // the motors do not move inside the dead band, step straight through it
+    if (next != 0 && abs(next) < MIN_SPEED_PERCENT) {
+        if (abs(next) > abs(current)) {
+            return (next > 0) ? MIN_SPEED_PERCENT : -MIN_SPEED_PERCENT;
         }
+        return 0;
+    }
+
+    return next;
+}
+
+static void ramp_timer_callback(void *arg)
+{
+    MotorPairUpdate update;
+    bool done = true;
+
+    portENTER_CRITICAL(&ramp_lock);
+    for (int i = 0; i < NUM_MOTORS; i++) {
+        ramp_current[i] = ramp_step(ramp_current[i], ramp_target[i]);
+        done = done && (ramp_current[i] == ramp_target[i]);
+
+        update.motor[i].motor_index = i;
+        update.motor[i].speed_percent = abs(ramp_current[i]);
+        update.motor[i].direction = ramp_current[i] >= 0;
+    }
+    // decided under the lock so a new target can never miss a running ramp
+    ramp_running = !done;
+    portEXIT_CRITICAL(&ramp_lock);
+
+    set_motor_speeds(&update);
+
+    // one shot timer re-armed per step, so nothing wakes up once the ramp is done
+    if (!done) {
+        esp_timer_start_once(ramp_timer, MOTOR_RAMP_PERIOD_MS * 1000);
     } else {
-        ESP_LOGD("motor","direct set on motor %i", motor_index);
-        set_motor_speed(motor_index, 0, target_direction);
+        // may have come to a stop, lets the chip sleep again
+        power_update();
+    }
+}
+
+esp_err_t motor_ramp_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+            .callback = ramp_timer_callback,
+            .name = "motor_ramp",
+    };
+
+    esp_err_t err = esp_timer_create(&timer_args, &ramp_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE("motor","Failed to create ramp timer: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+void motor_ramp_set_target(const MotorPairUpdate *update)
+{
+    bool start = false;
+
+    portENTER_CRITICAL(&ramp_lock);
+    for (int i = 0; i < NUM_MOTORS; i++) {
+        int index = update->motor[i].motor_index;
+        if (index >= 0 && index < NUM_MOTORS) {
+            ramp_target[index] = signed_speed(update->motor[i].speed_percent, update->motor[i].direction);
+        }
+    }
+    // a running ramp just heads for the new target from wherever it is now
+    if (!ramp_running) {
+        ramp_running = true;
+        start = true;
+    }
+    portEXIT_CRITICAL(&ramp_lock);
+
+    // wakes the PWM and sensor path before the first step
+    power_update();
+
+    if (start) {
+        esp_timer_start_once(ramp_timer, 0);
+    }
+}
+
+// runs one ramp step on the esp_timer task unless a ramp is already running; a step with
+// current == target just rewrites the duty, so this reapplies the feed-forward and limits
+static void ramp_kick(void)
+{
+    bool start = false;
+
+    portENTER_CRITICAL(&ramp_lock);
+    if (!ramp_running) {
+        ramp_running = true;
+        start = true;
+    }
+    portEXIT_CRITICAL(&ramp_lock);
+
+    if (start) {
+        esp_timer_start_once(ramp_timer, 0);
+    }
+}
+
+void motor_set_supply_voltage(uint32_t millivolts)
+{
+    if (millivolts == 0) {
+        return;
     }
+    atomic_store_explicit(&supply_mv, millivolts, memory_order_relaxed);
 
-    // Ensure we reach exactly the target speed
-    set_motor_speed(motor_index, target_speed, target_direction);
+    if (!motor_is_stopped()) {
+        ramp_kick();
+    }
+}
+
+void motor_set_speed_limit(int percent)
+{
+    percent = (percent > 100) ? 100 : (percent < 0) ? 0 : percent;
+    atomic_store_explicit(&speed_limit, percent, memory_order_relaxed);
+
+    portENTER_CRITICAL(&ramp_lock);
+    for (int i = 0; i < NUM_MOTORS; i++) {
+        ramp_target[i] = limit_speed(ramp_target[i]);
+    }
+    portEXIT_CRITICAL(&ramp_lock);
+
+    if (!motor_is_stopped()) {
+        ramp_kick();
+    }
+}
+
+void motor_get_state(int target[NUM_MOTORS], int duty[NUM_MOTORS])
+{
+    portENTER_CRITICAL(&ramp_lock);
+    for (int i = 0; i < NUM_MOTORS; i++) {
+        target[i] = ramp_target[i];
+        duty[i] = applied_duty[i];
+    }
+    portEXIT_CRITICAL(&ramp_lock);
+}
+
+bool motor_is_stopped(void)
+{
+    bool stopped = true;
 
-    // Update current speed and direction
-    current_speed[motor_index] = target_speed;
-    current_direction[motor_index] = target_direction;
-    ESP_LOGD("motor","done with motor %i", motor_index);
+    portENTER_CRITICAL(&ramp_lock);
+    for (int i = 0; i < NUM_MOTORS; i++) {
+        stopped = stopped && ramp_current[i] == 0 && ramp_target[i] == 0;
+    }
+    portEXIT_CRITICAL(&ramp_lock);
 
+    return stopped;
+}
+
+void soft_start_motor(int motor_index, int target_speed, bool target_direction)
+{
+    MotorPairUpdate update;
+
+    if (motor_index < 0 || motor_index >= NUM_MOTORS) {
+        ESP_LOGE("motor","Invalid motor index");
+        return;
+    }
+
+    // keep the other motor heading where it already is
+    portENTER_CRITICAL(&ramp_lock);
+    for (int i = 0; i < NUM_MOTORS; i++) {
+        update.motor[i].motor_index = i;
+        update.motor[i].speed_percent = abs(ramp_target[i]);
+        update.motor[i].direction = ramp_target[i] >= 0;
+    }
+    portEXIT_CRITICAL(&ramp_lock);
+
+    update.motor[motor_index].speed_percent = target_speed;
+    update.motor[motor_index].direction = target_direction;
+    motor_ramp_set_target(&update);
 }
 
 void motor_task(void *pvParameters)
 {
-    int motor_index = (int)pvParameters;
-    MotorUpdate update;
+    MotorPairUpdate update;
     while (1) {
-        if (xQueueReceive(motor_queue[0], &update, pdMS_TO_TICKS(10)) == pdTRUE) {
-            ESP_LOGI("Motor", "motor index %i speed %i direction %i", update.motor_index, update.speed_percent,
-                     update.direction);
-            set_motor_speed(update.motor_index, update.speed_percent, update.direction);
-        }
-        if (xQueueReceive(motor_queue[1], &update, pdMS_TO_TICKS(10)) == pdTRUE) {
-            ESP_LOGI("Motor", "motor index %i speed %i direction %i", update.motor_index, update.speed_percent,
-                     update.direction);
-            set_motor_speed(update.motor_index, update.speed_percent, update.direction);
+        if (xQueueReceive(motor_queue, &update, portMAX_DELAY) == pdTRUE) {
+            COMMAND_LOGI("Motor", "speed %i / %i direction %i / %i", update.motor[0].speed_percent,
+                         update.motor[1].speed_percent, update.motor[0].direction, update.motor[1].direction);
+            motor_ramp_set_target(&update);
         }
     }
-}
\ No newline at end of file
+}
@@ -8,10 +8,22 @@
 #include "driver/ledc.h"
 
 #define NUM_MOTORS              2
+#define MOTOR_TASK_PRIORITY     1
+#define MOTOR_TASK_STACK_SIZE   2048    // bytes
+
+// H bridge inputs, one LEDC channel each: motor n drives forward on channel 2n, backward on 2n + 1
+#define MOTOR_A_FWD_GPIO        13
+#define MOTOR_A_BWD_GPIO        14
+#define MOTOR_B_FWD_GPIO        4
+#define MOTOR_B_BWD_GPIO        5
+#define MOTOR_PWM_TIMER         LEDC_TIMER_0
+#define MOTOR_PWM_FREQ_HZ       15000
 #define MIN_SPEED_PERCENT       15  // Minimum speed percentage
 #define MAX_DUTY                ((1 << LEDC_TIMER_10_BIT) - 1)  // Max duty cycle for 10-bit resolution
-#define MOTOR_QUEUE_SIZE        10
-#define SOFT_START_DELAY_MS     30  // Adjust this value to change the softness of the start
+#define MOTOR_QUEUE_SIZE        1   // mailbox: only the newest update for both wheels is kept
+#define MOTOR_RAMP_PERIOD_MS    10  // ramp engine tick
+#define MOTOR_RAMP_STEP_PERCENT 5   // speed change per tick, adjust this to change the softness of the start
+#define MOTOR_REFERENCE_MV      3500  // speed percentages are duty percentages at this battery voltage
 
 // Motor speed update structure
 typedef struct {
@@ -20,12 +32,34 @@ typedef struct {
     bool direction;
 } MotorUpdate;
 
+// Updates for both wheels, applied together by the motor task
+typedef struct {
+    MotorUpdate motor[NUM_MOTORS];
+} MotorPairUpdate;
+
+// Sets up the PWM timer and the four bridge channels, all outputs low
+esp_err_t motor_pwm_init(void);
 void configure_motor_pwm(int gpio, ledc_channel_t channel);
 void set_motor_speed(int motor_index, int speed_percent, bool direction);
+void set_motor_speeds(const MotorPairUpdate *update);
+void motor_post_update(const MotorPairUpdate *update);
+// Non-blocking ramp engine: both motors step towards their targets on a timer.
+// A new target mid-ramp simply retargets it, direction changes pass through 0.
+esp_err_t motor_ramp_init(void);
+void motor_ramp_set_target(const MotorPairUpdate *update);
+// Battery feed-forward: the duty is scaled by MOTOR_REFERENCE_MV / millivolts, so a speed
+// gives about the same wheel speed on a full and on a low battery. Reapplies the running duty.
+void motor_set_supply_voltage(uint32_t millivolts);
+// Caps every target speed, running motors ramp down to it
+void motor_set_speed_limit(int percent);
+// Signed target speed in percent and signed applied LEDC duty per motor, positive is forward
+void motor_get_state(int target[NUM_MOTORS], int duty[NUM_MOTORS]);
+// True when both motors stand still and have nowhere to go
+bool motor_is_stopped(void);
 void soft_start_motor(int motor_index, int target_speed, bool target_direction);
 void motor_task(void *pvParameters);
 
-extern QueueHandle_t motor_queue[2];
+extern QueueHandle_t motor_queue;
 extern SemaphoreHandle_t motor_start_semaphore;
 
 #endif // MOTOR_H
@@ -1,185 +1,134 @@
 #include "opt4060.h"
-#include "driver/i2c.h"
+#include "i2c_config.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 
-// math
-#include <stdio.h>
-#include <math.h>
-
 static const char *TAG = "OPT4060";
 
-static esp_err_t i2c_master_init(void)
+static i2c_master_dev_handle_t opt4060_handle;
+static SemaphoreHandle_t read_done_semaphore;
+static StaticSemaphore_t read_done_semaphore_buffer;
+
+// color registers 0x00 - 0x07, read in one burst
+static uint8_t color_register = OPT4060_REG_COLOR;
+static uint8_t color_data[16];
+// how the last transfer ended, a NACK or timeout gives the semaphore too
+static volatile i2c_master_event_t last_event = I2C_EVENT_DONE;
+
+static bool IRAM_ATTR opt4060_read_done(i2c_master_dev_handle_t i2c_dev,
+                                        const i2c_master_event_data_t *evt_data, void *arg)
 {
-    i2c_config_t conf = {
-            .mode = I2C_MODE_MASTER,
-            .sda_io_num = I2C_MASTER_SDA_IO,
-            .scl_io_num = I2C_MASTER_SCL_IO,
-            .sda_pullup_en = GPIO_PULLUP_ENABLE,
-            .scl_pullup_en = GPIO_PULLUP_ENABLE,
-            .master.clk_speed = I2C_MASTER_FREQ_HZ,
-    };
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    last_event = evt_data->event;
+    xSemaphoreGiveFromISR(read_done_semaphore, &higher_priority_task_woken);
+    return higher_priority_task_woken == pdTRUE;
+}
 
-    esp_err_t err = i2c_param_config(I2C_MASTER_NUM, &conf);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "I2C parameter configuration failed: %s", esp_err_to_name(err));
-        return err;
+// adds the sensor to the bus and routes its transfer done events to read_done_semaphore
+static esp_err_t attach(uint32_t scl_speed_hz)
+{
+    esp_err_t ret = i2c_config_add_device_at(OPT4060_SENSOR_ADDR, scl_speed_hz, &opt4060_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize I2C: %s", esp_err_to_name(ret));
+        return ret;
     }
 
-    err = i2c_driver_install(I2C_MASTER_NUM, conf.mode, 0, 0, 0);
-    if (err != ESP_OK) {
-        if (err == ESP_ERR_INVALID_STATE) {
-            ESP_LOGW(TAG, "I2C driver already installed, attempting to use existing installation");
-            return ESP_OK;
-        }
-        ESP_LOGE(TAG, "I2C driver installation failed: %s", esp_err_to_name(err));
-        return err;
+    i2c_master_event_callbacks_t callbacks = {
+            .on_trans_done = opt4060_read_done,
+    };
+    ret = i2c_master_register_event_callbacks(opt4060_handle, &callbacks, NULL);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register I2C callbacks: %s", esp_err_to_name(ret));
     }
-
-    return ESP_OK;
+    return ret;
 }
 
 esp_err_t opt4060_init(void)
 {
-    esp_err_t ret = i2c_master_init();
+    read_done_semaphore = xSemaphoreCreateBinaryStatic(&read_done_semaphore_buffer);
+
+    esp_err_t ret = attach(I2C_MASTER_FREQ_HZ);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize I2C: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    // set the chip to continuous conversion at 1ms
-    // 0x30, 0x78 - write to 0x0A
-    uint8_t write_data[3] = {0x0A, 0x30, 0x78};
-    ret = i2c_master_write_to_device(I2C_MASTER_NUM, OPT4060_SENSOR_ADDR, write_data,
-                               3, pdMS_TO_TICKS(1000));
-
+    ret = opt4060_configure(OPT4060_RANGE_AUTO, OPT4060_CONVERSION_1MS);
     if (ret == ESP_OK)
         ESP_LOGI(TAG, "OPT4060 initialized successfully");
     else
         ESP_LOGE(TAG, "failed to init OPT4060");
 
-    return ESP_OK;
+    return ret;
 }
 
-void determineColor(uint16_t red, uint16_t green, uint16_t blue, uint16_t clear) {
-//    // Normalize the values
-//    float r = (float)red / clear;
-//    float g = (float)green / clear;
-//    float b = (float)blue / clear;
-//
-//    // Define color thresholds
-//    float threshold = 0.2;
-//    float white_threshold = 0.9;
-//    float black_threshold = 0.1;
-//
-//    // Determine the color
-//    if (r < black_threshold && g < black_threshold && b < black_threshold) {
-//        printf("Black\n");
-//    } else if (r > white_threshold && g > white_threshold && b > white_threshold) {
-//        printf("White\n");
-//    } else if (r > threshold && r > g && r > b) {
-//        printf("Red\n");
-//    } else if (g > threshold && g > r && g > b) {
-//        printf("Green\n");
-//    } else if (b > threshold && b > r && b > g) {
-//        printf("Blue\n");
-//    } else if (r > threshold && g > threshold && r > b && g > b) {
-//        printf("Yellow\n");
-//    } else if (r > threshold && b > threshold && r > g && b > g) {
-//        printf("Magenta\n");
-//    } else if (g > threshold && b > threshold && g > r && b > r) {
-//        printf("Cyan\n");
-//    } else {
-//        printf("Unknown\n");
-//    }
-
-    // Define thresholds based on the provided examples
-    const uint16_t GREEN_THRESHOLD = 1000;
-    const uint16_t BLACK_THRESHOLD = 300;
-    const uint16_t WHITE_THRESHOLD = 1000;
-    const uint16_t CLEAR_THRESHOLD = 3000;
-
-    // Calculate ratios for more accurate color detection
-    float red_ratio = (float)red / (red + green + blue);
-    float green_ratio = (float)green / (red + green + blue);
-    float blue_ratio = (float)blue / (red + green + blue);
-
-    // Check for green
-    if (green > GREEN_THRESHOLD && green_ratio > 0.4) {
-        ESP_LOGW("opt4060", "Green");
-    }
-        // Check for black
-    else if (red < BLACK_THRESHOLD && green < BLACK_THRESHOLD && blue < BLACK_THRESHOLD) {
-        ESP_LOGW("opt4060", "Black");
-    }
-        // Check for white
-    else if (red > WHITE_THRESHOLD && green > WHITE_THRESHOLD && blue > WHITE_THRESHOLD && clear > CLEAR_THRESHOLD) {
-        ESP_LOGW("opt4060", "White");
-    }
-        // Check for red
-    else if (red_ratio > 0.35 && red > green && red > blue) {
-        ESP_LOGW("opt4060", "Red");
-    }
-        // Check for blue
-    else if (blue_ratio > 0.35 && blue > red && blue > green) {
-        ESP_LOGW("opt4060", "Blue");
-    }
-        // If no specific color is detected
-    else {
-        ESP_LOGW("opt4060", "Unknown");
+esp_err_t opt4060_configure(uint8_t range, uint8_t conversion_time)
+{
+    if ((range > OPT4060_RANGE_MAX && range != OPT4060_RANGE_AUTO) || conversion_time > OPT4060_CONVERSION_MAX) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-}
+    // continuous conversion, latched interrupts: auto range at 1 ms is 0x30, 0x78
+    uint16_t config = (range << 10) | (conversion_time << 6) | (3 << 4) | (1 << 3);
+    uint8_t write_data[3] = {OPT4060_REG_CONFIG, config >> 8, config & 0xFF};
 
-void classify_color(double X, double Y, double Z, double LUX) {
-    // Convert XYZ to RGB
-    double R = 3.2404542 * X - 1.5371385 * Y - 0.4985314 * Z;
-    double G = -0.9692660 * X + 1.8760108 * Y + 0.0415560 * Z;
-    double B = 0.0556434 * X - 0.2040259 * Y + 1.0572252 * Z;
-
-    // Normalize RGB values
-    R = fmax(0, fmin(1, R));
-    G = fmax(0, fmin(1, G));
-    B = fmax(0, fmin(1, B));
-
-    // Define thresholds
-    const double COLOR_THRESHOLD = 0.5;
-    const double BLACK_THRESHOLD = 0.1;
-    const double WHITE_THRESHOLD = 0.9;
-
-    // Check for black and white first
-    if (LUX < BLACK_THRESHOLD) {
-        ESP_LOGW(TAG, "Classified color: Black");
-    } else if (LUX > WHITE_THRESHOLD && R > WHITE_THRESHOLD && G > WHITE_THRESHOLD && B > WHITE_THRESHOLD) {
-        ESP_LOGW(TAG, "Classified color: White");
+    esp_err_t ret = i2c_master_transmit(opt4060_handle, write_data, sizeof(write_data), I2C_MASTER_TIMEOUT_MS);
+    if (ret == ESP_OK) {
+        ret = i2c_config_wait_all_done();
     }
-        // Classify based on dominant color
-    else if (R > COLOR_THRESHOLD && R > G && R > B) {
-        ESP_LOGW(TAG, "Classified color: Red");
-    } else if (G > COLOR_THRESHOLD && G > R && G > B) {
-        ESP_LOGW(TAG, "Classified color: Green");
-    } else if (B > COLOR_THRESHOLD && B > R && B > G) {
-        ESP_LOGW(TAG, "Classified color: Blue");
+    // the write completing also gave the semaphore, the next read must not see it; waiting for
+    // the bus does not report a NACK, the event does
+    bool done = xSemaphoreTake(read_done_semaphore, 0) == pdTRUE && last_event == I2C_EVENT_DONE;
+    if (ret == ESP_OK && !done) {
+        ret = ESP_FAIL;
     }
-        // Default case
-    else {
-        ESP_LOGW(TAG, "Classified color: Unclassified");
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure: %s", esp_err_to_name(ret));
     }
+    return ret;
 }
 
-esp_err_t opt4060_read_color(uint16_t *red, uint16_t *green, uint16_t *blue, uint16_t *clear)
+uint32_t opt4060_conversion_time_us(uint8_t conversion_time)
 {
+    static const uint32_t conversion_us[OPT4060_CONVERSION_MAX + 1] = {600, 1000, 1800, 3400, 6500, 12700};
 
-    uint8_t data[16];
-    esp_err_t ret;
-
-    uint8_t address[1] = {0};
+    return conversion_time <= OPT4060_CONVERSION_MAX ? conversion_us[conversion_time] : 0;
+}
 
-    ret = i2c_master_write_read_device(I2C_MASTER_NUM, OPT4060_SENSOR_ADDR, address, 1, data,
-                                 16, pdMS_TO_TICKS(1000));
+esp_err_t opt4060_set_bus_speed(uint32_t scl_speed_hz)
+{
+    esp_err_t ret = i2c_master_bus_rm_device(opt4060_handle);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read color data: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Failed to detach: %s", esp_err_to_name(ret));
         return ret;
     }
+    return attach(scl_speed_hz);
+}
+
+esp_err_t opt4060_read_color_start(void)
+{
+    esp_err_t ret = i2c_master_transmit_receive(opt4060_handle, &color_register, 1, color_data,
+                                                sizeof(color_data), I2C_MASTER_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start color read: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t opt4060_read_color_finish(uint16_t *red, uint16_t *green, uint16_t *blue, uint16_t *clear,
+                                    TickType_t timeout)
+{
+    if (xSemaphoreTake(read_done_semaphore, timeout) != pdTRUE) {
+        ESP_LOGE(TAG, "Color read timed out");
+        return ESP_ERR_TIMEOUT;
+    }
+    if (last_event != I2C_EVENT_DONE) {
+        // color_data still holds the previous sample
+        ESP_LOGE(TAG, "Color read failed, I2C event %d", last_event);
+        return ESP_FAIL;
+    }
+
+    uint8_t *data = color_data;
 
     // Convert the read data to color values
 //    *red = (data[1] << 8) | data[0];
@@ -192,9 +141,15 @@ esp_err_t opt4060_read_color(uint16_t *red, uint16_t *green, uint16_t *blue, uin
     *blue =  ((data[8] & 0xF) << 8) | data[9];
     *clear =  ((data[12] & 0xF) << 8) | data[13];
 
+    return ESP_OK;
+}
 
+esp_err_t opt4060_read_color(uint16_t *red, uint16_t *green, uint16_t *blue, uint16_t *clear)
+{
+    esp_err_t ret = opt4060_read_color_start();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-
-
-    return ESP_OK;
+    return opt4060_read_color_finish(red, green, blue, clear, pdMS_TO_TICKS(I2C_MASTER_TIMEOUT_MS));
 }
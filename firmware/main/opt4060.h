@@ -3,18 +3,33 @@
 
 #include <stdint.h>
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
 
-#define I2C_MASTER_SCL_IO           0      // GPIO number for I2C master clock
-#define I2C_MASTER_SDA_IO           1      // GPIO number for I2C master data
-#define I2C_MASTER_NUM              0      // I2C master i2c port number
-#define I2C_MASTER_FREQ_HZ          100000 // I2C master clock frequency
 #define OPT4060_SENSOR_ADDR         0x44   // OPT4060 I2C address (1000100 in binary)
 
 #define OPT4060_REG_COLOR           0x00   // Register address for color data
+#define OPT4060_REG_CONFIG          0x0A
+
+// full scale range, 0-8 double it each step, auto range picks one per conversion
+#define OPT4060_RANGE_MAX           8
+#define OPT4060_RANGE_AUTO          12
+// conversion time per result, 0: 600 us, 1: 1 ms, 2: 1.8 ms, 3: 3.4 ms, 4: 6.5 ms, 5: 12.7 ms.
+// The chip goes up to 800 ms, beyond 5 a tile passes by within one result.
+#define OPT4060_CONVERSION_1MS      1
+#define OPT4060_CONVERSION_MAX      5
 
 esp_err_t opt4060_init(void);
-void determineColor(uint16_t red, uint16_t green, uint16_t blue, uint16_t clear);
-void classify_color(double X, double Y, double Z, double LUX);
+// Continuous conversion at a range and conversion time, no read may be in flight
+esp_err_t opt4060_configure(uint8_t range, uint8_t conversion_time);
+// Microseconds per result at a conversion time setting, 0 if out of range
+uint32_t opt4060_conversion_time_us(uint8_t conversion_time);
+// Re-attaches the sensor at another SCL clock, no read may be in flight. For benchmarks.
+esp_err_t opt4060_set_bus_speed(uint32_t scl_speed_hz);
 esp_err_t opt4060_read_color(uint16_t *red, uint16_t *green, uint16_t *blue, uint16_t *clear);
 
+// Asynchronous read: start queues the transfer and returns, finish sleeps until it is done
+esp_err_t opt4060_read_color_start(void);
+esp_err_t opt4060_read_color_finish(uint16_t *red, uint16_t *green, uint16_t *blue, uint16_t *clear,
+                                    TickType_t timeout);
+
 #endif // OPT4060_H
@@ -0,0 +1,199 @@
+#include "ota.h"
+#include <string.h>
+#include <stdbool.h>
+#include "esp_ota_ops.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "gatt_svr.h"
+#include "motor.h"
+
+static const char *TAG = "ota";
+
+// All of this is only touched from GATT callbacks, which all run in the BLE host task
+static esp_ota_handle_t update_handle;
+static bool in_progress = false;
+static ota_request_t request;
+static uint32_t received;
+static uint32_t crc;
+static ota_status_t status = {.status = SVR_CHR_OTA_CONTROL_NOP};
+
+static esp_timer_handle_t reboot_timer;
+
+static void reboot_timer_callback(void *arg)
+{
+    esp_restart();
+}
+
+static void answer(uint16_t conn_handle, svr_chr_ota_control_val_t code)
+{
+    status.status = code;
+    status.offset = received;
+    status.size = in_progress ? request.size : 0;
+
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(&status, sizeof(status));
+    if (om == NULL) {
+        // the client times out and asks again with a new request
+        return;
+    }
+    ble_gatts_notify_custom(conn_handle, ota_control_val_handle, om);
+}
+
+static void abort_update(void)
+{
+    if (in_progress) {
+        esp_ota_abort(update_handle);
+        in_progress = false;
+    }
+    received = 0;
+}
+
+static svr_chr_ota_control_val_t start(const ota_request_t *new_request)
+{
+    if (!motor_is_stopped()) {
+        ESP_LOGW(TAG, "Refusing an update while driving");
+        return SVR_CHR_OTA_CONTROL_REQUEST_NAK;
+    }
+    if (in_progress && new_request->size == request.size && new_request->crc32 == request.crc32) {
+        ESP_LOGI(TAG, "Resuming at %lu of %lu bytes", received, request.size);
+        return SVR_CHR_OTA_CONTROL_REQUEST_ACK;
+    }
+    abort_update();
+
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (partition == NULL || new_request->size == 0 || new_request->size > partition->size) {
+        ESP_LOGE(TAG, "No room for a %lu byte image", new_request->size);
+        return SVR_CHR_OTA_CONTROL_REQUEST_NAK;
+    }
+
+    // sequential writes erase sector by sector as the image comes in, instead of the whole
+    // partition up front while the host task is blocked
+    esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to begin the update: %s", esp_err_to_name(err));
+        return SVR_CHR_OTA_CONTROL_REQUEST_NAK;
+    }
+
+    request = *new_request;
+    received = 0;
+    crc = 0;
+    in_progress = true;
+    ESP_LOGI(TAG, "Receiving %lu bytes into %s", request.size, partition->label);
+    return SVR_CHR_OTA_CONTROL_REQUEST_ACK;
+}
+
+static svr_chr_ota_control_val_t finish(void)
+{
+    if (!in_progress || received != request.size) {
+        return SVR_CHR_OTA_CONTROL_DONE_NAK;
+    }
+    if (crc != request.crc32) {
+        ESP_LOGE(TAG, "Image crc %08lx, expected %08lx", crc, request.crc32);
+        abort_update();
+        return SVR_CHR_OTA_CONTROL_DONE_NAK;
+    }
+
+    // checks the image, and frees the handle either way
+    in_progress = false;
+    esp_err_t err = esp_ota_end(update_handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(esp_ota_get_next_update_partition(NULL));
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Image not accepted: %s", esp_err_to_name(err));
+        received = 0;
+        return SVR_CHR_OTA_CONTROL_DONE_NAK;
+    }
+
+    ESP_LOGI(TAG, "Update complete, rebooting");
+    esp_timer_start_once(reboot_timer, REBOOT_DEEP_SLEEP_TIMEOUT * 1000);
+    return SVR_CHR_OTA_CONTROL_DONE_ACK;
+}
+
+esp_err_t ota_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+            .callback = reboot_timer_callback,
+            .name = "ota_reboot",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &reboot_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create reboot timer: %s", esp_err_to_name(err));
+        return err;
+    }
+    return ESP_OK;
+}
+
+void ota_confirm_image(void)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+
+    if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        esp_ota_mark_app_valid_cancel_rollback();
+        ESP_LOGI(TAG, "Confirmed the update in %s", running->label);
+    }
+}
+
+void ota_control_receive(uint16_t conn_handle, const uint8_t *data, uint16_t len)
+{
+    ota_request_t new_request;
+    svr_chr_ota_control_val_t result;
+
+    switch (data[0]) {
+        case SVR_CHR_OTA_CONTROL_REQUEST:
+            if (len != 1 + sizeof(new_request)) {
+                result = SVR_CHR_OTA_CONTROL_REQUEST_NAK;
+                break;
+            }
+            memcpy(&new_request, data + 1, sizeof(new_request));
+            result = start(&new_request);
+            break;
+
+        case SVR_CHR_OTA_CONTROL_DONE:
+            result = finish();
+            break;
+
+        default:
+            return;
+    }
+    answer(conn_handle, result);
+}
+
+void ota_data_receive(uint16_t conn_handle, const uint8_t *data, uint16_t len)
+{
+    ota_chunk_header_t header;
+
+    if (!in_progress || len <= sizeof(header)) {
+        answer(conn_handle, SVR_CHR_OTA_CONTROL_DATA_NAK);
+        return;
+    }
+    memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+    len -= sizeof(header);
+
+    // a chunk after a lost one, or one the client repeats after a reconnect
+    if (header.offset != received || received + len > request.size) {
+        answer(conn_handle, SVR_CHR_OTA_CONTROL_DATA_NAK);
+        return;
+    }
+
+    esp_err_t err = esp_ota_write(update_handle, data, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Write at %lu failed: %s", received, esp_err_to_name(err));
+        abort_update();
+        answer(conn_handle, SVR_CHR_OTA_CONTROL_DATA_NAK);
+        return;
+    }
+    crc = esp_rom_crc32_le(crc, data, len);
+    received += len;
+    answer(conn_handle, SVR_CHR_OTA_CONTROL_DATA_ACK);
+}
+
+void ota_get_status(ota_status_t *out)
+{
+    *out = status;
+    out->offset = received;
+    out->size = in_progress ? request.size : 0;
+}
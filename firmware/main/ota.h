@@ -0,0 +1,51 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Firmware update over BLE into the OTA partition that is not running, see partitions.csv.
+// All fields are little endian.
+//
+// OTA Control, write:
+//   SVR_CHR_OTA_CONTROL_REQUEST, ota_request_t   starts an update, or resumes the one in progress if
+//                                                size and crc match; the car has to stand still
+//   SVR_CHR_OTA_CONTROL_DONE                     checks the image and boots it REBOOT_DEEP_SLEEP_TIMEOUT ms later
+// OTA Data, write without response: ota_chunk_header_t, then the image bytes from that offset
+// OTA Control, read / notification: ota_status_t, notified for every request, chunk and done
+//
+// Chunks go straight into esp_ota_write as they arrive, nothing is buffered. One that does not
+// start at the next expected offset is not written and answered with DATA_NAK and that offset,
+// the client goes back to it. A disconnect keeps the update open, a new request for the same image
+// gets REQUEST_ACK with the offset to continue from.
+
+typedef struct __attribute__((packed)) {
+    uint32_t size;          // image size in bytes
+    uint32_t crc32;         // esp_rom_crc32_le(0, image, size), tells a resumed update from a new one
+} ota_request_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t offset;
+} ota_chunk_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t status;         // svr_chr_ota_control_val_t of the last answer
+    uint32_t offset;        // bytes written, the next chunk has to start here
+    uint32_t size;          // of the image being received, 0 when idle
+} ota_status_t;
+
+esp_err_t ota_init(void);
+
+// Confirms the running image once the car has come up, so the bootloader does not roll back
+// to the previous one on the next reset. Nothing to do unless this is the first boot after an update.
+void ota_confirm_image(void);
+
+// OTA Control write, answers with a notification to conn_handle
+void ota_control_receive(uint16_t conn_handle, const uint8_t *data, uint16_t len);
+
+// OTA Data write, answers with a notification to conn_handle
+void ota_data_receive(uint16_t conn_handle, const uint8_t *data, uint16_t len);
+
+void ota_get_status(ota_status_t *status);
+
+#endif // OTA_H
@@ -0,0 +1,113 @@
+#include "power.h"
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+#include "motor.h"
+#include "color_stream.h"
+#include "battery.h"
+#include "race_broadcast.h"
+
+static const char *TAG = "power";
+
+// serializes power_update callers, each applies the motor state it reads under it,
+// so whichever runs last leaves the locks matching the newest motor state
+static SemaphoreHandle_t power_mutex;
+static StaticSemaphore_t power_mutex_buffer;
+static bool driving = false;
+static bool capturing = false;
+static bool calibrating = false;
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t no_sleep_lock;
+static esp_pm_lock_handle_t cpu_max_lock;
+#endif
+
+esp_err_t power_init(void)
+{
+    power_mutex = xSemaphoreCreateMutexStatic(&power_mutex_buffer);
+
+#if CONFIG_PM_ENABLE
+    const esp_pm_config_t pm_config = {
+            .max_freq_mhz = POWER_MAX_CPU_FREQ_MHZ,
+            .min_freq_mhz = POWER_MIN_CPU_FREQ_MHZ,
+            .light_sleep_enable = true,
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "driving", &no_sleep_lock);
+    if (err == ESP_OK) {
+        err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "driving_cpu", &cpu_max_lock);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create power locks: %s", esp_err_to_name(err));
+        return err;
+    }
+#endif
+
+    return ESP_OK;
+}
+
+void power_update(void)
+{
+    if (power_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(power_mutex, portMAX_DELAY);
+
+    bool now = !motor_is_stopped();
+    if (now != driving) {
+        driving = now;
+#if CONFIG_PM_ENABLE
+        if (driving) {
+            esp_pm_lock_acquire(no_sleep_lock);
+            esp_pm_lock_acquire(cpu_max_lock);
+        } else {
+            esp_pm_lock_release(cpu_max_lock);
+            esp_pm_lock_release(no_sleep_lock);
+        }
+#endif
+        // tiles only matter while the car moves, the 1 kHz sampling is the biggest wakeup source
+        color_stream_set_active(driving || capturing || calibrating);
+        // follow the voltage sag under load for the motor feed-forward
+        battery_set_driving(driving);
+        // the race director can wait, a wide scan window keeps the radio and the chip awake
+        race_broadcast_set_driving(driving);
+        ESP_LOGD(TAG, "%s", driving ? "driving" : "stopped");
+    }
+
+    xSemaphoreGive(power_mutex);
+}
+
+void power_set_capture(bool active)
+{
+    if (power_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(power_mutex, portMAX_DELAY);
+    capturing = active;
+    color_stream_set_active(driving || capturing || calibrating);
+    xSemaphoreGive(power_mutex);
+}
+
+void power_set_calibrating(bool active)
+{
+    if (power_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(power_mutex, portMAX_DELAY);
+    calibrating = active;
+    color_stream_set_active(driving || capturing || calibrating);
+    xSemaphoreGive(power_mutex);
+}
@@ -0,0 +1,26 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+// dynamic frequency scaling range, min is the 32 MHz XTAL so the PLL can stop
+#define POWER_MAX_CPU_FREQ_MHZ  96
+#define POWER_MIN_CPU_FREQ_MHZ  32
+
+// Sets up DFS and automatic light sleep when CONFIG_PM_ENABLE is on.
+// Call first in app_main, before any peripheral picks its clock.
+esp_err_t power_init(void);
+
+// Re-evaluates whether the car is driving, call after every change to the motor targets or speeds.
+// While driving the CPU stays at full speed, light sleep is blocked and the color sensor is sampled;
+// once both motors are stopped all of that is released again.
+void power_update(void);
+
+// Keeps the color sensor sampling while parked, for training data capture
+void power_set_capture(bool active);
+
+// Same for a calibration reference capture, independent of power_set_capture
+void power_set_calibrating(bool active);
+
+#endif // POWER_H
@@ -0,0 +1,172 @@
+#include "race_broadcast.h"
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include "controller.h"
+
+static const char *TAG = "race";
+
+#define AD_TYPE_MFG_DATA 0xFF
+
+static uint8_t scan_addr_type;
+static atomic_bool scan_started = false;
+static atomic_bool scan_driving = false;
+
+// last applied event, so the repeats of one event are ignored
+static bool have_event = false;
+static uint8_t last_session;
+static uint8_t last_sequence;
+
+// event waiting for its delay to run out, only touched from the host task and the timer
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static race_packet_t pending;
+static esp_timer_handle_t event_timer;
+
+static int race_gap_event(struct ble_gap_event *event, void *arg);
+
+static void apply_event(const race_packet_t *packet)
+{
+    switch (packet->event) {
+        case RACE_EVENT_START:
+            controller_set_frozen(false);
+            break;
+        case RACE_EVENT_FREEZE:
+            controller_set_frozen(true);
+            break;
+        case RACE_EVENT_GAME:
+            command_set_game_status(packet->argument);
+            break;
+        default:
+            ESP_LOGE(TAG, "Unknown race event %d", packet->event);
+            break;
+    }
+}
+
+static void event_timer_callback(void *arg)
+{
+    race_packet_t packet;
+
+    portENTER_CRITICAL(&pending_lock);
+    packet = pending;
+    portEXIT_CRITICAL(&pending_lock);
+
+    apply_event(&packet);
+}
+
+// finds the race packet in the advertising data, false if there is none
+static bool find_packet(const uint8_t *data, uint8_t len, race_packet_t *packet)
+{
+    uint8_t pos = 0;
+
+    // AD structures: length, type, length - 1 bytes of data
+    while (pos + 1 < len && data[pos] != 0) {
+        uint8_t field_len = data[pos];
+        if (pos + 1 + field_len > len) {
+            return false;
+        }
+        if (data[pos + 1] == AD_TYPE_MFG_DATA && field_len - 1 == sizeof(*packet)) {
+            memcpy(packet, &data[pos + 2], sizeof(*packet));
+            return packet->company_id == RACE_COMPANY_ID && packet->magic == RACE_MAGIC;
+        }
+        pos += 1 + field_len;
+    }
+    return false;
+}
+
+static void handle_packet(const race_packet_t *packet)
+{
+    if (packet->version != RACE_PROTOCOL_VERSION) {
+        return;
+    }
+    if (have_event && packet->session == last_session && packet->sequence == last_sequence) {
+        return;
+    }
+    have_event = true;
+    last_session = packet->session;
+    last_sequence = packet->sequence;
+
+    ESP_LOGI(TAG, "Event %d (%d) in %d ms, session %d seq %d", packet->event, packet->argument,
+             packet->delay_ms, packet->session, packet->sequence);
+
+    // a newer event replaces one that is still counting down
+    esp_timer_stop(event_timer);
+    if (packet->delay_ms == 0) {
+        apply_event(packet);
+        return;
+    }
+
+    portENTER_CRITICAL(&pending_lock);
+    pending = *packet;
+    portEXIT_CRITICAL(&pending_lock);
+    esp_timer_start_once(event_timer, packet->delay_ms * 1000ULL);
+}
+
+static void start_scan(void)
+{
+    bool driving = atomic_load(&scan_driving);
+    const struct ble_gap_disc_params params = {
+        .itvl = driving ? RACE_SCAN_ITVL : RACE_PARKED_SCAN_ITVL,
+        .window = driving ? RACE_SCAN_WINDOW : RACE_PARKED_SCAN_WINDOW,
+        .passive = 1,
+        // the director changes the delay in every repeat, and repeats of one
+        // event are filtered by sequence here anyway
+        .filter_duplicates = 0,
+    };
+
+    int rc = ble_gap_disc(scan_addr_type, BLE_HS_FOREVER, &params, race_gap_event, NULL);
+    if (rc != 0 && rc != BLE_HS_EALREADY) {
+        ESP_LOGE(TAG, "Error starting race scan: rc=%d", rc);
+    }
+}
+
+static int race_gap_event(struct ble_gap_event *event, void *arg)
+{
+    race_packet_t packet;
+
+    switch (event->type) {
+        case BLE_GAP_EVENT_DISC:
+            if (find_packet(event->disc.data, event->disc.length_data, &packet)) {
+                handle_packet(&packet);
+            }
+            break;
+
+        case BLE_GAP_EVENT_DISC_COMPLETE:
+            // the controller may end the scan, e.g. around a connection setup
+            start_scan();
+            break;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+esp_err_t race_broadcast_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+            .callback = event_timer_callback,
+            .name = "race_event",
+    };
+    return esp_timer_create(&timer_args, &event_timer);
+}
+
+void race_broadcast_start(uint8_t own_addr_type)
+{
+    scan_addr_type = own_addr_type;
+    atomic_store(&scan_started, true);
+    start_scan();
+}
+
+void race_broadcast_set_driving(bool driving)
+{
+    if (atomic_exchange(&scan_driving, driving) == driving || !atomic_load(&scan_started)) {
+        return;
+    }
+    // the scan parameters only change with a new scan
+    ble_gap_disc_cancel();
+    start_scan();
+}
@@ -0,0 +1,57 @@
+#ifndef RACE_BROADCAST_H
+#define RACE_BROADCAST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Race director broadcast: every car scans passively for one advertising packet that
+// carries the race event, so a whole heat reacts to the same packet without a
+// connection per car. The driver connection is unaffected.
+//
+// The event rides in manufacturer specific data (AD type 0xFF), little endian:
+// company id (u16, RACE_COMPANY_ID), magic (u16, RACE_MAGIC), version (u8), session (u8),
+// sequence (u8), event (u8), argument (u8), delay ms (u16)
+//
+// The director repeats every event for a while and counts delay down in each repeat,
+// cars apply it delay ms after reception, so all of them act at the same moment no
+// matter which repeat they caught. A car applies a (session, sequence) pair only once.
+//
+// While a motor turns the scan takes half the air time. A parked car, frozen on the grid or
+// idle, keeps a short window every RACE_PARKED_SCAN_ITVL so the start or freeze still reaches it,
+// at about a tenth of that, and sleeps in between.
+
+#define RACE_COMPANY_ID             0xFFFF  // reserved for testing by the Bluetooth SIG
+#define RACE_MAGIC                  0x4452  // "RD"
+#define RACE_PROTOCOL_VERSION       1
+#define RACE_SCAN_ITVL              160     // 100 ms, 0.625 ms units
+#define RACE_SCAN_WINDOW            80      // 50 ms, leaves air time for the driver connection
+#define RACE_PARKED_SCAN_ITVL       512     // 320 ms, within the director's 500 ms hold after an event
+#define RACE_PARKED_SCAN_WINDOW     56      // 35 ms, longer than the director's 20-30 ms repeat spacing
+
+typedef enum {
+    RACE_EVENT_START = 0,   // release the cars
+    RACE_EVENT_FREEZE,      // stop and ignore the drivers until the next start
+    RACE_EVENT_GAME,        // argument is the game_status to apply
+} race_event_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t company_id;
+    uint16_t magic;
+    uint8_t version;
+    uint8_t session;
+    uint8_t sequence;
+    uint8_t event;
+    uint8_t argument;
+    uint16_t delay_ms;
+} race_packet_t;
+
+esp_err_t race_broadcast_init(void);
+
+// Starts scanning, called once the host is synced
+void race_broadcast_start(uint8_t own_addr_type);
+
+// Switches between the driving and the parked scan, called by power_update
+void race_broadcast_set_driving(bool driving);
+
+#endif // RACE_BROADCAST_H
@@ -0,0 +1,194 @@
+#include "shared_state.h"
+#include <string.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static shared_state_t state = {
+        .game = GAME_OFF,
+        .led = {.mode = LED_CONST, .brightness = LED_MAX_BRIGHTNESS},
+};
+static atomic_uint state_seq = 0;
+// serializes writers, readers never take it
+static portMUX_TYPE state_write_lock = portMUX_INITIALIZER_UNLOCKED;
+// set by every published command, cleared when the controller takes it
+static atomic_bool command_pending = false;
+
+#if SHARED_STATE_STATS
+static struct {
+    atomic_uint writes;
+    atomic_uint reads;
+    atomic_uint read_retries;
+    atomic_uint commands_coalesced;
+    atomic_uint commands_dropped;
+} stats;
+#define STAT_INC(counter) atomic_fetch_add_explicit(&stats.counter, 1, memory_order_relaxed)
+#else
+#define STAT_INC(counter) do {} while (0)
+#endif
+
+// write side, state_write_lock held around begin ... end
+static void write_begin(void)
+{
+    unsigned int seq = atomic_load_explicit(&state_seq, memory_order_relaxed);
+    atomic_store_explicit(&state_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    STAT_INC(writes);
+}
+
+static void write_end(void)
+{
+    unsigned int seq = atomic_load_explicit(&state_seq, memory_order_relaxed);
+    atomic_store_explicit(&state_seq, seq + 1, memory_order_release);
+}
+
+// copies len bytes at field out of the state, retrying until no write overlapped
+static void read_field(const void *field, void *out, size_t len)
+{
+    unsigned int seq_before, seq_after;
+
+    STAT_INC(reads);
+    while (1) {
+        seq_before = atomic_load_explicit(&state_seq, memory_order_acquire);
+        memcpy(out, field, len);
+        atomic_thread_fence(memory_order_acquire);
+        seq_after = atomic_load_explicit(&state_seq, memory_order_relaxed);
+        if (!(seq_before & 1) && seq_before == seq_after) {
+            return;
+        }
+        STAT_INC(read_retries);
+    }
+}
+
+#if SHARED_STATE_STATS
+static const char *TAG = "shared_state";
+
+static void stats_timer_callback(void *arg)
+{
+    (void)arg;
+    shared_state_stats_t now;
+    shared_state_get_stats(&now);
+    ESP_LOGI(TAG, "writes %" PRIu32 ", reads %" PRIu32 ", read retries %" PRIu32 ", commands coalesced %" PRIu32
+             ", dropped %" PRIu32,
+             now.writes, now.reads, now.read_retries, now.commands_coalesced, now.commands_dropped);
+}
+#endif
+
+esp_err_t shared_state_init(void)
+{
+#if SHARED_STATE_STATS
+    static esp_timer_handle_t stats_timer;
+    const esp_timer_create_args_t timer_args = {
+            .callback = stats_timer_callback,
+            .name = "shared_state_stats",
+    };
+
+    esp_err_t err = esp_timer_create(&timer_args, &stats_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(stats_timer, SHARED_STATE_STATS_PERIOD_MS * 1000ULL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the stats timer: %s", esp_err_to_name(err));
+        return err;
+    }
+#endif
+    return ESP_OK;
+}
+
+bool shared_state_publish_command(const MotorCommand *command)
+{
+    portENTER_CRITICAL(&state_write_lock);
+    bool published = !state.frozen;
+    if (published) {
+        write_begin();
+        state.command = *command;
+        write_end();
+    }
+    portEXIT_CRITICAL(&state_write_lock);
+
+    if (!published) {
+        STAT_INC(commands_dropped);
+    } else if (atomic_exchange(&command_pending, true)) {
+        STAT_INC(commands_coalesced);
+    }
+    return published;
+}
+
+void shared_state_set_frozen(bool frozen, const MotorCommand *stop)
+{
+    portENTER_CRITICAL(&state_write_lock);
+    write_begin();
+    state.frozen = frozen;
+    if (frozen) {
+        state.command = *stop;
+    }
+    write_end();
+    portEXIT_CRITICAL(&state_write_lock);
+
+    if (frozen) {
+        atomic_store(&command_pending, true);
+    }
+}
+
+void shared_state_publish_game(game_status game)
+{
+    portENTER_CRITICAL(&state_write_lock);
+    write_begin();
+    state.game = game;
+    write_end();
+    portEXIT_CRITICAL(&state_write_lock);
+}
+
+void shared_state_publish_led(const led_config_t *led)
+{
+    portENTER_CRITICAL(&state_write_lock);
+    write_begin();
+    state.led = *led;
+    write_end();
+    portEXIT_CRITICAL(&state_write_lock);
+}
+
+void shared_state_read(shared_state_t *snapshot)
+{
+    read_field(&state, snapshot, sizeof(state));
+}
+
+MotorCommand shared_state_take_command(void)
+{
+    MotorCommand command;
+
+    // a command published right after this sets the flag again, so nothing is lost
+    atomic_store(&command_pending, false);
+
+    read_field(&state.command, &command, sizeof(command));
+    return command;
+}
+
+game_status shared_state_game(void)
+{
+    game_status game;
+    read_field(&state.game, &game, sizeof(game));
+    return game;
+}
+
+void shared_state_led(led_config_t *led)
+{
+    read_field(&state.led, led, sizeof(*led));
+}
+
+void shared_state_get_stats(shared_state_stats_t *out)
+{
+#if SHARED_STATE_STATS
+    *out = (shared_state_stats_t) {
+            .writes = atomic_load(&stats.writes),
+            .reads = atomic_load(&stats.reads),
+            .read_retries = atomic_load(&stats.read_retries),
+            .commands_coalesced = atomic_load(&stats.commands_coalesced),
+            .commands_dropped = atomic_load(&stats.commands_dropped),
+    };
+#else
+    memset(out, 0, sizeof(*out));
+#endif
+}
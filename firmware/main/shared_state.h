@@ -0,0 +1,63 @@
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "controller.h"
+#include "led.h"
+
+// Runtime state shared between the BLE host task, the timer callbacks and the sensor tasks,
+// published through one sequence lock: writers serialize on a spinlock and make the sequence
+// odd while they copy, readers retry on odd or changed sequences. Readers never block and
+// never see a half written MotorCommand or LED configuration.
+//
+// Every value has a single owner that publishes it: the controller the driver command and
+// the freeze, game_effect the game state, led the LED configuration.
+
+// read retry and write counters, for debugging races; costs a few atomics on every access
+// and logs them every SHARED_STATE_STATS_PERIOD_MS
+#ifndef SHARED_STATE_STATS
+#define SHARED_STATE_STATS 0
+#endif
+#define SHARED_STATE_STATS_PERIOD_MS    10000
+
+typedef struct {
+    MotorCommand command;   // newest driver command, coalesced if the controller task is behind
+    bool frozen;            // race director freeze, commands are dropped while set
+    game_status game;       // highest priority running game effect
+    led_config_t led;
+} shared_state_t;
+
+typedef struct {
+    uint32_t writes;
+    uint32_t reads;
+    uint32_t read_retries;          // reads that overlapped a write and had to copy again
+    uint32_t commands_coalesced;    // commands replaced before the controller task picked them up
+    uint32_t commands_dropped;      // commands refused while frozen
+} shared_state_stats_t;
+
+// Starts the stats log when SHARED_STATE_STATS is set, nothing otherwise
+esp_err_t shared_state_init(void);
+
+// Publishes a driver command, false and nothing published while frozen
+bool shared_state_publish_command(const MotorCommand *command);
+
+// Sets the freeze, and with it publishes stop as the command in the same step
+void shared_state_set_frozen(bool frozen, const MotorCommand *stop);
+
+void shared_state_publish_game(game_status game);
+void shared_state_publish_led(const led_config_t *led);
+
+// Consistent copy of everything
+void shared_state_read(shared_state_t *state);
+
+// The newest command; marks it as taken, for the coalescing count
+MotorCommand shared_state_take_command(void);
+game_status shared_state_game(void);
+void shared_state_led(led_config_t *led);
+
+// All zero unless SHARED_STATE_STATS is set
+void shared_state_get_stats(shared_state_stats_t *stats);
+
+#endif // SHARED_STATE_H
@@ -0,0 +1,156 @@
+#include "telemetry.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include "color_stream.h"
+#include "color_predictor.h"
+#include "controller.h"
+#include "motor.h"
+#include "battery.h"
+#include "gatt_svr.h"
+
+static const char *TAG = "telemetry";
+
+// ATT notification header: opcode and attribute handle
+#define ATT_NOTIFY_OVERHEAD 3
+
+static esp_timer_handle_t sample_timer;
+static TaskHandle_t telemetry_task_handle = NULL;
+static StackType_t telemetry_task_stack[TELEMETRY_TASK_STACK_SIZE];
+static StaticTask_t telemetry_task_buffer;
+
+// only written by the BLE host task, read by the telemetry task
+static volatile uint16_t subscribed_conn = BLE_HS_CONN_HANDLE_NONE;
+static volatile uint16_t rate_hz = TELEMETRY_DEFAULT_RATE_HZ;
+
+static void sample_timer_callback(void *arg)
+{
+    xTaskNotifyGive(telemetry_task_handle);
+}
+
+static void take_record(telemetry_record_t *record)
+{
+    color_sample_t sample = {0};
+    float probabilities[OUTPUT_SIZE];
+    int target[NUM_MOTORS];
+    int duty[NUM_MOTORS];
+
+    color_stream_latest(&sample);
+    uint32_t color = predict_color_probabilities(color_predictor_get_model(), sample.red, sample.green,
+                                                 sample.blue, sample.clear, probabilities);
+    motor_get_state(target, duty);
+
+    *record = (telemetry_record_t) {
+            .timestamp_us = (uint32_t)esp_timer_get_time(),
+            .red = sample.red,
+            .green = sample.green,
+            .blue = sample.blue,
+            .clear = sample.clear,
+            .color = color,
+            .confidence = (uint8_t)(probabilities[color] * 100),
+            .target_a = target[0],
+            .target_b = target[1],
+            .duty_a = duty[0],
+            .duty_b = duty[1],
+            .game_state = command_get_game_status(),
+            .battery_mv = battery_get_millivolts(),
+    };
+}
+
+// records per notification for the negotiated MTU
+static int batch_size(uint16_t conn_handle)
+{
+    int fit = (ble_att_mtu(conn_handle) - ATT_NOTIFY_OVERHEAD - (int)sizeof(telemetry_header_t)) /
+              (int)sizeof(telemetry_record_t);
+    return fit < 1 ? 1 : fit > TELEMETRY_MAX_BATCH ? TELEMETRY_MAX_BATCH : fit;
+}
+
+static void telemetry_task(void *pvParameters)
+{
+    static uint8_t batch[sizeof(telemetry_header_t) + TELEMETRY_MAX_BATCH * sizeof(telemetry_record_t)];
+    telemetry_header_t header = {.version = TELEMETRY_VERSION};
+    telemetry_record_t *records = (telemetry_record_t *)(batch + sizeof(header));
+    int count = 0;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint16_t conn_handle = subscribed_conn;
+        if (conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+            count = 0;
+            continue;
+        }
+
+        take_record(&records[count++]);
+        if (count < batch_size(conn_handle)) {
+            continue;
+        }
+
+        // a single notification for the whole batch
+        header.count = count;
+        memcpy(batch, &header, sizeof(header));
+        struct os_mbuf *om = ble_hs_mbuf_from_flat(batch, sizeof(header) + count * sizeof(telemetry_record_t));
+        if (om == NULL || ble_gatts_notify_custom(conn_handle, telemetry_val_handle, om) != 0) {
+            ESP_LOGD(TAG, "Dropped telemetry batch %u", header.sequence);
+        }
+        header.sequence++;
+        count = 0;
+    }
+}
+
+// samples only while someone listens, so telemetry costs nothing otherwise
+static void update_timer(void)
+{
+    esp_timer_stop(sample_timer);
+    if (subscribed_conn != BLE_HS_CONN_HANDLE_NONE && rate_hz != 0) {
+        esp_timer_start_periodic(sample_timer, 1000000 / rate_hz);
+    }
+}
+
+esp_err_t telemetry_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+            .callback = sample_timer_callback,
+            .name = "telemetry",
+            .skip_unhandled_events = true,
+    };
+
+    esp_err_t err = esp_timer_create(&timer_args, &sample_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create telemetry timer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    telemetry_task_handle = xTaskCreateStatic(telemetry_task, "telemetry_task", TELEMETRY_TASK_STACK_SIZE, NULL,
+                                              TELEMETRY_TASK_PRIORITY, telemetry_task_stack, &telemetry_task_buffer);
+    return ESP_OK;
+}
+
+void telemetry_set_subscribed(uint16_t conn_handle, bool subscribed)
+{
+    if (subscribed) {
+        subscribed_conn = conn_handle;
+    } else if (conn_handle == subscribed_conn) {
+        subscribed_conn = BLE_HS_CONN_HANDLE_NONE;
+    }
+    update_timer();
+    ESP_LOGI(TAG, "Telemetry %s, %u Hz", subscribed ? "on" : "off", rate_hz);
+}
+
+esp_err_t telemetry_set_rate(uint16_t rate)
+{
+    if (rate > TELEMETRY_MAX_RATE_HZ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    rate_hz = rate;
+    update_timer();
+    return ESP_OK;
+}
+
+uint16_t telemetry_get_rate(void)
+{
+    return rate_hz;
+}
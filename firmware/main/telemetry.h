@@ -0,0 +1,52 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Telemetry stream: records are sampled at a configurable rate and batched into MTU sized
+// notifications of the telemetry characteristic, only while a central is subscribed.
+// All fields are little endian.
+//
+// notification: header, then count records
+// writing a u16 to the characteristic sets the rate in Hz (0 stops sampling), reading returns it
+
+#define TELEMETRY_VERSION           1
+#define TELEMETRY_DEFAULT_RATE_HZ   50
+#define TELEMETRY_MAX_RATE_HZ       200
+#define TELEMETRY_MAX_BATCH         16     // records per notification, also capped by the MTU
+#define TELEMETRY_TASK_PRIORITY     2
+#define TELEMETRY_TASK_STACK_SIZE   3072   // bytes
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t count;
+    uint16_t sequence;      // per notification, a gap means notifications were lost
+} telemetry_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t timestamp_us;  // esp_timer_get_time(), wraps after about 71 minutes
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+    uint16_t clear;
+    uint8_t color;          // predicted class of this sample
+    uint8_t confidence;     // softmax probability of that class, percent
+    int8_t target_a;        // commanded speed, signed percent
+    int8_t target_b;
+    int16_t duty_a;         // applied LEDC duty, signed
+    int16_t duty_b;
+    uint8_t game_state;
+    uint16_t battery_mv;
+} telemetry_record_t;
+
+esp_err_t telemetry_init(void);
+
+// Follows the subscription of the telemetry characteristic
+void telemetry_set_subscribed(uint16_t conn_handle, bool subscribed);
+
+esp_err_t telemetry_set_rate(uint16_t rate_hz);
+uint16_t telemetry_get_rate(void);
+
+#endif // TELEMETRY_H
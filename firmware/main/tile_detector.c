@@ -0,0 +1,89 @@
+#include "tile_detector.h"
+#include <string.h>
+
+#if TILE_VOTE_MAJORITY * 2 <= TILE_VOTE_WINDOW
+#error "TILE_VOTE_MAJORITY must be more than half of TILE_VOTE_WINDOW"
+#endif
+
+// on a tile until its class is down to this many votes, or another class wins
+#define TILE_EXIT_VOTES (TILE_VOTE_WINDOW - TILE_VOTE_MAJORITY)
+
+void tile_detector_init(tile_detector_t *detector, uint8_t track_class)
+{
+    memset(detector, 0, sizeof(*detector));
+    memset(detector->labels, TILE_NO_CLASS, sizeof(detector->labels));
+    detector->track_class = track_class;
+}
+
+uint8_t tile_detector_label(const float probabilities[OUTPUT_SIZE], uint8_t threshold_percent)
+{
+    uint8_t best = 0;
+    for (int i = 1; i < OUTPUT_SIZE; i++) {
+        if (probabilities[i] > probabilities[best]) {
+            best = i;
+        }
+    }
+    return probabilities[best] * 100 >= threshold_percent ? best : TILE_NO_CLASS;
+}
+
+unsigned int tile_detector_step(tile_detector_t *detector, int64_t timestamp_us, uint8_t label,
+                                tile_detection_t *left)
+{
+    unsigned int events = 0;
+
+    if (label >= OUTPUT_SIZE || label == detector->track_class) {
+        label = TILE_NO_CLASS;
+    }
+
+    // slide the window, the oldest label gives up its vote
+    uint32_t slot = detector->count % TILE_VOTE_WINDOW;
+    if (detector->labels[slot] != TILE_NO_CLASS) {
+        detector->votes[detector->labels[slot]]--;
+    }
+    detector->labels[slot] = label;
+    detector->timestamps[slot] = timestamp_us;
+    if (label != TILE_NO_CLASS) {
+        detector->votes[label]++;
+    }
+    detector->count++;
+
+    uint8_t voted = TILE_NO_CLASS;
+    for (int i = 0; i < OUTPUT_SIZE; i++) {
+        if (detector->votes[i] >= TILE_VOTE_MAJORITY) {
+            voted = i;
+        }
+    }
+
+    if (detector->on_tile) {
+        tile_detection_t *tile = &detector->tile;
+        if (label == tile->color) {
+            tile->last_us = timestamp_us;
+            tile->samples++;
+        }
+        if ((voted != TILE_NO_CLASS && voted != tile->color) || detector->votes[tile->color] <= TILE_EXIT_VOTES) {
+            *left = *tile;
+            detector->on_tile = false;
+            events |= TILE_DETECTOR_EXIT;
+        }
+    }
+
+    if (!detector->on_tile && voted != TILE_NO_CLASS) {
+        // the tile began with the oldest sample of its class still in the window
+        uint32_t kept = detector->count < TILE_VOTE_WINDOW ? detector->count : TILE_VOTE_WINDOW;
+        bool found = false;
+        detector->tile = (tile_detection_t){.color = voted, .samples = detector->votes[voted]};
+        for (uint32_t age = kept; age > 0; age--) {
+            uint32_t index = (detector->count - age) % TILE_VOTE_WINDOW;
+            if (detector->labels[index] == voted) {
+                if (!found) {
+                    detector->tile.entry_us = detector->timestamps[index];
+                    found = true;
+                }
+                detector->tile.last_us = detector->timestamps[index];
+            }
+        }
+        detector->on_tile = true;
+        events |= TILE_DETECTOR_ENTRY;
+    }
+    return events;
+}
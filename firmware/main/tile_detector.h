@@ -0,0 +1,59 @@
+#ifndef TILE_DETECTOR_H
+#define TILE_DETECTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "color_predictor.h"
+
+// Incremental tile detector over the per sample classes of the color stream. No RTOS in here,
+// tile_trigger feeds it from its task and the host replay from logged samples.
+//
+// Every sample is labelled with its class, or TILE_NO_CLASS when the softmax is not confident
+// enough or it is the track surface. A moving window majority vote over the last
+// TILE_VOTE_WINDOW labels smooths out single misclassified samples, and a tile is a run of one
+// voted class: it is entered when that class wins the vote and left when it loses it, so a tile
+// gives one entry however long the car takes to cross it. Two tiles of the same color need
+// track, or at least unconfident samples, between them to count twice.
+// The stream pauses while the car stands still, the window then still holds what is under the sensor.
+
+#define TILE_NO_CLASS       0xFF
+
+#ifndef TILE_VOTE_WINDOW
+#define TILE_VOTE_WINDOW    5       // samples, 5 ms at 1 kHz
+#endif
+#ifndef TILE_VOTE_MAJORITY
+#define TILE_VOTE_MAJORITY  3       // also the shortest tile that is seen, in samples
+#endif
+
+#define TILE_DETECTOR_ENTRY 0x01
+#define TILE_DETECTOR_EXIT  0x02
+
+typedef struct {
+    uint8_t color;          // game_status of the tile
+    int64_t entry_us;       // timestamp of its first sample
+    int64_t last_us;        // timestamp of its last sample so far
+    uint32_t samples;       // labelled with its color
+} tile_detection_t;
+
+typedef struct {
+    uint8_t labels[TILE_VOTE_WINDOW];
+    int64_t timestamps[TILE_VOTE_WINDOW];
+    uint8_t votes[OUTPUT_SIZE];
+    uint32_t count;         // samples since the start, the window is full from TILE_VOTE_WINDOW on
+    uint8_t track_class;    // class of the track surface, never a tile, or TILE_NO_CLASS
+    bool on_tile;
+    tile_detection_t tile;  // current tile while on_tile
+} tile_detector_t;
+
+void tile_detector_init(tile_detector_t *detector, uint8_t track_class);
+
+// Labels a sample: its class if confidence reaches threshold_percent, else TILE_NO_CLASS
+uint8_t tile_detector_label(const float probabilities[OUTPUT_SIZE], uint8_t threshold_percent);
+
+// Adds the next sample, returns TILE_DETECTOR_ENTRY and / or TILE_DETECTOR_EXIT.
+// On an exit the finished tile is copied to *left, on an entry detector->tile is the new one.
+// Both at once when the car goes straight from one tile onto another.
+unsigned int tile_detector_step(tile_detector_t *detector, int64_t timestamp_us, uint8_t label,
+                                tile_detection_t *left);
+
+#endif // TILE_DETECTOR_H
@@ -0,0 +1,159 @@
+#include "tile_trigger.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "color_stream.h"
+#include "color_predictor.h"
+#include "controller.h"
+#include "motor.h"
+#include "trace.h"
+
+static const char *TAG = "TileTrigger";
+
+static TaskHandle_t tile_trigger_task_handle = NULL;
+static StackType_t tile_trigger_task_stack[TILE_TRIGGER_TASK_STACK_SIZE];
+static StaticTask_t tile_trigger_task_buffer;
+static atomic_uint confidence_threshold = TILE_CONFIDENCE_THRESHOLD_PERCENT;
+
+static tile_info_t last_tile;
+static bool have_last_tile = false;
+static portMUX_TYPE last_tile_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// last edge of the Hall switch, the level it went to and when
+static bool hall_asserted = false;
+static int64_t hall_edge_us = 0;
+static portMUX_TYPE hall_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void IRAM_ATTR hall_isr_handler(void *arg)
+{
+    portENTER_CRITICAL_ISR(&hall_lock);
+    hall_asserted = gpio_get_level(TILE_HALL_PIN) == 0;
+    hall_edge_us = esp_timer_get_time();
+    portEXIT_CRITICAL_ISR(&hall_lock);
+}
+
+// Whether the magnet of a tile was under the car when the sample was taken. Samples are read
+// a period or two after they were taken, far less than a tile, so at most one edge lies between.
+static bool hall_asserted_at(int64_t timestamp_us)
+{
+    portENTER_CRITICAL(&hall_lock);
+    bool asserted = hall_asserted;
+    bool before_edge = timestamp_us < hall_edge_us;
+    portEXIT_CRITICAL(&hall_lock);
+    return before_edge ? !asserted : asserted;
+}
+
+static void tile_left(const tile_detection_t *tile)
+{
+    int target[NUM_MOTORS], duty[NUM_MOTORS];
+    tile_info_t info = {
+            .color = tile->color,
+            .dwell_us = tile->last_us - tile->entry_us + color_stream_period_us(),
+            .samples = tile->samples,
+    };
+
+    // no wheel encoders, the commanded speed has to do
+    motor_get_state(target, duty);
+    int speed_percent = (abs(target[0]) + abs(target[1])) / 2;
+    info.width_mm = (uint64_t)info.dwell_us * speed_percent * TILE_FULL_SPEED_MM_PER_S / (100 * 1000000ULL);
+
+    portENTER_CRITICAL(&last_tile_lock);
+    last_tile = info;
+    have_last_tile = true;
+    portEXIT_CRITICAL(&last_tile_lock);
+
+    ESP_LOGD(TAG, "Left tile %d after %lu us, %lu samples, about %u mm", info.color, info.dwell_us,
+             info.samples, info.width_mm);
+}
+
+static void tile_trigger_task(void *pvParameters)
+{
+    uint32_t cursor = color_stream_cursor();
+    tile_detector_t detector;
+    tile_detection_t left;
+    color_sample_t sample;
+    float probabilities[OUTPUT_SIZE];
+
+    tile_detector_init(&detector, TILE_TRACK_CLASS);
+    color_stream_set_listener(xTaskGetCurrentTaskHandle());
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // normally one new sample, more if a higher priority task held us up
+        while (color_stream_read(&cursor, &sample)) {
+            // every sample, so an uploaded model is picked up as soon as it is active
+            const NeuralNetwork *model = color_predictor_get_model();
+            TRACE_SPAN(TRACE_INFERENCE,
+                       predict_color_probabilities(model, sample.red, sample.green, sample.blue, sample.clear,
+                                                   probabilities));
+            uint8_t label = tile_detector_label(probabilities, atomic_load(&confidence_threshold));
+            // only a color over a magnet is a tile, off it the vote sees nothing and leaves the tile
+            if (!hall_asserted_at(sample.timestamp_us)) {
+                label = TILE_NO_CLASS;
+            }
+            unsigned int events = tile_detector_step(&detector, sample.timestamp_us, label, &left);
+
+            if (events & TILE_DETECTOR_EXIT) {
+                tile_left(&left);
+            }
+            if (events & TILE_DETECTOR_ENTRY) {
+                TRACE_ORIGIN(TRACE_FLOW_TILE, detector.tile.entry_us);
+                TRACE_POINT(TRACE_TILE_CLASSIFIED);
+                ESP_LOGD(TAG, "Entered tile %d, %lu of the last %d samples", detector.tile.color,
+                         detector.tile.samples, TILE_VOTE_WINDOW);
+                command_set_game_status(detector.tile.color);
+                TRACE_POINT(TRACE_EFFECT_APPLIED);
+            }
+        }
+    }
+}
+
+esp_err_t tile_trigger_start(void)
+{
+    const gpio_config_t io_conf = {
+            .pin_bit_mask = 1ULL << TILE_HALL_PIN,
+            .mode = GPIO_MODE_INPUT,
+            .pull_up_en = GPIO_PULLUP_ENABLE,
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_ANYEDGE,
+    };
+    esp_err_t err = gpio_config(&io_conf);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure the Hall switch: %s", esp_err_to_name(err));
+        return err;
+    }
+    hall_asserted = gpio_get_level(TILE_HALL_PIN) == 0;
+
+    err = gpio_install_isr_service(0);
+    if (err == ESP_OK) {
+        err = gpio_isr_handler_add(TILE_HALL_PIN, hall_isr_handler, NULL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to attach the Hall switch interrupt: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    tile_trigger_task_handle = xTaskCreateStatic(tile_trigger_task, "tile_trigger_task",
+                                                 TILE_TRIGGER_TASK_STACK_SIZE, NULL, TILE_TRIGGER_TASK_PRIORITY,
+                                                 tile_trigger_task_stack, &tile_trigger_task_buffer);
+    return ESP_OK;
+}
+
+void tile_trigger_set_confidence_threshold(uint8_t percent)
+{
+    atomic_store(&confidence_threshold, percent > 100 ? 100 : percent);
+}
+
+bool tile_trigger_get_last(tile_info_t *info)
+{
+    portENTER_CRITICAL(&last_tile_lock);
+    bool have = have_last_tile;
+    *info = last_tile;
+    portEXIT_CRITICAL(&last_tile_lock);
+    return have;
+}
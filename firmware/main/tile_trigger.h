@@ -0,0 +1,54 @@
+#ifndef TILE_TRIGGER_H
+#define TILE_TRIGGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "tile_detector.h"
+
+// Color stream to game event: every sample is classified as it arrives and fed to the tile
+// detector, see tile_detector.h. Entering a tile fires its game event once, however fast or
+// slow the car crosses it; leaving it gives the dwell time and from that the tile width.
+// A tile is a color over a magnet: samples taken while the Hall switch is released vote for
+// nothing, so the track surface never fires an event whatever its color.
+
+#define TILE_TRIGGER_TASK_PRIORITY  10
+#define TILE_TRIGGER_TASK_STACK_SIZE 2048  // bytes
+
+// HAL1501 Hall switch, pulled low while a tile magnet is under the car
+#ifndef TILE_HALL_PIN
+#define TILE_HALL_PIN 10
+#endif
+
+#ifndef TILE_CONFIDENCE_THRESHOLD_PERCENT
+#define TILE_CONFIDENCE_THRESHOLD_PERCENT 80
+#endif
+
+// class of the track surface between the tiles, TILE_NO_CLASS if it is none of them; with the
+// Hall gate only needed where the track next to a magnet is seen before the tile color
+#ifndef TILE_TRACK_CLASS
+#define TILE_TRACK_CLASS TILE_NO_CLASS
+#endif
+
+// car speed at 100% duty, only for the tile width estimate; nominal, measure it for a car
+#ifndef TILE_FULL_SPEED_MM_PER_S
+#define TILE_FULL_SPEED_MM_PER_S 1000
+#endif
+
+// the last tile the car left
+typedef struct {
+    uint8_t color;          // game_status of the tile
+    uint32_t dwell_us;      // from its first sample to one period after its last
+    uint32_t samples;
+    uint16_t width_mm;      // dwell times the mean commanded speed
+} tile_info_t;
+
+// Starts the task consuming the color stream, color_stream_start must have been called
+esp_err_t tile_trigger_start(void);
+
+void tile_trigger_set_confidence_threshold(uint8_t percent);
+
+// Copies the last tile the car left. Returns false if there was none yet.
+bool tile_trigger_get_last(tile_info_t *info);
+
+#endif // TILE_TRIGGER_H
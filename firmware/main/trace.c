@@ -0,0 +1,139 @@
+#include "trace.h"
+
+#if TRACE_ENABLE
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "trace";
+
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+static const char *const trace_names[TRACE_ID_COUNT] = {
+        [TRACE_COMMAND_PUBLISHED] = "ble rx -> published",
+        [TRACE_CONTROLLER]        = "ble rx -> controller",
+        [TRACE_MOTOR_DUTY]        = "ble rx -> pwm duty",
+        [TRACE_TILE_CLASSIFIED]   = "tile -> classified",
+        [TRACE_EFFECT_APPLIED]    = "tile -> effect",
+        [TRACE_I2C_READ]          = "i2c read",
+        [TRACE_INFERENCE]         = "inference",
+};
+
+// the flow a stage belongs to, durations have none
+static const int trace_flow[TRACE_ID_COUNT] = {
+        [TRACE_COMMAND_PUBLISHED] = TRACE_FLOW_COMMAND,
+        [TRACE_CONTROLLER]        = TRACE_FLOW_COMMAND,
+        [TRACE_MOTOR_DUTY]        = TRACE_FLOW_COMMAND,
+        [TRACE_TILE_CLASSIFIED]   = TRACE_FLOW_TILE,
+        [TRACE_EFFECT_APPLIED]    = TRACE_FLOW_TILE,
+        [TRACE_I2C_READ]          = -1,
+        [TRACE_INFERENCE]         = -1,
+};
+
+// low 32 bits of esp_timer, differences stay right across the wrap; esp_timer
+// rather than the cycle counter, which DFS keeps rescaling
+static atomic_uint flow_origin[TRACE_FLOW_COUNT];
+static atomic_uint armed = 0;       // bit per trace_id_t still waiting for its first result
+
+static struct {
+    atomic_uint head;               // results recorded, writers claim slots with fetch_add
+    uint32_t ring[TRACE_RING_SIZE];
+} results[TRACE_ID_COUNT];
+
+uint32_t trace_now_us(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+void trace_record(trace_id_t id, uint32_t duration_us)
+{
+    unsigned int slot = atomic_fetch_add_explicit(&results[id].head, 1, memory_order_relaxed);
+    results[id].ring[slot & TRACE_RING_MASK] = duration_us;
+}
+
+void trace_origin(trace_flow_t flow, int64_t timestamp_us)
+{
+    unsigned int stages = 0;
+    for (int i = 0; i < TRACE_ID_COUNT; i++) {
+        if (trace_flow[i] == (int)flow) {
+            stages |= 1u << i;
+        }
+    }
+    atomic_store_explicit(&flow_origin[flow], (uint32_t)timestamp_us, memory_order_relaxed);
+    atomic_fetch_or_explicit(&armed, stages, memory_order_release);
+}
+
+void trace_point(trace_id_t id)
+{
+    // only the first time after the origin
+    if (!(atomic_fetch_and_explicit(&armed, ~(1u << id), memory_order_acquire) & (1u << id))) {
+        return;
+    }
+    uint32_t origin = atomic_load_explicit(&flow_origin[trace_flow[id]], memory_order_relaxed);
+    trace_record(id, trace_now_us() - origin);
+}
+
+static void summarize(trace_id_t id, trace_summary_t *summary)
+{
+    uint32_t sorted[TRACE_RING_SIZE];
+    uint32_t count = atomic_load_explicit(&results[id].head, memory_order_relaxed);
+    uint32_t kept = count < TRACE_RING_SIZE ? count : TRACE_RING_SIZE;
+
+    // insertion sort, the ring is small and this only runs for a report
+    for (uint32_t i = 0; i < kept; i++) {
+        uint32_t value = results[id].ring[i];
+        uint32_t j = i;
+        for (; j > 0 && sorted[j - 1] > value; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+
+    *summary = (trace_summary_t) {
+            .count = count,
+            .p50_us = kept ? sorted[kept / 2] : 0,
+            .p99_us = kept ? sorted[kept * 99 / 100] : 0,
+            .max_us = kept ? sorted[kept - 1] : 0,
+    };
+}
+
+void trace_get_summary(trace_summary_t summary[TRACE_ID_COUNT])
+{
+    for (int i = 0; i < TRACE_ID_COUNT; i++) {
+        summarize(i, &summary[i]);
+    }
+}
+
+static void report_timer_callback(void *arg)
+{
+    trace_summary_t summary[TRACE_ID_COUNT];
+
+    trace_get_summary(summary);
+    for (int i = 0; i < TRACE_ID_COUNT; i++) {
+        if (summary[i].count != 0) {
+            ESP_LOGI(TAG, "%-22s n %6lu  p50 %6lu us  p99 %6lu us  max %6lu us", trace_names[i],
+                     summary[i].count, summary[i].p50_us, summary[i].p99_us, summary[i].max_us);
+        }
+    }
+}
+
+void trace_init(void)
+{
+    static esp_timer_handle_t report_timer;
+    const esp_timer_create_args_t timer_args = {
+            .callback = report_timer_callback,
+            .name = "trace_report",
+    };
+
+    esp_err_t err = esp_timer_create(&timer_args, &report_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(report_timer, TRACE_REPORT_PERIOD_MS * 1000ULL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the trace report: %s", esp_err_to_name(err));
+    }
+}
+
+#endif // TRACE_ENABLE
@@ -0,0 +1,75 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Latency trace points along the two latency critical paths, and durations of the expensive steps.
+// Off by default, with TRACE_ENABLE=0 every macro below expands to nothing (or just its statement).
+//
+// A flow starts at an origin, each of its stages then records the time since that origin once,
+// the first time it is reached; a newer origin re-arms all stages. Every id keeps its last
+// TRACE_RING_SIZE results in a lock free ring, reported as p50 / p99 / max on the console every
+// TRACE_REPORT_PERIOD_MS and through the read only trace characteristic.
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 0
+#endif
+
+#define TRACE_RING_SIZE         128     // must be a power of two
+#define TRACE_REPORT_PERIOD_MS  5000
+
+typedef enum {
+    TRACE_FLOW_COMMAND,     // from the BLE write callback
+    TRACE_FLOW_TILE,        // from the first color stream sample of the tile
+    TRACE_FLOW_COUNT
+} trace_flow_t;
+
+typedef enum {
+    // command flow
+    TRACE_COMMAND_PUBLISHED = 0,    // set_motor_command published the command
+    TRACE_CONTROLLER,               // controller task picked it up
+    TRACE_MOTOR_DUTY,               // first PWM duty latched
+    // tile flow
+    TRACE_TILE_CLASSIFIED,          // entry voted, includes the vote window
+    TRACE_EFFECT_APPLIED,           // game effect started
+    // durations
+    TRACE_I2C_READ,                 // collecting one sample and queueing the next on the bus
+    TRACE_INFERENCE,                // classifying one sample
+    TRACE_ID_COUNT
+} trace_id_t;
+
+// one trace characteristic entry per trace_id_t, little endian
+typedef struct __attribute__((packed)) {
+    uint32_t count;         // results recorded since boot
+    uint32_t p50_us;        // over the last TRACE_RING_SIZE results
+    uint32_t p99_us;
+    uint32_t max_us;
+} trace_summary_t;
+
+#if TRACE_ENABLE
+
+void trace_init(void);
+void trace_origin(trace_flow_t flow, int64_t timestamp_us);
+void trace_point(trace_id_t id);
+void trace_record(trace_id_t id, uint32_t duration_us);
+uint32_t trace_now_us(void);
+void trace_get_summary(trace_summary_t summary[TRACE_ID_COUNT]);
+
+#define TRACE_INIT()                    trace_init()
+#define TRACE_ORIGIN(flow, timestamp)   trace_origin(flow, timestamp)
+#define TRACE_ORIGIN_NOW(flow)          trace_origin(flow, trace_now_us())
+#define TRACE_POINT(id)                 trace_point(id)
+// runs the statement and records how long it took
+#define TRACE_SPAN(id, ...)             do { uint32_t trace_start = trace_now_us(); __VA_ARGS__; \
+                                             trace_record(id, trace_now_us() - trace_start); } while (0)
+
+#else
+
+#define TRACE_INIT()                    do {} while (0)
+#define TRACE_ORIGIN(flow, timestamp)   do {} while (0)
+#define TRACE_ORIGIN_NOW(flow)          do {} while (0)
+#define TRACE_POINT(id)                 do {} while (0)
+#define TRACE_SPAN(id, ...)             do { __VA_ARGS__; } while (0)
+
+#endif // TRACE_ENABLE
+
+#endif // TRACE_H
@@ -0,0 +1,58 @@
+import argparse
+import asyncio
+import json
+import os
+import statistics
+import struct
+import time
+from bleak import BleakClient
+
+CONFIG_FILE = "ble_device_config.json"
+CONTROL_CHARACTERISTIC_UUID = "5b2e8d34-7c1a-4e0b-9f6d-2a8c3e71b4d2"
+LINK_CHARACTERISTIC_UUID = "a1f4c2d9-6e3b-4b8a-8d57-3c9e0f12ab64"
+
+# see firmware/main/control_protocol.h and gap.h
+CONTROL_PROTOCOL_VERSION = 1
+HEADER = struct.Struct('<BBH')      # version, count, sequence
+SETPOINT = struct.Struct('<HbbB')   # offset ms, speed a, speed b, duration
+LINK = struct.Struct('<HHHHBBHB')   # conn handle, interval, latency, timeout, tx phy, rx phy, mtu, idle
+
+
+def load_saved_address():
+    if os.path.exists(CONFIG_FILE):
+        with open(CONFIG_FILE, "r") as f:
+            return json.load(f).get("ble_address")
+    return None
+
+async def main():
+    parser = argparse.ArgumentParser(description="Time control writes with response, the over the air half of "
+                                                 "the command path that firmware/bench cannot see")
+    parser.add_argument("address", nargs="?", help="car BLE address, defaults to the saved one")
+    parser.add_argument("--count", type=int, default=200, help="writes to time")
+    args = parser.parse_args()
+
+    address = args.address or load_saved_address()
+    if address is None:
+        print("No device address given and none saved. Exiting.")
+        return
+
+    rtts = []
+    async with BleakClient(address) as client:
+        for sequence in range(1, args.count + 1):
+            # stop setpoints, the car stays where it is
+            packet = HEADER.pack(CONTROL_PROTOCOL_VERSION, 1, sequence) + SETPOINT.pack(0, 0, 0, 1)
+            start = time.perf_counter()
+            # the car sends the write response once the control callback returned
+            await client.write_gatt_char(CONTROL_CHARACTERISTIC_UUID, packet, response=True)
+            rtts.append((time.perf_counter() - start) * 1000)
+
+        link = LINK.unpack(await client.read_gatt_char(LINK_CHARACTERISTIC_UUID))
+
+    first = rtts[0]
+    rtts.sort()
+    print(f"connection interval {link[1] * 1.25:.2f} ms, latency {link[2]}, mtu {link[6]}")
+    # same columns as the BENCH lines of firmware/bench
+    print(f"BENCH,ble_write_rtt,ms,{len(rtts)},{first:.2f},{rtts[0]:.2f},{statistics.median(rtts):.2f},{rtts[-1]:.2f}")
+
+if __name__ == "__main__":
+    asyncio.run(main())
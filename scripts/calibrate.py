@@ -0,0 +1,86 @@
+import argparse
+import asyncio
+import json
+import os
+import struct
+from bleak import BleakClient
+
+CONFIG_FILE = "ble_device_config.json"
+CALIBRATION_CHARACTERISTIC_UUID = "3e8b5d21-a6c4-4f97-8b13-c52e0d9a7f64"
+
+# see firmware/main/calibration.h
+CALIBRATION_VERSION = 1
+OP_CAPTURE_WHITE = 1
+OP_CAPTURE_BLACK = 2
+OP_CLEAR = 3
+OP_SENSOR = 4
+MODES = ['none', 'gain', 'two point']
+STATE = struct.Struct('<BBBBB4H4H')  # version, mode, busy, range, conversion time, white r g b c, black r g b c
+# conversion time settings of the OPT4060, see opt4060.h
+CONVERSION_US = [600, 1000, 1800, 3400, 6500, 12700]
+
+
+def load_saved_address():
+    if os.path.exists(CONFIG_FILE):
+        with open(CONFIG_FILE, "r") as f:
+            return json.load(f).get("ble_address")
+    return None
+
+async def read_state(client):
+    fields = STATE.unpack(await client.read_gatt_char(CALIBRATION_CHARACTERISTIC_UUID))
+    if fields[0] != CALIBRATION_VERSION:
+        raise RuntimeError(f"Unsupported calibration version {fields[0]}")
+    return fields
+
+def print_state(fields):
+    _version, mode, _busy, sensor_range, conversion = fields[:5]
+    print(f"mode: {MODES[mode]}")
+    print(f"sensor: range {sensor_range}, "
+          f"{CONVERSION_US[conversion]} us per sample")
+    print(f"white: {' '.join(str(v) for v in fields[5:9])}")
+    print(f"black: {' '.join(str(v) for v in fields[9:13])}")
+
+async def capture(client, op, name):
+    await asyncio.to_thread(input, f"Put the car on {name} and press enter")
+    await client.write_gatt_char(CALIBRATION_CHARACTERISTIC_UUID, bytes([op]), response=True)
+    # the car averages 100 ms of samples
+    while (await read_state(client))[2]:
+        await asyncio.sleep(0.1)
+
+async def main():
+    parser = argparse.ArgumentParser(description="Calibrate the color sensor of a car for the venue lighting")
+    parser.add_argument("address", nargs="?", help="car BLE address, defaults to the saved one")
+    action = parser.add_mutually_exclusive_group()
+    action.add_argument("--white-only", action="store_true", help="capture only white, for a brightness gain")
+    action.add_argument("--show", action="store_true", help="only print the current calibration")
+    action.add_argument("--clear", action="store_true", help="forget the references, raw counts from now on")
+    # no auto range, the car reads the results without their exponent, see firmware/main/calibration.h
+    parser.add_argument("--range", type=int, choices=range(9), help="sensor range 0-8, each step doubles full scale")
+    parser.add_argument("--conversion", type=int, choices=range(len(CONVERSION_US)),
+                        help="sensor conversion time setting, see CONVERSION_US; changing it clears the references")
+    args = parser.parse_args()
+
+    address = args.address or load_saved_address()
+    if address is None:
+        print("No device address given and none saved. Exiting.")
+        return
+
+    async with BleakClient(address) as client:
+        state = await read_state(client)
+        if args.range is not None or args.conversion is not None:
+            sensor_range = state[3] if args.range is None else args.range
+            conversion = state[4] if args.conversion is None else args.conversion
+            await client.write_gatt_char(CALIBRATION_CHARACTERISTIC_UUID,
+                                         bytes([OP_SENSOR, sensor_range, conversion]), response=True)
+
+        if args.clear:
+            await client.write_gatt_char(CALIBRATION_CHARACTERISTIC_UUID, bytes([OP_CLEAR]), response=True)
+        elif not args.show:
+            await capture(client, OP_CAPTURE_WHITE, "white")
+            if not args.white_only:
+                await capture(client, OP_CAPTURE_BLACK, "black")
+
+        print_state(await read_state(client))
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,84 @@
+import argparse
+import asyncio
+import json
+import os
+import struct
+from bleak import BleakClient
+
+CONFIG_FILE = "ble_device_config.json"
+CAPTURE_CHARACTERISTIC_UUID = "4c8e1f27-93b5-4a6d-8e02-d7f3b9a15c48"
+
+# see firmware/main/capture.h, class indices match the firmware and trainer.py
+CAPTURE_VERSION = 1
+CAPTURE_LABEL_NONE = 0xFF
+LABELS = ['Red', 'Black', 'Green', 'White']
+CAPTURE_FILE = "color_capture.bin"
+
+HEADER = struct.Struct('<BBHBB')  # version, label, sequence, count, dropped
+SAMPLE = struct.Struct('<HHHH')   # red, green, blue, clear
+
+
+def load_saved_address():
+    if os.path.exists(CONFIG_FILE):
+        with open(CONFIG_FILE, "r") as f:
+            return json.load(f).get("ble_address")
+    return None
+
+class Capture:
+    """Collects the capture notifications of one label, and counts what got lost on the way."""
+
+    def __init__(self):
+        self.payloads = []
+        self.samples = 0
+        self.dropped = 0
+        self.lost_batches = 0
+        self.last_sequence = None
+
+    def on_notify(self, _, data):
+        version, _label, sequence, count, dropped = HEADER.unpack_from(data)
+        if version != CAPTURE_VERSION or len(data) != HEADER.size + count * SAMPLE.size:
+            print(f"Ignoring malformed capture notification of {len(data)} bytes")
+            return
+        if self.last_sequence is not None:
+            self.lost_batches += (sequence - self.last_sequence - 1) & 0xFFFF
+        self.last_sequence = sequence
+        self.payloads.append(bytes(data))
+        self.samples += count
+        self.dropped += dropped
+
+async def capture_label(client, label, seconds):
+    capture = Capture()
+    await client.start_notify(CAPTURE_CHARACTERISTIC_UUID, capture.on_notify)
+    await client.write_gatt_char(CAPTURE_CHARACTERISTIC_UUID, bytes([label]), response=True)
+    await asyncio.sleep(seconds)
+    await client.write_gatt_char(CAPTURE_CHARACTERISTIC_UUID, bytes([CAPTURE_LABEL_NONE]), response=True)
+    await client.stop_notify(CAPTURE_CHARACTERISTIC_UUID)
+    print(f"{LABELS[label]}: {capture.samples} samples, {capture.dropped} dropped on the car, "
+          f"{capture.lost_batches} notifications lost")
+    return capture.payloads
+
+async def main():
+    parser = argparse.ArgumentParser(description="Record labeled color sensor samples over BLE for trainer.py")
+    parser.add_argument("address", nargs="?", help="car BLE address, defaults to the saved one")
+    parser.add_argument("--labels", nargs="+", choices=LABELS, default=LABELS, help="colors to record, in order")
+    parser.add_argument("--seconds", type=float, default=5, help="recording time per color, the car sends 1000 samples/s")
+    parser.add_argument("--out", default=CAPTURE_FILE, help="capture file, new recordings are appended")
+    args = parser.parse_args()
+
+    address = args.address or load_saved_address()
+    if address is None:
+        print("No device address given and none saved. Exiting.")
+        return
+
+    async with BleakClient(address) as client:
+        for name in args.labels:
+            await asyncio.to_thread(input, f"Put the car on {name} and press enter")
+            payloads = await capture_label(client, LABELS.index(name), args.seconds)
+            # the file is just the notifications back to back, trainer.py reads it as is
+            with open(args.out, "ab") as f:
+                f.writelines(payloads)
+
+    print(f"Appended to {args.out}, train with `python trainer.py {args.out}`")
+
+if __name__ == "__main__":
+    asyncio.run(main())
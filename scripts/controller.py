@@ -1,16 +1,147 @@
+import argparse
 import asyncio
 import os
 import json
+import struct
+import time
 from bleak import BleakClient, BleakScanner
 import keyboard
 
 CONFIG_FILE = "ble_device_config.json"
-CHARACTERISTIC_UUID = "23408888-1f40-4cd8-9b89-ca8d45f8a5b0"  # Replace with your characteristic UUID
-
-
-async def send_command(client, speedA, speedB, directionA, directionB, duration):
-    command = bytearray([speedA, speedB, directionA, directionB, duration])
-    await client.write_gatt_char(CHARACTERISTIC_UUID, command)
+DRIVE_CHARACTERISTIC_UUID = "c4a27e19-3d58-4b6f-91e2-7f0b5d83a6c1"  # the original 5 byte command
+CONTROL_CHARACTERISTIC_UUID = "5b2e8d34-7c1a-4e0b-9f6d-2a8c3e71b4d2"
+
+# see firmware/main/control_protocol.h
+CONTROL_PROTOCOL_VERSION = 1
+
+SEND_RATE_HZ = 50  # fixed control rate, faster than the car's 15 ms connection interval is pointless
+HOLD_DURATION = 3  # 100 ms units, the car stops by itself if the link drops while a key is held
+STATS_PERIOD_S = 5
+
+# one key set per car, in the order the addresses are given
+KEY_MAPS = [{'forward': 'w', 'back': 's', 'left': 'a', 'right': 'd'},
+            {'forward': 'i', 'back': 'k', 'left': 'j', 'right': 'l'},
+            {'forward': 'up', 'back': 'down', 'left': 'left', 'right': 'right'}]
+
+# signed speed A, signed speed B per action
+ACTIONS = {'forward': (60, 60), 'back': (-50, -50), 'right': (40, -40), 'left': (-40, 40)}
+
+
+def control_packet(sequence, setpoints):
+    """setpoints: list of (offset ms, signed speed A, signed speed B, duration in 100 ms units)"""
+    packet = struct.pack('<BBH', CONTROL_PROTOCOL_VERSION, len(setpoints), sequence & 0xFFFF)
+    for offset_ms, speed_a, speed_b, duration in setpoints:
+        packet += struct.pack('<HbbB', offset_ms, speed_a, speed_b, duration)
+    return packet
+
+def read_input(keys):
+    """Current (speed A, speed B) for a key set, None if no key is held."""
+    for action, key in keys.items():
+        if keyboard.is_pressed(key):
+            return ACTIONS[action]
+    return None
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * fraction))]
+
+
+class CarLink:
+    """One car: a single slot mailbox in front of a writer task, so a slow write never stalls the send loop.
+
+    A packet that is still waiting when the next tick submits a newer one is dropped, only the newest input is sent.
+    """
+
+    def __init__(self, address, keys):
+        self.address = address
+        self.keys = keys
+        self.client = BleakClient(address)
+        self.sequence = 0
+        self.last_input = None
+        self.pending = None
+        self.wakeup = asyncio.Event()
+        self.latencies = []
+        self.sent = 0
+        self.dropped = 0
+        self.errors = 0
+
+    def submit(self, speed_a, speed_b, duration):
+        self.sequence += 1
+        if self.pending is not None:
+            self.dropped += 1
+        self.pending = (control_packet(self.sequence, [(0, speed_a, speed_b, duration)]), time.perf_counter())
+        self.wakeup.set()
+
+    async def writer(self):
+        while True:
+            await self.wakeup.wait()
+            self.wakeup.clear()
+            packet, submitted = self.pending
+            self.pending = None
+            try:
+                await self.client.write_gatt_char(CONTROL_CHARACTERISTIC_UUID, packet, response=False)
+            except Exception as e:
+                self.errors += 1
+                print(f"{self.address}: write failed: {e}")
+                continue
+            self.latencies.append(time.perf_counter() - submitted)
+            self.sent += 1
+
+    def tick(self):
+        current = read_input(self.keys)
+        if current is not None:
+            self.submit(*current, HOLD_DURATION)
+        elif self.last_input is not None:
+            # key released, stop right away instead of waiting for the hold duration; speed 0 with a
+            # real duration, older firmware asserts on a duration of 0 once its command timer ran out
+            self.submit(0, 0, HOLD_DURATION)
+        self.last_input = current
+
+    def report(self):
+        line = f"{self.address}: sent {self.sent}, dropped {self.dropped}, errors {self.errors}"
+        if self.latencies:
+            ms = [latency * 1000 for latency in self.latencies]
+            line += (f", latency avg {sum(ms) / len(ms):.1f} ms, p99 {percentile(ms, 0.99):.1f} ms,"
+                     f" max {max(ms):.1f} ms")
+        print(line)
+        self.latencies = []
+        self.sent = self.dropped = self.errors = 0
+
+
+async def run_engine(cars):
+    """Fixed rate send loop, samples the latest input of every car each tick."""
+    loop = asyncio.get_running_loop()
+    writers = [asyncio.create_task(car.writer()) for car in cars]
+    period = 1 / SEND_RATE_HZ
+    next_tick = loop.time()
+    next_report = next_tick + STATS_PERIOD_S
+    late_ticks = 0
+
+    try:
+        while not keyboard.is_pressed('q'):
+            for car in cars:
+                car.tick()
+
+            if loop.time() >= next_report:
+                for car in cars:
+                    car.report()
+                if late_ticks:
+                    print(f"{late_ticks} late ticks")
+                late_ticks = 0
+                next_report += STATS_PERIOD_S
+
+            next_tick += period
+            delay = next_tick - loop.time()
+            if delay < 0:
+                # fell behind, skip the missed ticks instead of bursting to catch up
+                late_ticks += 1
+                next_tick = loop.time()
+                delay = 0
+            await asyncio.sleep(delay)
+        print("Quitting...")
+    finally:
+        for writer in writers:
+            writer.cancel()
 
 async def select_device():
     devices = await BleakScanner.discover()
@@ -58,42 +189,30 @@ async def get_ble_address():
         save_config(config)
     return new_address
 
-async def handle_key_press(client):
-
-    # motor A speed, motor A dir, motor B speed, motor B dir, time 50 == 5.0 seconds
-    if keyboard.is_pressed('w'):
-        await send_command(client, 60,1,60,1,5)
-        print(f"Forward")
-    elif keyboard.is_pressed('s'):
-        await send_command(client, 50,0,50,0,5)
-        print(f"Backwards")
-    elif keyboard.is_pressed('d'):
-        await send_command(client, 40,1,40,0,3)
-        print(f"Right")
-    elif keyboard.is_pressed('a'):
-        await send_command(client, 40,0,40,1,3)
-        print(f"Left")
-
-
-
 async def main():
-    global motor_speed
-
-    ble_address = await get_ble_address()
-    if not ble_address:
-        print("No device selected. Exiting.")
-        return
-
-    print(f"Connecting to device: {ble_address}")
-    async with BleakClient(ble_address) as client:
-        print(f"Connected: {await client.is_connected()}")
-        print("Press 'w' to speed up, 's' to slow down, or 'q' to quit.")
-
-        while True:
-            await handle_key_press(client)
-            if keyboard.is_pressed('q'):
-                print("Quitting...")
-                break
+    parser = argparse.ArgumentParser(description="Drive one or more cars from the keyboard")
+    parser.add_argument("addresses", nargs="*",
+                        help=f"car addresses, up to {len(KEY_MAPS)}, default is the saved car")
+    args = parser.parse_args()
+
+    addresses = args.addresses[:len(KEY_MAPS)]
+    if not addresses:
+        ble_address = await get_ble_address()
+        if not ble_address:
+            print("No device selected. Exiting.")
+            return
+        addresses = [ble_address]
+
+    cars = [CarLink(address, keys) for address, keys in zip(addresses, KEY_MAPS)]
+    print(f"Connecting to {', '.join(addresses)}")
+    await asyncio.gather(*(car.client.connect() for car in cars))
+    try:
+        for car in cars:
+            print(f"{car.address}: keys {'/'.join(car.keys.values())}")
+        print("Press 'q' to quit.")
+        await run_engine(cars)
+    finally:
+        await asyncio.gather(*(car.client.disconnect() for car in cars), return_exceptions=True)
 
 if __name__ == "__main__":
     asyncio.run(main())
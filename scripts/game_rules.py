@@ -0,0 +1,80 @@
+import argparse
+import asyncio
+import json
+import os
+import struct
+from bleak import BleakClient
+
+CONFIG_FILE = "ble_device_config.json"
+GAME_RULES_CHARACTERISTIC_UUID = "0b7d9e42-5c1f-4a83-9e6b-f2a4c8d31e57"
+
+# see firmware/main/game_effect.h, color indices follow game_status
+COLORS = ['red', 'black', 'green', 'white', 'yellow']
+SPEED_MODES = ['none', 'offset', 'scale', 'spin']
+LED_MODES = ['none', 'flash_all', 'flash_back', 'flash_front', 'flash_front_alternate']
+EFFECT = struct.Struct('<HHBbBB')  # duration ms, cooldown ms, speed mode, speed arg, led mode, priority
+FIELDS = ['duration', 'cooldown', 'speed', 'arg', 'led', 'priority']
+
+
+def load_saved_address():
+    if os.path.exists(CONFIG_FILE):
+        with open(CONFIG_FILE, "r") as f:
+            return json.load(f).get("ble_address")
+    return None
+
+def print_table(address, table):
+    print(f"{address}:")
+    print(f"  {'color':<8}{'duration':>9}{'cooldown':>9}  {'speed':<7}{'arg':>4}  {'led':<22}{'priority':>8}")
+    for color, (duration, cooldown, speed, arg, led, priority) in zip(COLORS, EFFECT.iter_unpack(table)):
+        print(f"  {color:<8}{duration:>9}{cooldown:>9}  {SPEED_MODES[speed]:<7}{arg:>4}  {LED_MODES[led]:<22}{priority:>8}")
+
+async def update(address, changes):
+    async with BleakClient(address) as client:
+        table = await client.read_gatt_char(GAME_RULES_CHARACTERISTIC_UUID)
+        if changes:
+            entries = [list(effect) for effect in EFFECT.iter_unpack(table)]
+            packet = b''
+            for color, values in changes.items():
+                effect = entries[COLORS.index(color)]
+                for field, value in values.items():
+                    effect[FIELDS.index(field)] = value
+                packet += struct.pack('<B', COLORS.index(color)) + EFFECT.pack(*effect)
+            # one write, so all changes apply together
+            await client.write_gatt_char(GAME_RULES_CHARACTERISTIC_UUID, packet, response=True)
+            table = await client.read_gatt_char(GAME_RULES_CHARACTERISTIC_UUID)
+        print_table(address, table)
+
+def parse_change(text):
+    """color.field=value, e.g. green.cooldown=8000 or black.led=flash_back"""
+    target, value = text.split('=')
+    color, field = target.split('.')
+    if color not in COLORS or field not in FIELDS:
+        raise argparse.ArgumentTypeError(f"unknown rule {target}")
+    if field == 'speed':
+        value = SPEED_MODES.index(value)
+    elif field == 'led':
+        value = LED_MODES.index(value)
+    else:
+        value = int(value)
+    return color, field, value
+
+async def main():
+    parser = argparse.ArgumentParser(description="Show or change the game rules of one or more cars")
+    parser.add_argument("addresses", nargs="*", help="car BLE addresses, defaults to the saved one")
+    parser.add_argument("--set", dest="changes", type=parse_change, action="append", default=[],
+                        metavar="COLOR.FIELD=VALUE", help=f"fields: {', '.join(FIELDS)}")
+    args = parser.parse_args()
+
+    addresses = args.addresses or [load_saved_address()]
+    if None in addresses:
+        print("No device address given and none saved. Exiting.")
+        return
+
+    changes = {}
+    for color, field, value in args.changes:
+        changes.setdefault(color, {})[field] = value
+
+    await asyncio.gather(*(update(address, changes) for address in addresses))
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,122 @@
+import struct
+import zlib
+
+# fixed point format of the firmware activations, must match NN_ACTIVATION_FRAC_BITS
+ACTIVATION_FRAC_BITS = 11
+# must match NN_MAX_WEIGHT_SHIFT
+MAX_WEIGHT_SHIFT = 31 - ACTIVATION_FRAC_BITS
+
+MODEL_HEADER_PATH = '../firmware/main/color_model.h'
+MODEL_BLOB_PATH = 'color_model.bin'
+
+# must match model_store.h
+MODEL_BLOB_MAGIC = 0x4E4E4352
+MODEL_BLOB_FORMAT = 1
+
+# (weights name, weights dims, bias name, bias dims) in firmware layer order
+LAYER_NAMES = [("input_weights", "INPUT_SIZE][HIDDEN_SIZE1", "hidden_bias1", "HIDDEN_SIZE1"),
+               ("hidden_weights1", "HIDDEN_SIZE1][HIDDEN_SIZE2", "hidden_bias2", "HIDDEN_SIZE2"),
+               ("hidden_weights2", "HIDDEN_SIZE2][OUTPUT_SIZE", "output_bias", "OUTPUT_SIZE")]
+
+SHIFT_NAMES = ["input_shift", "hidden1_shift", "hidden2_shift"]
+
+
+def to_float32(f):
+    return struct.unpack('<f', struct.pack('<f', f))[0]
+
+def c_float(f):
+    # exact C99 hex float literal of the float32 value
+    f = to_float32(f)
+    if f == 0:
+        return "0.0f"
+    mantissa, exponent = float.hex(f).split('p')
+    mantissa = mantissa.rstrip('0').rstrip('.')
+    return f"{mantissa}p{exponent}f"
+
+def weight_shift(weights, limit=127):
+    # largest power of two scale that keeps every weight inside int8, all zero weights get the largest shift
+    largest = max(abs(w) for row in weights for w in row)
+    shift = 0
+    while shift < MAX_WEIGHT_SHIFT and largest * 2 ** (shift + 1) <= limit:
+        shift += 1
+    return shift
+
+def quantize_layer(weights, bias):
+    shift = weight_shift(weights)
+    q_weights = [[max(-127, min(127, round(w * 2 ** shift))) for w in row] for row in weights]
+    q_bias = [round(b * 2 ** (ACTIVATION_FRAC_BITS + shift)) for b in bias]
+    return q_weights, q_bias, shift
+
+def quantize_network(layers):
+    return [quantize_layer(weights, bias) for weights, bias in layers]
+
+def format_initializer(name, weights, bias, fmt):
+    lines = [f"        .{name[0]} = {{"]
+    for row in weights:
+        lines.append("                {" + ", ".join(fmt(w) for w in row) + "},")
+    lines.append("        },")
+    lines.append(f"        .{name[2]} = {{" + ", ".join(fmt(b) for b in bias) + "},")
+    return lines
+
+def format_model_header(layers):
+    """C header holding the model as a flash resident const NeuralNetwork.
+
+    layers is a list of (weights, bias) per layer, as nested python lists.
+    """
+    q_layers = quantize_network(layers)
+
+    out = ["// color_model.h",
+           "// Generated by scripts/trainer.py -- do not edit by hand",
+           "",
+           "#ifndef COLOR_MODEL_H",
+           "#define COLOR_MODEL_H",
+           "",
+           '#include "color_predictor.h"',
+           "",
+           "#if COLOR_PREDICTOR_QUANTIZED",
+           "static const NeuralNetwork color_model = {"]
+    for (q_weights, q_bias, _), name in zip(q_layers, LAYER_NAMES):
+        out += format_initializer(name, q_weights, q_bias, str)
+    for (_, _, shift), name in zip(q_layers, SHIFT_NAMES):
+        out.append(f"        .{name} = {shift},")
+    out += ["};",
+            "#else",
+            "static const NeuralNetwork color_model = {"]
+    for (weights, bias), name in zip(layers, LAYER_NAMES):
+        out += format_initializer(name, weights, bias, c_float)
+    out += ["};",
+            "#endif",
+            "",
+            "#endif // COLOR_MODEL_H",
+            ""]
+    return "\n".join(out)
+
+def write_model_header(layers, path=MODEL_HEADER_PATH):
+    with open(path, 'w') as f:
+        f.write(format_model_header(layers))
+
+def pack_payload(layers, quantized):
+    """Bytes of the firmware NeuralNetwork struct (RISC-V, little endian)."""
+    weights = [w for layer_weights, _ in layers for row in layer_weights for w in row]
+    biases = [b for _, layer_bias in layers for b in layer_bias]
+    if not quantized:
+        return struct.pack(f'<{len(weights)}f{len(biases)}f', *weights, *biases)
+
+    q_layers = quantize_network(layers)
+    q_weights = [w for layer_weights, _, _ in q_layers for row in layer_weights for w in row]
+    q_biases = [b for _, layer_bias, _ in q_layers for b in layer_bias]
+    shifts = [shift for _, _, shift in q_layers]
+    payload = struct.pack(f'<{len(q_weights)}b{len(q_biases)}i3B', *q_weights, *q_biases, *shifts)
+    # struct padding up to the int32 alignment
+    return payload + bytes(-len(payload) % 4)
+
+def format_model_blob(layers, version, quantized=True):
+    """Versioned, CRC checked model blob accepted by the firmware model characteristic."""
+    payload = pack_payload(layers, quantized)
+    header = struct.pack('<IBBHII', MODEL_BLOB_MAGIC, MODEL_BLOB_FORMAT, int(quantized),
+                         len(payload), version, zlib.crc32(payload))
+    return header + payload
+
+def write_model_blob(layers, version, path=MODEL_BLOB_PATH, quantized=True):
+    with open(path, 'wb') as f:
+        f.write(format_model_blob(layers, version, quantized))
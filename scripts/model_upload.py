@@ -0,0 +1,51 @@
+import argparse
+import asyncio
+import json
+import os
+import struct
+from bleak import BleakClient
+
+from model_export import MODEL_BLOB_PATH
+
+CONFIG_FILE = "ble_device_config.json"
+MODEL_CHARACTERISTIC_UUID = "9d3c62a4-3b8e-4f1a-9a1c-6a5c8e2b7f10"
+
+# offset prefix + chunk has to fit one ATT write at the default 256 byte MTU
+CHUNK_SIZE = 240
+
+
+def load_saved_address():
+    if os.path.exists(CONFIG_FILE):
+        with open(CONFIG_FILE, "r") as f:
+            return json.load(f).get("ble_address")
+    return None
+
+async def upload(address, blob):
+    async with BleakClient(address) as client:
+        for offset in range(0, len(blob), CHUNK_SIZE):
+            chunk = struct.pack('<H', offset) + blob[offset:offset + CHUNK_SIZE]
+            await client.write_gatt_char(MODEL_CHARACTERISTIC_UUID, chunk, response=True)
+
+        active = struct.unpack('<I', await client.read_gatt_char(MODEL_CHARACTERISTIC_UUID))[0]
+        expected = struct.unpack_from('<I', blob, 8)[0]
+        status = "ok" if active == expected else "FAILED"
+        print(f"{address}: model version {active} active ({status})")
+
+async def main():
+    parser = argparse.ArgumentParser(description="Upload a color model to one or more cars over BLE")
+    parser.add_argument("addresses", nargs="*", help="car BLE addresses, defaults to the saved one")
+    parser.add_argument("--model", default=MODEL_BLOB_PATH, help="model blob written by trainer.py")
+    args = parser.parse_args()
+
+    addresses = args.addresses or [load_saved_address()]
+    if None in addresses:
+        print("No device address given and none saved. Exiting.")
+        return
+
+    with open(args.model, "rb") as f:
+        blob = f.read()
+
+    await asyncio.gather(*(upload(address, blob) for address in addresses))
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,129 @@
+import argparse
+import asyncio
+import json
+import os
+import struct
+import zlib
+from bleak import BleakClient
+
+CONFIG_FILE = "ble_device_config.json"
+OTA_CONTROL_CHARACTERISTIC_UUID = "7ad671aa-21c0-46a4-b722-270e3ae3d830"
+OTA_DATA_CHARACTERISTIC_UUID = "23408888-1f40-4cd8-9b89-ca8d45f8a5b0"
+DEFAULT_IMAGE = "../firmware/build/hello_world.bin"
+
+# see firmware/main/ota.h, svr_chr_ota_control_val_t in gatt_svr.h
+REQUEST = 1
+REQUEST_ACK, REQUEST_NAK, DONE, DONE_ACK, DONE_NAK, DATA_ACK, DATA_NAK = 2, 3, 4, 5, 6, 7, 8
+STATUS = struct.Struct('<BII')      # status, offset, size
+CHUNK_HEADER = struct.Struct('<I')  # offset
+
+WINDOW = 8          # chunks sent ahead of the last acknowledged one
+ACK_TIMEOUT_S = 2
+RETRIES = 5         # reconnects before giving up on a car
+
+
+def load_saved_address():
+    if os.path.exists(CONFIG_FILE):
+        with open(CONFIG_FILE, "r") as f:
+            return json.load(f).get("ble_address")
+    return None
+
+
+class Transfer:
+    """Acknowledgments of one connection. A NAK means a chunk got lost, everything from its offset is sent again."""
+
+    def __init__(self):
+        self.answers = asyncio.Queue()
+        self.acked = 0
+        self.rewind = None
+        self.recovering = False
+        self.progress = asyncio.Event()
+
+    def on_notify(self, _sender, data):
+        status, offset, _size = STATUS.unpack(data)
+        if status == DATA_ACK:
+            self.acked = offset
+            self.recovering = False
+        elif status == DATA_NAK:
+            # the chunks still in flight behind a lost one all get a NAK, one rewind is enough
+            if not self.recovering:
+                self.rewind = offset
+                self.recovering = True
+        else:
+            self.answers.put_nowait((status, offset))
+        self.progress.set()
+
+
+async def send_image(client, image, crc):
+    transfer = Transfer()
+    await client.start_notify(OTA_CONTROL_CHARACTERISTIC_UUID, transfer.on_notify)
+
+    await client.write_gatt_char(OTA_CONTROL_CHARACTERISTIC_UUID,
+                                 bytes([REQUEST]) + struct.pack('<II', len(image), crc), response=True)
+    status, offset = await asyncio.wait_for(transfer.answers.get(), ACK_TIMEOUT_S * 5)
+    if status != REQUEST_ACK:
+        raise RuntimeError("update refused, is the car standing still?")
+    if offset:
+        print(f"{client.address}: resuming at {offset} of {len(image)} bytes")
+
+    # one ATT write without response at the negotiated MTU
+    chunk_size = min(client.mtu_size - 3, 512) - CHUNK_HEADER.size
+    transfer.acked = offset
+    sent = offset
+    while transfer.acked < len(image):
+        if transfer.rewind is not None:
+            sent = transfer.rewind
+            transfer.rewind = None
+        if sent < len(image) and sent - transfer.acked < WINDOW * chunk_size:
+            chunk = CHUNK_HEADER.pack(sent) + image[sent:sent + chunk_size]
+            await client.write_gatt_char(OTA_DATA_CHARACTERISTIC_UUID, chunk, response=False)
+            sent += len(chunk) - CHUNK_HEADER.size
+            continue
+        transfer.progress.clear()
+        try:
+            await asyncio.wait_for(transfer.progress.wait(), ACK_TIMEOUT_S)
+        except asyncio.TimeoutError:
+            sent = transfer.acked
+            transfer.recovering = False
+
+    await client.write_gatt_char(OTA_CONTROL_CHARACTERISTIC_UUID, bytes([DONE]), response=True)
+    status, _offset = await asyncio.wait_for(transfer.answers.get(), ACK_TIMEOUT_S * 5)
+    if status != DONE_ACK:
+        raise RuntimeError("image rejected by the car")
+
+
+async def update(address, image):
+    crc = zlib.crc32(image)
+    for attempt in range(RETRIES + 1):
+        try:
+            async with BleakClient(address) as client:
+                await send_image(client, image, crc)
+            print(f"{address}: updated, rebooting")
+            return True
+        except RuntimeError as e:
+            print(f"{address}: {e}")
+            return False
+        except Exception as e:
+            # the car keeps what it got, the next request for the same image resumes
+            print(f"{address}: connection lost ({e}), {RETRIES - attempt} retries left")
+    return False
+
+
+async def main():
+    parser = argparse.ArgumentParser(description="Update the firmware of one or more cars over BLE")
+    parser.add_argument("addresses", nargs="*", help="car BLE addresses, defaults to the saved one")
+    parser.add_argument("--image", default=DEFAULT_IMAGE, help="application image built by idf.py build")
+    args = parser.parse_args()
+
+    addresses = args.addresses or [load_saved_address()]
+    if None in addresses:
+        print("No device address given and none saved. Exiting.")
+        return
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    await asyncio.gather(*(update(address, image) for address in addresses))
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,82 @@
+import argparse
+import json
+import os
+import struct
+import subprocess
+import time
+
+# see firmware/main/race_broadcast.h
+RACE_COMPANY_ID = 0xFFFF
+RACE_MAGIC = 0x4452
+RACE_PROTOCOL_VERSION = 1
+RACE_EVENTS = {"start": 0, "freeze": 1, "game": 2}
+GAME_STATES = {"red": 0, "black": 1, "green": 2, "white": 3, "yellow": 4}
+STATE_FILE = "race_director_state.json"
+
+AD_TYPE_FLAGS = 0x01
+AD_TYPE_MFG_DATA = 0xFF
+ADV_INTERVAL = 0x20  # 20 ms, 0.625 ms units
+HOLD_S = 0.5  # keep advertising after the event fired, for cars that missed the countdown
+
+
+def race_packet(session, sequence, event, argument, delay_ms):
+    return struct.pack('<HHBBBBBH', RACE_COMPANY_ID, RACE_MAGIC, RACE_PROTOCOL_VERSION,
+                       session, sequence, event, argument, delay_ms)
+
+def adv_data(packet):
+    data = bytes([2, AD_TYPE_FLAGS, 0x04, len(packet) + 1, AD_TYPE_MFG_DATA]) + packet
+    return data + bytes(31 - len(data))
+
+def next_sequence(session):
+    # the cars apply every (session, sequence) once, so count up per session across runs
+    state = {}
+    if os.path.exists(STATE_FILE):
+        with open(STATE_FILE, "r") as f:
+            state = json.load(f)
+    sequence = (state.get(str(session), -1) + 1) & 0xFF
+    state[str(session)] = sequence
+    with open(STATE_FILE, "w") as f:
+        json.dump(state, f)
+    return sequence
+
+def hci_cmd(device, ocf, payload):
+    # LE controller commands, OGF 0x08
+    subprocess.run(["hcitool", "-i", device, "cmd", "0x08", f"0x{ocf:04x}"] + [f"{b:02x}" for b in payload],
+                   check=True, stdout=subprocess.DEVNULL)
+
+def main():
+    parser = argparse.ArgumentParser(description="Broadcast a race director event to every car in range (Linux, BlueZ)")
+    parser.add_argument("event", choices=RACE_EVENTS.keys())
+    parser.add_argument("--game", choices=GAME_STATES.keys(), help="game state for the game event, required with it")
+    parser.add_argument("--delay", type=int, default=1000, help="ms until the cars act on the event")
+    parser.add_argument("--session", type=int, default=1, help="race session id, 0-255")
+    parser.add_argument("--device", default="hci0")
+    args = parser.parse_args()
+    if args.event == "game" and args.game is None:
+        parser.error("the game event needs --game")
+
+    event = RACE_EVENTS[args.event]
+    argument = GAME_STATES[args.game] if args.event == "game" else 0
+    sequence = next_sequence(args.session)
+
+    # non connectable undirected advertising on all three channels
+    hci_cmd(args.device, 0x0006, struct.pack('<HHBBB6sBB', ADV_INTERVAL, ADV_INTERVAL, 0x03, 0, 0,
+                                              bytes(6), 0x07, 0))
+    hci_cmd(args.device, 0x0008, bytes([31]) + adv_data(race_packet(args.session, sequence, event, argument,
+                                                                     max(args.delay, 0))))
+    hci_cmd(args.device, 0x000A, [1])
+
+    # count the delay down in every update, so whichever repeat a car receives it acts at the same moment
+    fire_at = time.monotonic() + max(args.delay, 0) / 1000
+    try:
+        while time.monotonic() < fire_at + HOLD_S:
+            delay_ms = max(0, int((fire_at - time.monotonic()) * 1000))
+            hci_cmd(args.device, 0x0008, bytes([31]) + adv_data(race_packet(args.session, sequence, event,
+                                                                             argument, delay_ms)))
+            time.sleep(ADV_INTERVAL * 0.625 / 1000)
+    finally:
+        hci_cmd(args.device, 0x000A, [0])
+    print(f"Sent {args.event} (session {args.session}, sequence {sequence})")
+
+if __name__ == "__main__":
+    main()
@@ -1,81 +1,124 @@
+import argparse
 import numpy as np
 import re
 import struct
-from sklearn.utils import shuffle
-from sklearn.model_selection import train_test_split
+import time
+from model_export import (ACTIVATION_FRAC_BITS, MODEL_BLOB_PATH, MODEL_HEADER_PATH, quantize_layer,
+                          quantize_network, write_model_blob, write_model_header)
+
+# class index order of the firmware game_status enum
+COLOR_LABELS = ['Red', 'Black', 'Green', 'White']
+
+# raw sensor counts are the firmware's Q11 input activations
+INPUT_SCALE = 2 ** ACTIVATION_FRAC_BITS
+
+LAYER_SIZES = [4, 16, 8, len(COLOR_LABELS)]
+
+
+def softmax(x):
+    exp_x = np.exp(x - np.max(x, axis=1, keepdims=True))
+    return exp_x / np.sum(exp_x, axis=1, keepdims=True)
+
+def cross_entropy(logits, y):
+    return -np.mean(np.sum(y * np.log(softmax(logits) + 1e-12), axis=1))
 
 class NeuralNetwork:
-    def __init__(self, input_size, hidden_size1, hidden_size2, output_size):
-        self.input_size = input_size
-        self.hidden_size1 = hidden_size1
-        self.hidden_size2 = hidden_size2
-        self.output_size = output_size
-
-        self.input_weights = np.random.randn(input_size, hidden_size1).astype(np.float32) * np.sqrt(2.0/input_size)
-        self.hidden_weights1 = np.random.randn(hidden_size1, hidden_size2).astype(np.float32) * np.sqrt(2.0/hidden_size1)
-        self.hidden_weights2 = np.random.randn(hidden_size2, output_size).astype(np.float32) * np.sqrt(2.0/hidden_size2)
-        self.hidden_bias1 = np.zeros((1, hidden_size1), dtype=np.float32)
-        self.hidden_bias2 = np.zeros((1, hidden_size2), dtype=np.float32)
-        self.output_bias = np.zeros((1, output_size), dtype=np.float32)
-
-    def relu(self, x):
-        return np.maximum(0, x)
-
-    def relu_derivative(self, x):
-        return np.where(x > 0, 1, 0)
-
-    def softmax(self, x):
-        exp_x = np.exp(x - np.max(x, axis=1, keepdims=True))
-        return exp_x / np.sum(exp_x, axis=1, keepdims=True)
-
-    def forward(self, X):
-        self.hidden1 = self.relu(np.dot(X, self.input_weights) + self.hidden_bias1)
-        self.hidden2 = self.relu(np.dot(self.hidden1, self.hidden_weights1) + self.hidden_bias2)
-        self.output = self.softmax(np.dot(self.hidden2, self.hidden_weights2) + self.output_bias)
-        return self.output
-
-    def backward(self, X, y, output, learning_rate):
-        output_error = y - output
-        hidden2_error = np.dot(output_error, self.hidden_weights2.T)
-        hidden1_error = np.dot(hidden2_error, self.hidden_weights1.T)
-
-        hidden2_delta = hidden2_error * self.relu_derivative(self.hidden2)
-        hidden1_delta = hidden1_error * self.relu_derivative(self.hidden1)
-
-        self.hidden_weights2 += learning_rate * np.dot(self.hidden2.T, output_error)
-        self.hidden_weights1 += learning_rate * np.dot(self.hidden1.T, hidden2_delta)
-        self.input_weights += learning_rate * np.dot(X.T, hidden1_delta)
-
-        self.output_bias += learning_rate * np.sum(output_error, axis=0, keepdims=True)
-        self.hidden_bias2 += learning_rate * np.sum(hidden2_delta, axis=0, keepdims=True)
-        self.hidden_bias1 += learning_rate * np.sum(hidden1_delta, axis=0, keepdims=True)
-
-    def train(self, X, y, X_val, y_val, epochs, learning_rate, batch_size=32, patience=50):
-        best_val_loss = float('inf')
-        patience_counter = 0
+    """ReLU MLP trained on softmax cross-entropy with Adam, every batch is a handful of matrix products.
+
+    With quantize=True the forward pass uses the int8 weights, int32 biases and Q11 activations the
+    firmware integer path uses, and gradients pass straight through the rounding to the float weights.
+    Fine tuning that way keeps the exported quantized model as accurate as the float one.
+    """
+
+    def __init__(self, sizes, rng):
+        self.weights = [(rng.standard_normal((n_in, n_out)) * np.sqrt(2.0 / n_in)).astype(np.float32)
+                        for n_in, n_out in zip(sizes[:-1], sizes[1:])]
+        self.biases = [np.zeros(n_out, dtype=np.float32) for n_out in sizes[1:]]
+        # every parameter array is updated in place, so params keeps pointing at them
+        self.params = self.weights + self.biases
+        self.adam_m = [np.zeros_like(p) for p in self.params]
+        self.adam_v = [np.zeros_like(p) for p in self.params]
+        self.adam_step = 0
+
+    def effective_layers(self, quantize):
+        if not quantize:
+            return self.weights, self.biases
+        weights, biases = [], []
+        for w, b in zip(self.weights, self.biases):
+            q_w, q_b, shift = quantize_layer(w.tolist(), b.tolist())
+            weights.append(np.array(q_w, dtype=np.float32) / 2 ** shift)
+            biases.append(np.array(q_b, dtype=np.float32) / 2 ** (ACTIVATION_FRAC_BITS + shift))
+        return weights, biases
+
+    def forward(self, X, quantize=False):
+        """Logits for a batch, keeps what backward needs."""
+        weights, biases = self.effective_layers(quantize)
+        self.used_weights = weights
+        self.activations = [X]
+        x = X
+        for w, b in zip(weights[:-1], biases[:-1]):
+            x = np.maximum(x @ w + b, 0)
+            if quantize:
+                x = np.round(x * INPUT_SCALE) / INPUT_SCALE
+            self.activations.append(x)
+        return x @ weights[-1] + biases[-1]
+
+    def backward(self, logits, y, learning_rate):
+        # gradient of the mean softmax cross-entropy with respect to the logits
+        delta = (softmax(logits) - y) / len(y)
+        grads_w, grads_b = [], []
+        for i in reversed(range(len(self.weights))):
+            a = self.activations[i]
+            grads_w.insert(0, a.T @ delta)
+            grads_b.insert(0, np.sum(delta, axis=0))
+            if i > 0:
+                delta = (delta @ self.used_weights[i].T) * (a > 0)
+        self.adam(grads_w + grads_b, learning_rate)
+
+    def adam(self, grads, learning_rate, beta1=0.9, beta2=0.999, eps=1e-8):
+        self.adam_step += 1
+        for p, g, m, v in zip(self.params, grads, self.adam_m, self.adam_v):
+            m *= beta1
+            m += (1 - beta1) * g
+            v *= beta2
+            v += (1 - beta2) * g * g
+            m_hat = m / (1 - beta1 ** self.adam_step)
+            v_hat = v / (1 - beta2 ** self.adam_step)
+            p -= learning_rate * m_hat / (np.sqrt(v_hat) + eps)
+
+    def fit(self, X, y, epochs, learning_rate, batch_size, rng, X_val=None, y_val=None, patience=30,
+            quantize=False):
+        """Mini-batch training. With validation data it stops early and keeps the best weights.
+
+        Returns the number of epochs that gave the kept weights.
+        """
+        best_loss = float('inf')
+        best_epoch = epochs
+        best_params = None
         for epoch in range(epochs):
-            epoch_loss = 0
-            for i in range(0, len(X), batch_size):
-                batch_X = X[i:i+batch_size]
-                batch_y = y[i:i+batch_size]
-                output = self.forward(batch_X)
-                self.backward(batch_X, batch_y, output, learning_rate)
-                epoch_loss += np.mean(np.square(batch_y - output))
-
-            val_output = self.forward(X_val)
-            val_loss = np.mean(np.square(y_val - val_output))
-
-            if epoch % 100 == 0:
-                print(f"Epoch {epoch}, Loss: {epoch_loss/len(X)}, Val Loss: {val_loss}")
-
-            if val_loss < best_val_loss:
-                best_val_loss = val_loss
-                patience_counter = 0
-            else:
-                patience_counter += 1
-                if patience_counter >= patience:
-                    print(f"Early stopping at epoch {epoch}")
-                    break
+            order = rng.permutation(len(X))
+            for start in range(0, len(X), batch_size):
+                batch = order[start:start + batch_size]
+                logits = self.forward(X[batch], quantize)
+                self.backward(logits, y[batch], learning_rate)
+
+            if X_val is None:
+                continue
+            val_loss = cross_entropy(self.forward(X_val, quantize), y_val)
+            if val_loss < best_loss:
+                best_loss = val_loss
+                best_epoch = epoch + 1
+                best_params = [p.copy() for p in self.params]
+            elif epoch + 1 - best_epoch >= patience:
+                break
+
+        if best_params is not None:
+            for p, best in zip(self.params, best_params):
+                p[...] = best
+        return best_epoch
+
+    def predict(self, X):
+        return np.argmax(self.forward(X), axis=1)
 
 def parse_input(file_path):
     data = []
@@ -89,74 +132,182 @@ def parse_input(file_path):
                 labels.append(color)
     return np.array(data), np.array(labels)
 
+def parse_capture(file_path):
+    # back to back capture notifications written by capture.py, see firmware/main/capture.h
+    data = []
+    labels = []
+    with open(file_path, 'rb') as file:
+        blob = file.read()
+    offset = 0
+    while offset < len(blob):
+        version, label, _sequence, count, _dropped = struct.unpack_from('<BBHBB', blob, offset)
+        if version != 1:
+            raise ValueError(f"{file_path}: unsupported capture version {version} at byte {offset}")
+        offset += 6
+        for r, g, b, c in struct.iter_unpack('<HHHH', blob[offset:offset + count * 8]):
+            data.append([r, g, b, c])
+            labels.append(COLOR_LABELS[label])
+        offset += count * 8
+    return np.array(data), np.array(labels)
+
+def load_data(file_paths):
+    """Raw counts, labels and the index of the file each sample came from, one file per venue.
+
+    Serial logs (.txt) and BLE captures (.bin) can be mixed.
+    """
+    parts = [parse_capture(path) if path.endswith('.bin') else parse_input(path) for path in file_paths]
+    venues = [np.full(len(d), i) for i, (d, _) in enumerate(parts)]
+    return (np.concatenate([d for d, _ in parts]), np.concatenate([l for _, l in parts]),
+            np.concatenate(venues))
+
 def normalize_data(data):
-    return data / np.array([2048, 2048, 2048, 2048])
+    return (data / INPUT_SCALE).astype(np.float32)
 
 def one_hot_encode(labels):
-    unique_labels = np.array(['Red', 'Black', 'Green', 'White'])
-    label_dict = {label: i for i, label in enumerate(unique_labels)}
-    encoded = np.zeros((len(labels), len(unique_labels)))
-    for i, label in enumerate(labels):
-        encoded[i, label_dict[label]] = 1
-    return encoded, unique_labels
-
-def float_to_hex(f):
-    return hex(struct.unpack('<I', struct.pack('<f', f))[0])
-
-# Prepare training data
-input_data, labels = parse_input('color_data.txt')
-X = normalize_data(input_data)
-y, unique_labels = one_hot_encode(labels)
-
-# Split data into train and validation sets
-X_train, X_val, y_train, y_val = train_test_split(X, y, test_size=0.2, random_state=42)
-
-# Create and train the neural network
-nn = NeuralNetwork(input_size=4, hidden_size1=16, hidden_size2=8, output_size=4)
-nn.train(X_train, y_train, X_val, y_val, epochs=10000, learning_rate=0.001, batch_size=32, patience=50)
-
-# Print C-compatible array initializers
-print("\nC-compatible array initializers:")
-print("uint32_t input_weights[INPUT_SIZE][HIDDEN_SIZE1] = {")
-for row in nn.input_weights:
-    print("    {" + ", ".join(float_to_hex(x) for x in row) + "},")
-print("};")
-
-print("\nuint32_t hidden_weights1[HIDDEN_SIZE1][HIDDEN_SIZE2] = {")
-for row in nn.hidden_weights1:
-    print("    {" + ", ".join(float_to_hex(x) for x in row) + "},")
-print("};")
-
-print("\nuint32_t hidden_weights2[HIDDEN_SIZE2][OUTPUT_SIZE] = {")
-for row in nn.hidden_weights2:
-    print("    {" + ", ".join(float_to_hex(x) for x in row) + "},")
-print("};")
-
-print("\nuint32_t hidden_bias1[HIDDEN_SIZE1] = {" + ", ".join(float_to_hex(x) for x in nn.hidden_bias1.flatten()) + "};")
-print("\nuint32_t hidden_bias2[HIDDEN_SIZE2] = {" + ", ".join(float_to_hex(x) for x in nn.hidden_bias2.flatten()) + "};")
-print("\nuint32_t output_bias[OUTPUT_SIZE] = {" + ", ".join(float_to_hex(x) for x in nn.output_bias.flatten()) + "};")
-
-# Debug information
-print("\nSample predictions from Python:")
-for i in range(min(5, len(X))):  # Print predictions for up to 5 samples
-    sample_output = nn.forward(X[i:i+1])
-    print(f"Input: {input_data[i]}, True label: {labels[i]}")
-    print(f"Output: {sample_output[0]}")
-    print(f"Predicted: {unique_labels[np.argmax(sample_output)]}\n")
-
-print("Sample weight values:")
-print("Input weights (first few):", nn.input_weights[:2, :2])
-print("Hidden weights1 (first few):", nn.hidden_weights1[:2, :2])
-print("Hidden weights2 (first few):", nn.hidden_weights2[:2, :2])
-print("Hidden bias1 (first few):", nn.hidden_bias1[0, :2])
-print("Hidden bias2 (first few):", nn.hidden_bias2[0, :2])
-print("Output bias (all):", nn.output_bias[0])
-
-# Test with a specific input
-test_input = np.array([[1794, 2164, 1742, 1996]])  # Example for white
-test_input_normalized = normalize_data(test_input)
-test_output = nn.forward(test_input_normalized)
-print("\nTest prediction:")
-print("Input:", test_input[0])
-print("Output:", test_output[0])
-print("Predicted color:", unique_labels[np.argmax(test_output)])
+    indices = np.array([COLOR_LABELS.index(label) for label in labels])
+    return np.eye(len(COLOR_LABELS), dtype=np.float32)[indices], indices
+
+def model_layers(nn):
+    # (weights, bias) per layer as plain lists, the format model_export works on
+    return [(w.tolist(), b.tolist()) for w, b in zip(nn.weights, nn.biases)]
+
+def quantized_forward(layers, raw_input):
+    # bit exact model of the firmware integer forward pass, raw counts are already Q11
+    x = raw_input.astype(np.int64)
+    for i, (q_weights, q_bias, shift) in enumerate(layers):
+        acc = np.dot(x, np.array(q_weights, dtype=np.int64)) + np.array(q_bias, dtype=np.int64)
+        if i == len(layers) - 1:
+            return acc
+        # relu_rescale: a shift of 0 has nothing to round
+        rescaled = acc if shift == 0 else (acc + (1 << (shift - 1))) >> shift
+        x = np.where(acc > 0, rescaled, 0)
+
+def quantized_predict(nn, raw_input):
+    return np.argmax(quantized_forward(quantize_network(model_layers(nn)), raw_input), axis=1)
+
+def make_folds(venues, folds, per_venue, rng):
+    """(train, test) index arrays, one held out venue per fold or shuffled k-fold."""
+    if per_venue:
+        return [(np.flatnonzero(venues != v), np.flatnonzero(venues == v)) for v in np.unique(venues)]
+    chunks = np.array_split(rng.permutation(len(venues)), folds)
+    return [(np.concatenate(chunks[:i] + chunks[i + 1:]), chunks[i]) for i in range(folds)]
+
+def train_model(raw, y, args, rng, epochs=None, qat_epochs=None, validation=0.1):
+    """Float training followed by quantization aware fine tuning.
+
+    Without explicit epoch counts a slice of the data is held out for early stopping.
+    Returns the network, float only predictions of it before fine tuning, and the epochs used.
+    """
+    X = normalize_data(raw)
+    nn = NeuralNetwork(LAYER_SIZES, rng)
+    if epochs is None:
+        order = rng.permutation(len(X))
+        n_val = max(1, int(len(X) * validation))
+        train, val = order[n_val:], order[:n_val]
+        epochs = nn.fit(X[train], y[train], args.epochs, args.learning_rate, args.batch_size, rng,
+                        X[val], y[val], args.patience)
+        float_nn = [p.copy() for p in nn.params]
+        qat_epochs = nn.fit(X[train], y[train], args.qat_epochs, args.learning_rate / 10, args.batch_size, rng,
+                            X[val], y[val], args.patience, quantize=True)
+    else:
+        nn.fit(X, y, epochs, args.learning_rate, args.batch_size, rng)
+        float_nn = [p.copy() for p in nn.params]
+        nn.fit(X, y, qat_epochs, args.learning_rate / 10, args.batch_size, rng, quantize=True)
+    return nn, float_nn, epochs, qat_epochs
+
+def evaluate(raw, y, venues, args, rng):
+    """k-fold benchmark of the float model, its plain int8 export and the fine tuned int8 export."""
+    X = normalize_data(raw)
+    truth = np.argmax(y, axis=1)
+    epochs, qat_epochs = [], []
+    scores = []
+    print(f"{'fold':>6} {'samples':>8} {'float':>8} {'int8':>8} {'int8 QAT':>9} {'agree':>8}")
+    for fold, (train, test) in enumerate(make_folds(venues, args.folds, args.per_venue, rng)):
+        nn, float_params, fold_epochs, fold_qat_epochs = train_model(raw[train], y[train], args, rng)
+        epochs.append(fold_epochs)
+        qat_epochs.append(fold_qat_epochs)
+
+        qat_pred = quantized_predict(nn, raw[test])
+        for p, saved in zip(nn.params, float_params):
+            p[...] = saved
+        float_pred = nn.predict(X[test])
+        ptq_pred = quantized_predict(nn, raw[test])
+
+        accuracy = [np.mean(pred == truth[test]) for pred in (float_pred, ptq_pred, qat_pred)]
+        agreement = np.mean(float_pred == qat_pred)
+        scores.append(accuracy + [agreement])
+        print(f"{fold:>6} {len(test):>8} " + " ".join(f"{a * 100:>7.2f}%" for a in accuracy[:2]) +
+              f" {accuracy[2] * 100:>8.2f}% {agreement * 100:>7.2f}%")
+
+    mean = np.mean(scores, axis=0) * 100
+    print(f"{'mean':>6} {len(raw):>8} {mean[0]:>7.2f}% {mean[1]:>7.2f}% {mean[2]:>8.2f}% {mean[3]:>7.2f}%")
+    return int(np.median(epochs)), max(1, int(np.median(qat_epochs)))
+
+def main():
+    parser = argparse.ArgumentParser(description="Train the color classifier and export it for the firmware")
+    parser.add_argument("files", nargs="*", default=["color_data.txt"],
+                        help="capture files from capture.py and/or serial logs, one file per venue")
+    parser.add_argument("--folds", type=int, default=5, help="k for the k-fold benchmark, 0 skips it")
+    parser.add_argument("--per-venue", action="store_true", help="hold out one file per fold")
+    parser.add_argument("--epochs", type=int, default=500, help="upper bound, training stops early")
+    parser.add_argument("--qat-epochs", type=int, default=50, help="quantization aware fine tuning epochs")
+    parser.add_argument("--patience", type=int, default=30)
+    parser.add_argument("--batch-size", type=int, default=64)
+    parser.add_argument("--learning-rate", type=float, default=0.005)
+    parser.add_argument("--seed", type=int, default=42)
+    args = parser.parse_args()
+
+    rng = np.random.default_rng(args.seed)
+    raw, labels, venues = load_data(args.files)
+    y, truth = one_hot_encode(labels)
+    missing = [label for i, label in enumerate(COLOR_LABELS) if not np.any(truth == i)]
+    if missing:
+        print(f"No samples for {', '.join(missing)}, every color is needed. Exiting.")
+        return
+    print(f"{len(raw)} samples from {len(args.files)} file(s): " +
+          ", ".join(f"{label} {np.sum(truth == i)}" for i, label in enumerate(COLOR_LABELS)))
+
+    if args.per_venue and len(args.files) < 2:
+        print("--per-venue needs at least two files. Exiting.")
+        return
+
+    epochs = qat_epochs = None
+    if args.folds > 1 or args.per_venue:
+        start = time.perf_counter()
+        epochs, qat_epochs = evaluate(raw, y, venues, args, rng)
+        print(f"Benchmark took {time.perf_counter() - start:.1f} s, final model trains for "
+              f"{epochs} + {qat_epochs} QAT epochs")
+
+    # the exported model sees all the data
+    start = time.perf_counter()
+    nn, _, _, _ = train_model(raw, y, args, rng, epochs, qat_epochs)
+    print(f"Trained in {time.perf_counter() - start:.1f} s")
+
+    # Write the flash resident model header used by the firmware
+    layers = model_layers(nn)
+    write_model_header(layers)
+    print(f"\nModel written to {MODEL_HEADER_PATH}")
+
+    # ... and the blob model_upload.py sends to cars that are already flashed
+    model_version = int(time.time())
+    write_model_blob(layers, model_version)
+    print(f"Model version {model_version} written to {MODEL_BLOB_PATH}")
+
+    q_layers = quantize_network(layers)
+    print(f"Quantized layer shifts: {[shift for _, _, shift in q_layers]}")
+
+    float_pred = nn.predict(normalize_data(raw))
+    quant_pred = quantized_predict(nn, raw)
+    print(f"\nQuantized agreement with float: {np.mean(float_pred == quant_pred) * 100:.2f}%")
+    print(f"Quantized accuracy (training data): {np.mean(quant_pred == truth) * 100:.2f}%")
+
+    # Test with a specific input
+    test_input = np.array([[1794, 2164, 1742, 1996]])  # Example for white
+    test_output = softmax(nn.forward(normalize_data(test_input)))
+    print("\nTest prediction:")
+    print("Input:", test_input[0])
+    print("Output:", test_output[0])
+    print("Predicted color:", COLOR_LABELS[np.argmax(test_output)])
+
+if __name__ == "__main__":
+    main()